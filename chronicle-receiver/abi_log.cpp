@@ -0,0 +1,257 @@
+// copyright defined in LICENSE.txt
+
+#include "abi_log.hpp"
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <fc/log/logger.hpp>
+
+namespace bip = boost::interprocess;
+namespace bfs = boost::filesystem;
+
+namespace chronicle {
+
+  static const uint64_t ABI_LOG_MAGIC = 0x474f4c4849424143ull; // "CABIHLOG"
+  static const uint32_t ABI_LOG_VERSION = 1;
+
+  // the hash table is declared full at this fill ratio, in percent
+  static const uint64_t ABI_LOG_MAX_LOAD = 80;
+
+  static const uint64_t NO_RECORD = std::numeric_limits<uint64_t>::max();
+
+  // about 3% of the file is used by the hash table of accounts
+  static uint64_t slots_for_size(uint64_t size) {
+    uint64_t slots = 1024;
+    while( slots * 2 * 16 <= size / 32 )
+      slots *= 2;
+    return slots;
+  }
+
+  struct abi_log::header {
+    uint64_t    magic;
+    uint32_t    version;
+    uint32_t    last_block;
+    uint64_t    slot_count;
+    uint64_t    data_size;
+    uint64_t    write_pos;  // end of the last record in the data area
+    uint64_t    entries;
+    uint64_t    accounts;
+    char        reserved[8];
+  };
+
+  struct abi_log::index_slot {
+    uint64_t    account;    // zero marks an empty slot
+    uint64_t    head;       // offset of the newest record of the account
+  };
+
+  struct abi_log::record {
+    uint64_t    account;
+    uint64_t    parent;     // previous revision of the same account
+    uint64_t    jump;       // an older revision, for logarithmic search
+    uint32_t    block_num;
+    uint32_t    depth;      // number of older revisions
+    uint32_t    size;
+    uint32_t    reserved;
+  };
+
+
+  abi_log::abi_log(const std::string& path, bool writable, uint64_t size_mb)
+  {
+    bool created = false;
+    if( !bfs::exists(path) ) {
+      if( !writable )
+        throw std::runtime_error("ABI history log does not exist: " + path);
+      uint64_t size = size_mb * 1024*1024;
+      if( sizeof(header) + slots_for_size(size) * sizeof(index_slot) + 1024*1024 > size )
+        throw std::runtime_error("ABI history log size is too small");
+      std::ofstream ofs(path, std::ofstream::trunc);
+      ofs.close();
+      bfs::resize_file(path, size);
+      created = true;
+    }
+
+    bip::mode_t mode = writable ? bip::read_write : bip::read_only;
+    _file = bip::file_mapping(path.c_str(), mode);
+    _region = bip::mapped_region(_file, mode);
+    _hdr = static_cast<header*>(_region.get_address());
+
+    if( created ) {
+      _hdr->magic = ABI_LOG_MAGIC;
+      _hdr->version = ABI_LOG_VERSION;
+      _hdr->last_block = 0;
+      _hdr->slot_count = slots_for_size(_region.get_size());
+      _hdr->data_size = _region.get_size() - sizeof(header) - _hdr->slot_count * sizeof(index_slot);
+      _hdr->write_pos = 0;
+      _hdr->entries = 0;
+      _hdr->accounts = 0;
+    }
+    else if( _hdr->magic != ABI_LOG_MAGIC || _hdr->version != ABI_LOG_VERSION ) {
+      throw std::runtime_error("Invalid ABI history log file: " + path);
+    }
+
+    _slots = reinterpret_cast<index_slot*>(reinterpret_cast<char*>(_hdr) + sizeof(header));
+    _data = reinterpret_cast<char*>(_slots + _hdr->slot_count);
+    _mask = _hdr->slot_count - 1;
+
+    if( writable && !created && size_mb * 1024*1024 != _region.get_size() ) {
+      wlog("ABI history log ${f} keeps its original size of ${s} MB",
+           ("f",path)("s",_region.get_size()/(1024*1024)));
+    }
+    ilog("ABI history log ${f}: ${e} revisions of ${a} contracts up to block ${b}, ${u} of ${c} MB used",
+         ("f",path)("e",_hdr->entries)("a",_hdr->accounts)("b",_hdr->last_block)
+         ("u",_hdr->write_pos/(1024*1024))("c",_hdr->data_size/(1024*1024)));
+  }
+
+
+  bool abi_log::exists(const std::string& path) {
+    return bfs::exists(path);
+  }
+
+
+  void abi_log::add(uint64_t account, uint32_t block_num, const char* data, size_t size) {
+    // the block was replayed after a restart
+    if( block_num <= _hdr->last_block )
+      return;
+    // only the last setabi within a block is valid
+    for( auto itr = _pending.rbegin(); itr != _pending.rend() && itr->block_num == block_num; ++itr ) {
+      if( itr->account == account ) {
+        itr->data.assign(data, size);
+        return;
+      }
+    }
+    _pending.push_back(pending_entry{account, block_num, std::string(data, size)});
+  }
+
+
+  void abi_log::flush(uint32_t irreversible) {
+    while( !_pending.empty() && _pending.front().block_num <= irreversible ) {
+      append(_pending.front());
+      _pending.pop_front();
+    }
+    if( irreversible > _hdr->last_block )
+      __atomic_store_n(&_hdr->last_block, irreversible, __ATOMIC_RELEASE);
+  }
+
+
+  void abi_log::rollback(uint32_t block_num) {
+    while( !_pending.empty() && _pending.back().block_num >= block_num )
+      _pending.pop_back();
+  }
+
+
+  const abi_log::record* abi_log::record_at(uint64_t offset) const {
+    return reinterpret_cast<const record*>(_data + offset);
+  }
+
+
+  abi_log::index_slot* abi_log::find_slot(uint64_t account) const {
+    uint64_t pos = ((account * 0x9e3779b97f4a7c15ull) >> 32) & _mask;
+    while( true ) {
+      uint64_t a = __atomic_load_n(&_slots[pos].account, __ATOMIC_ACQUIRE);
+      if( a == 0 || a == account )
+        return &_slots[pos];
+      pos = (pos + 1) & _mask;
+    }
+  }
+
+
+  void abi_log::append(const pending_entry& e) {
+    if( e.account == 0 )
+      return;
+
+    uint64_t record_size = (sizeof(record) + e.data.size() + 7) & ~7ull;
+    uint64_t pos = _hdr->write_pos;
+    if( pos + record_size > _hdr->data_size )
+      throw std::runtime_error("ABI history log is full");
+
+    index_slot* slot = find_slot(e.account);
+    bool new_account = (slot->account == 0);
+    if( new_account && (_hdr->accounts + 1) * 100 > _hdr->slot_count * ABI_LOG_MAX_LOAD )
+      throw std::runtime_error("ABI history log index is full");
+
+    record* r = reinterpret_cast<record*>(_data + pos);
+    r->account = e.account;
+    r->block_num = e.block_num;
+    r->size = e.data.size();
+    r->reserved = 0;
+    if( new_account ) {
+      r->parent = NO_RECORD;
+      r->jump = NO_RECORD;
+      r->depth = 0;
+    }
+    else {
+      // skew-binary jump pointers: the distance doubles when two jumps of equal length meet
+      const record* p = record_at(slot->head);
+      r->parent = slot->head;
+      r->depth = p->depth + 1;
+      r->jump = slot->head;
+      if( p->jump != NO_RECORD ) {
+        const record* j = record_at(p->jump);
+        if( j->jump != NO_RECORD && p->depth - j->depth == j->depth - record_at(j->jump)->depth )
+          r->jump = j->jump;
+      }
+    }
+    memcpy(_data + pos + sizeof(record), e.data.data(), e.data.size());
+
+    // the record must be complete before the chain head points to it
+    __atomic_store_n(&_hdr->write_pos, pos + record_size, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->head, pos, __ATOMIC_RELEASE);
+    if( new_account ) {
+      __atomic_store_n(&slot->account, e.account, __ATOMIC_RELEASE);
+      __atomic_store_n(&_hdr->accounts, _hdr->accounts + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&_hdr->entries, _hdr->entries + 1, __ATOMIC_RELEASE);
+  }
+
+
+  bool abi_log::lookup(uint64_t account, uint32_t block_num, lookup_result& result) const {
+    if( account == 0 )
+      return false;
+    const index_slot* slot = find_slot(account);
+    if( __atomic_load_n(&slot->account, __ATOMIC_ACQUIRE) != account )
+      return false;
+
+    uint64_t offset = __atomic_load_n(&slot->head, __ATOMIC_ACQUIRE);
+    const record* r = record_at(offset);
+    result.next_revision = std::numeric_limits<uint32_t>::max();
+    while( r->block_num > block_num ) {
+      if( r->jump != NO_RECORD && record_at(r->jump)->block_num > block_num ) {
+        r = record_at(r->jump);
+      }
+      else {
+        result.next_revision = r->block_num;
+        if( r->parent == NO_RECORD )
+          return false;
+        r = record_at(r->parent);
+      }
+    }
+
+    result.revision = r->block_num;
+    const char* data = reinterpret_cast<const char*>(r) + sizeof(record);
+    result.data.assign(data, data + r->size);
+    return true;
+  }
+
+
+  uint32_t abi_log::last_block() const {
+    return __atomic_load_n(&_hdr->last_block, __ATOMIC_ACQUIRE);
+  }
+
+
+  uint64_t abi_log::entries() const {
+    return __atomic_load_n(&_hdr->entries, __ATOMIC_ACQUIRE);
+  }
+
+
+  uint64_t abi_log::data_used() const {
+    return __atomic_load_n(&_hdr->write_pos, __ATOMIC_ACQUIRE);
+  }
+
+
+  uint64_t abi_log::data_capacity() const {
+    return _hdr->data_size;
+  }
+}
@@ -0,0 +1,79 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace chronicle {
+
+  // Append-only memory-mapped log of contract ABI revisions.
+  //
+  // The scanning receiver appends the revisions of irreversible blocks, so
+  // that the log never needs to be rolled back. Revisions of each account
+  // are chained from the newest to the oldest, and every record carries a
+  // jump pointer that skips exponentially growing distances back in the
+  // chain, so a lookup by block number takes a logarithmic number of steps.
+  // The head of each chain is kept in a hash table by account. Records and
+  // chain heads are published with release semantics, and interactive
+  // readers in other processes do not take any locks.
+
+  class abi_log {
+  public:
+    abi_log(const std::string& path, bool writable, uint64_t size_mb);
+
+    static bool exists(const std::string& path);
+
+    // memorize a revision until its block becomes irreversible. Empty data
+    // means that the ABI was removed.
+    void add(uint64_t account, uint32_t block_num, const char* data, size_t size);
+
+    // write pending revisions for blocks up to and including the given block
+    void flush(uint32_t irreversible);
+
+    // forget pending revisions at or above the fork block
+    void rollback(uint32_t block_num);
+
+    struct lookup_result {
+      uint32_t          revision;       // block of the revision
+      uint32_t          next_revision;  // next revision in the log, or max uint32 if none
+      std::vector<char> data;
+    };
+
+    // latest revision at or below the block. The log is only complete up to last_block().
+    bool lookup(uint64_t account, uint32_t block_num, lookup_result& result) const;
+
+    // all revisions of blocks up to and including this block are in the log
+    uint32_t last_block() const;
+
+    uint64_t entries() const;
+    uint64_t data_used() const;
+    uint64_t data_capacity() const;
+
+  private:
+    struct header;
+    struct index_slot;
+    struct record;
+
+    boost::interprocess::file_mapping   _file;
+    boost::interprocess::mapped_region  _region;
+    header*                             _hdr = nullptr;
+    index_slot*                         _slots = nullptr;
+    char*                               _data = nullptr;
+    uint64_t                            _mask = 0;
+
+    struct pending_entry {
+      uint64_t          account;
+      uint32_t          block_num;
+      std::string       data;
+    };
+    std::deque<pending_entry>           _pending;
+
+    const record* record_at(uint64_t offset) const;
+    index_slot* find_slot(uint64_t account) const;
+    void append(const pending_entry& e);
+  };
+}
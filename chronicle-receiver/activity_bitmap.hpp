@@ -0,0 +1,88 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace chronicle {
+
+  // Compressed sets of block numbers, organized the same way as roaring
+  // bitmaps: block numbers are split into chunks by their high bits, and
+  // each chunk is stored either as a sorted array of 16-bit offsets (sparse
+  // chunks), or as a plain bitmap (dense chunks). Chunks are kept small so
+  // that modifying one within a chainbase undo session stays cheap.
+
+  namespace activity_bitmap {
+
+    const uint32_t chunk_bits = 12;
+    const uint32_t chunk_blocks = 1 << chunk_bits;
+    const size_t   bitmap_bytes = chunk_blocks / 8;
+    const size_t   max_array_entries = bitmap_bytes / sizeof(uint16_t) - 1;
+
+    inline uint32_t chunk_of(uint32_t block_num) {
+      return block_num >> chunk_bits;
+    }
+
+    inline bool is_bitmap(const std::string& container) {
+      return container.size() == bitmap_bytes;
+    }
+
+    // adds a block to the container, returns false if it was already there
+    inline bool add(std::string& container, uint32_t block_num) {
+      uint16_t offset = block_num & (chunk_blocks - 1);
+      if( is_bitmap(container) ) {
+        char mask = 1 << (offset & 7);
+        if( container[offset >> 3] & mask )
+          return false;
+        container[offset >> 3] |= mask;
+        return true;
+      }
+
+      std::vector<uint16_t> entries(container.size() / sizeof(uint16_t));
+      memcpy(entries.data(), container.data(), container.size());
+      auto pos = std::lower_bound(entries.begin(), entries.end(), offset);
+      if( pos != entries.end() && *pos == offset )
+        return false;
+      entries.insert(pos, offset);
+
+      if( entries.size() > max_array_entries ) {
+        container.assign(bitmap_bytes, 0);
+        for( auto e : entries )
+          container[e >> 3] |= 1 << (e & 7);
+      }
+      else {
+        container.assign((const char*)entries.data(), entries.size() * sizeof(uint16_t));
+      }
+      return true;
+    }
+
+    // appends the blocks of a chunk that fall into [start, end) to the result
+    template <typename Container>
+    void get_blocks(const Container& container, uint32_t chunk, uint32_t start, uint32_t end,
+                    std::vector<uint32_t>& result) {
+      uint32_t base = chunk << chunk_bits;
+      if( container.size() == bitmap_bytes ) {
+        for( uint32_t i = 0; i < chunk_blocks; i++ ) {
+          if( container[i >> 3] & (1 << (i & 7)) ) {
+            uint32_t block_num = base + i;
+            if( block_num >= start && block_num < end )
+              result.push_back(block_num);
+          }
+        }
+      }
+      else {
+        size_t count = container.size() / sizeof(uint16_t);
+        for( size_t i = 0; i < count; i++ ) {
+          uint16_t offset;
+          memcpy(&offset, container.data() + i * sizeof(uint16_t), sizeof(offset));
+          uint32_t block_num = base + offset;
+          if( block_num >= start && block_num < end )
+            result.push_back(block_num);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,46 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <appbase/application.hpp>
+#include <stdexcept>
+
+class receiver_plugin;
+
+namespace chronicle {
+
+  // The receiver, decoder and exporter of one blockchain find each other
+  // and their channels through a chain instance. appbase has a single
+  // instance of every plugin and of every channel type, so for now a
+  // process serves only the default chain, and its channels are the
+  // appbase channels.
+
+  class chain_instance {
+  public:
+    receiver_plugin* receiver() const {
+      return _receiver;
+    }
+
+    void set_receiver(receiver_plugin* plug) {
+      if( _receiver != nullptr )
+        throw std::runtime_error("The chain has a receiver already");
+      _receiver = plug;
+    }
+
+    void add_exporter() {
+      if( _have_exporter )
+        throw std::runtime_error("Only one exporter plugin is allowed");
+      _have_exporter = true;
+    }
+
+    template <typename ChannelDecl>
+    typename ChannelDecl::channel_type& channel() {
+      return appbase::app().get_channel<ChannelDecl>();
+    }
+
+  private:
+    receiver_plugin*   _receiver = nullptr;
+    bool               _have_exporter = false;
+  };
+
+  chain_instance& default_chain();
+}
@@ -0,0 +1,384 @@
+// copyright defined in LICENSE.txt
+
+#include "checkpoint_writer.hpp"
+
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <set>
+#include <stdexcept>
+#include <fc/log/logger.hpp>
+
+namespace bfs = boost::filesystem;
+
+namespace chronicle {
+
+  // the first candidate that can be parsed, or the ABI that was not changed later
+  static const std::string& resolve_current_abi(const receiver_state::account_abis& acc,
+                                                const abi_validator& validate) {
+    for( auto& candidate : acc.candidates ) {
+      if( validate(acc.account, candidate) )
+        return candidate;
+    }
+    return acc.current;
+  }
+
+
+  static uint64_t elapsed_ms(std::chrono::steady_clock::time_point started) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+  }
+
+
+  static void write_abi_history(state_file_writer& writer, uint64_t account, uint32_t block_num, const std::string& abi) {
+    writer.write_u8(state_rec_abi_history);
+    writer.write_u64(account);
+    writer.write_u32(block_num);
+    writer.write_bytes(abi.data(), abi.size());
+  }
+
+
+  static void write_contract_abi(state_file_writer& writer, uint64_t account, const std::string& abi) {
+    writer.write_u8(state_rec_contract_abi);
+    writer.write_u64(account);
+    writer.write_bytes(abi.data(), abi.size());
+  }
+
+
+  static void write_activity(state_file_writer& writer, uint64_t account, uint32_t chunk, const std::string& blocks) {
+    writer.write_u8(state_rec_account_activity);
+    writer.write_u64(account);
+    writer.write_u32(chunk);
+    writer.write_bytes(blocks.data(), blocks.size());
+  }
+
+
+  void write_receiver_state(state_file_writer& writer, const receiver_state& state, const abi_validator& validate) {
+    writer.write_u32(state.block_num);
+    writer.write_raw((const char*)state.block_id.data(), state.block_id.size());
+
+    for( auto& acc : state.abis ) {
+      for( auto& rev : acc.revisions )
+        write_abi_history(writer, acc.account, rev.first, rev.second);
+      auto& current = resolve_current_abi(acc, validate);
+      if( !current.empty() )
+        write_contract_abi(writer, acc.account, current);
+    }
+
+    for( auto& chunk : state.activity )
+      write_activity(writer, chunk.account, chunk.chunk, chunk.blocks);
+    writer.write_u8(state_rec_end);
+  }
+
+
+  bool read_checkpoint_delta(const std::string& path, uint32_t base_block, checkpoint_delta& delta) {
+    if( !state_file_exists(path) )
+      return false;
+    state_file_reader reader(path);
+    delta.base_block = reader.read_u32();
+    if( delta.base_block != base_block )
+      return false;
+    delta.block_num = reader.read_u32();
+    reader.read_raw((char*)delta.block_id.data(), delta.block_id.size());
+
+    std::string data;
+    while( true ) {
+      uint8_t type = reader.read_u8();
+      if( type == state_rec_end )
+        break;
+      uint64_t account = reader.read_u64();
+      switch( type ) {
+      case state_rec_abi_history:
+        {
+          uint32_t block_num = reader.read_u32();
+          reader.read_bytes(delta.abi_history[std::make_pair(account, block_num)]);
+        }
+        break;
+      case state_rec_contract_abi:
+        reader.read_bytes(delta.contract_abi[account]);
+        break;
+      case state_rec_account_activity:
+        {
+          uint32_t chunk = reader.read_u32();
+          reader.read_bytes(delta.activity[std::make_pair(account, chunk)]);
+        }
+        break;
+      default:
+        throw std::runtime_error("Unknown record type " + std::to_string(type) + " in " + path);
+      }
+    }
+    reader.finish();
+    return true;
+  }
+
+
+  checkpoint_writer::checkpoint_writer(worker_pool& workers, const std::string& base_path,
+                                       const std::string& delta_path, abi_validator validate) :
+    _base_path(base_path),
+    _delta_path(delta_path),
+    _validate(validate),
+    _tasks(workers, true)
+  {
+    if( state_file_exists(_base_path) ) {
+      try {
+        // the base is verified completely only when the state is recovered from it
+        state_file_reader reader(_base_path);
+        _base_block = reader.read_u32();
+        _need_full = false;
+      }
+      catch( const std::exception& e ) {
+        wlog("Cannot read ${f}, the next checkpoint will be full: ${e}", ("f",_base_path)("e",e.what()));
+        _base_block = 0;
+      }
+    }
+
+    _delta.base_block = _base_block;
+    if( _base_block > 0 ) {
+      try {
+        if( !read_checkpoint_delta(_delta_path, _base_block, _delta) )
+          _delta = checkpoint_delta();
+      }
+      catch( const std::exception& e ) {
+        wlog("Ignoring ${f}: ${e}", ("f",_delta_path)("e",e.what()));
+        _delta = checkpoint_delta();
+      }
+      _delta.base_block = _base_block;
+    }
+
+  }
+
+
+  checkpoint_writer::~checkpoint_writer() {
+    stop();
+  }
+
+
+  bool checkpoint_writer::needs_full() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _need_full;
+  }
+
+
+  void checkpoint_writer::save(std::unique_ptr<receiver_state> state) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if( !state->incremental )
+        _need_full = false;
+    }
+    std::shared_ptr<receiver_state> queued(std::move(state));
+    _tasks.post([this, queued]() { write(*queued); });
+  }
+
+
+  void checkpoint_writer::stop() {
+    _tasks.wait();
+  }
+
+
+  void checkpoint_writer::write(const receiver_state& state) {
+    try {
+      if( state.incremental )
+        write_incremental(state);
+      else
+        write_full(state);
+    }
+    catch( const std::exception& e ) {
+      elog("Cannot save checkpoint at block ${b}: ${e}", ("b",state.block_num)("e",e.what()));
+      if( !state.incremental ) {
+        // the changes that follow cannot be added to the old base
+        _base_block = 0;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _need_full = true;
+      }
+    }
+  }
+
+
+  void checkpoint_writer::write_full(const receiver_state& state) {
+    auto started = std::chrono::steady_clock::now();
+    state_file_writer writer(_base_path, false);
+    write_receiver_state(writer, state, _validate);
+    writer.commit();
+    _base_block = state.block_num;
+    _delta = checkpoint_delta();
+    _delta.base_block = _base_block;
+    boost::system::error_code ec;
+    bfs::remove(_delta_path, ec);
+    ilog("Saved full checkpoint at block ${b}: ${s} bytes in ${t} ms",
+         ("b",state.block_num)("s",writer.bytes_written())("t",elapsed_ms(started)));
+  }
+
+
+  void checkpoint_writer::write_incremental(const receiver_state& state) {
+    if( _base_block == 0 ) {
+      wlog("Skipping checkpoint at block ${b}, there is no full checkpoint to add it to", ("b",state.block_num));
+      std::lock_guard<std::mutex> lock(_mutex);
+      _need_full = true;
+      return;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    for( auto& acc : state.abis ) {
+      for( auto& rev : acc.revisions )
+        _delta.abi_history[std::make_pair(acc.account, rev.first)] = rev.second;
+      _delta.contract_abi[acc.account] = resolve_current_abi(acc, _validate);
+    }
+    for( auto& chunk : state.activity )
+      _delta.activity[std::make_pair(chunk.account, chunk.chunk)] = chunk.blocks;
+    _delta.block_num = state.block_num;
+    _delta.block_id = state.block_id;
+
+    state_file_writer writer(_delta_path, false);
+    writer.write_u32(_delta.base_block);
+    writer.write_u32(_delta.block_num);
+    writer.write_raw((const char*)_delta.block_id.data(), _delta.block_id.size());
+    for( auto& e : _delta.abi_history )
+      write_abi_history(writer, e.first.first, e.first.second, e.second);
+    for( auto& e : _delta.contract_abi )
+      write_contract_abi(writer, e.first, e.second);
+    for( auto& e : _delta.activity )
+      write_activity(writer, e.first.first, e.first.second, e.second);
+    writer.write_u8(state_rec_end);
+    writer.commit();
+    ilog("Saved checkpoint at block ${b}: ${s} bytes of changes since block ${f} in ${t} ms",
+         ("b",state.block_num)("s",writer.bytes_written())("f",_base_block)("t",elapsed_ms(started)));
+
+    if( writer.bytes_written() * 4 > bfs::file_size(_base_path) )
+      merge_into_base();
+  }
+
+
+  // The base is written in the order of the state database indexes: ABI
+  // history of each account followed by its current ABI, and then the
+  // activity chunks. The changes are merged into that order, so only one
+  // account's revisions are held in memory.
+  void checkpoint_writer::merge_into_base() {
+    auto started = std::chrono::steady_clock::now();
+    state_file_reader reader(_base_path);
+    state_file_writer writer(_base_path, false);
+
+    reader.read_u32();
+    std::array<uint8_t, 32> old_id;
+    reader.read_raw((char*)old_id.data(), old_id.size());
+    writer.write_u32(_delta.block_num);
+    writer.write_raw((const char*)_delta.block_id.data(), _delta.block_id.size());
+
+    std::set<uint64_t> accounts;
+    for( auto& e : _delta.abi_history )
+      accounts.insert(e.first.first);
+    for( auto& e : _delta.contract_abi )
+      accounts.insert(e.first);
+    auto next_account = accounts.begin();
+    auto next_chunk = _delta.activity.begin();
+
+    auto write_account = [&](uint64_t account, const std::vector<std::pair<uint32_t, std::string>>& base_revisions,
+                             const std::string& base_current) {
+      auto hist = _delta.abi_history.lower_bound(std::make_pair(account, uint32_t(0)));
+      size_t pos = 0;
+      while( pos < base_revisions.size() || (hist != _delta.abi_history.end() && hist->first.first == account) ) {
+        bool changed = hist != _delta.abi_history.end() && hist->first.first == account &&
+          (pos == base_revisions.size() || hist->first.second <= base_revisions[pos].first);
+        if( changed ) {
+          if( pos < base_revisions.size() && base_revisions[pos].first == hist->first.second )
+            pos++;
+          write_abi_history(writer, account, hist->first.second, hist->second);
+          ++hist;
+        }
+        else {
+          write_abi_history(writer, account, base_revisions[pos].first, base_revisions[pos].second);
+          pos++;
+        }
+      }
+      auto cur = _delta.contract_abi.find(account);
+      const std::string& current = (cur != _delta.contract_abi.end()) ? cur->second : base_current;
+      if( !current.empty() )
+        write_contract_abi(writer, account, current);
+    };
+
+    const std::vector<std::pair<uint32_t, std::string>> no_revisions;
+    const std::string no_abi;
+    auto write_new_accounts_before = [&](uint64_t account) {
+      for( ; next_account != accounts.end() && *next_account < account; ++next_account )
+        write_account(*next_account, no_revisions, no_abi);
+    };
+
+    // the account being read from the base
+    bool have_account = false;
+    uint64_t account = 0;
+    std::vector<std::pair<uint32_t, std::string>> revisions;
+    std::string current;
+    auto finish_account = [&]() {
+      if( !have_account )
+        return;
+      write_new_accounts_before(account);
+      write_account(account, revisions, current);
+      if( next_account != accounts.end() && *next_account == account )
+        ++next_account;
+      have_account = false;
+      revisions.clear();
+      current.clear();
+    };
+
+    bool abis_done = false;
+    std::string data;
+    while( true ) {
+      uint8_t type = reader.read_u8();
+      if( type == state_rec_abi_history || type == state_rec_contract_abi ) {
+        if( abis_done )
+          throw std::runtime_error("Unexpected record order in " + _base_path);
+        uint64_t acc = reader.read_u64();
+        if( have_account && acc != account )
+          finish_account();
+        have_account = true;
+        account = acc;
+        if( type == state_rec_abi_history ) {
+          uint32_t block_num = reader.read_u32();
+          reader.read_bytes(data);
+          revisions.emplace_back(block_num, data);
+        }
+        else {
+          reader.read_bytes(current);
+        }
+      }
+      else if( type == state_rec_account_activity || type == state_rec_end ) {
+        if( !abis_done ) {
+          finish_account();
+          for( ; next_account != accounts.end(); ++next_account )
+            write_account(*next_account, no_revisions, no_abi);
+          abis_done = true;
+        }
+        if( type == state_rec_end )
+          break;
+        uint64_t acc = reader.read_u64();
+        uint32_t chunk = reader.read_u32();
+        reader.read_bytes(data);
+        auto key = std::make_pair(acc, chunk);
+        for( ; next_chunk != _delta.activity.end() && next_chunk->first < key; ++next_chunk )
+          write_activity(writer, next_chunk->first.first, next_chunk->first.second, next_chunk->second);
+        if( next_chunk != _delta.activity.end() && next_chunk->first == key ) {
+          write_activity(writer, acc, chunk, next_chunk->second);
+          ++next_chunk;
+        }
+        else {
+          write_activity(writer, acc, chunk, data);
+        }
+      }
+      else {
+        throw std::runtime_error("Unknown record type " + std::to_string(type) + " in " + _base_path);
+      }
+    }
+    for( ; next_chunk != _delta.activity.end(); ++next_chunk )
+      write_activity(writer, next_chunk->first.first, next_chunk->first.second, next_chunk->second);
+    writer.write_u8(state_rec_end);
+
+    // the old base must be intact before it's replaced
+    reader.finish();
+    writer.commit();
+
+    _base_block = _delta.block_num;
+    _delta = checkpoint_delta();
+    _delta.base_block = _base_block;
+    boost::system::error_code ec;
+    bfs::remove(_delta_path, ec);
+    ilog("Merged checkpoint changes into a full checkpoint at block ${b}: ${s} bytes in ${t} ms",
+         ("b",_base_block)("s",writer.bytes_written())("t",elapsed_ms(started)));
+  }
+}
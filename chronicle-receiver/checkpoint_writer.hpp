@@ -0,0 +1,108 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include "state_file.hpp"
+#include "worker_pool.hpp"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace chronicle {
+
+  // The state as of a committed block, copied from the state database, so
+  // that it can be written to a file without holding the lock: contract ABI
+  // history up to the block, candidates for the ABI that was current at the
+  // block, and account activity. An incremental state has only the ABI
+  // revisions added after the previous checkpoint, and the activity chunks
+  // that were modified since then.
+  struct receiver_state {
+    struct account_abis {
+      uint64_t                                  account;
+      std::vector<std::pair<uint32_t, std::string>> revisions;
+      std::string                               current;
+      std::vector<std::string>                  candidates; // newest first, if the ABI was changed later
+    };
+
+    struct activity_chunk {
+      uint64_t                                  account;
+      uint32_t                                  chunk;
+      std::string                               blocks;
+    };
+
+    bool                                        incremental = false;
+    uint32_t                                    block_num = 0;
+    std::array<uint8_t, 32>                     block_id;
+    std::vector<account_abis>                   abis;
+    std::vector<activity_chunk>                 activity;
+  };
+
+  // tells if the binary ABI can be parsed. It's called from the writer thread.
+  using abi_validator = std::function<bool(uint64_t account, const std::string& abi)>;
+
+  // writes a full state. ABI candidates are parsed here, outside of the state database lock.
+  void write_receiver_state(state_file_writer& writer, const receiver_state& state, const abi_validator& validate);
+
+
+  // Changes since the base checkpoint, keyed the same way as in the state
+  // database. An empty contract ABI means that the contract has no valid ABI.
+  struct checkpoint_delta {
+    uint32_t                                              base_block = 0;
+    uint32_t                                              block_num = 0;
+    std::array<uint8_t, 32>                               block_id;
+    std::map<std::pair<uint64_t, uint32_t>, std::string>  abi_history;   // (account, block)
+    std::map<uint64_t, std::string>                       contract_abi;
+    std::map<std::pair<uint64_t, uint32_t>, std::string>  activity;      // (account, chunk)
+  };
+
+  // reads the delta file, returns false if it's missing or belongs to a different base
+  bool read_checkpoint_delta(const std::string& path, uint32_t base_block, checkpoint_delta& delta);
+
+
+  // Checkpoints in two files: a full state of a block, and the changes
+  // accumulated since then. Every incremental checkpoint rewrites only the
+  // delta file, and when the delta grows to a quarter of the base, both are
+  // merged into a new base by streaming through the old one. The files are
+  // written and synced by worker threads, in the order the states are
+  // queued.
+
+  class checkpoint_writer {
+  public:
+    checkpoint_writer(worker_pool& workers, const std::string& base_path, const std::string& delta_path,
+                      abi_validator validate);
+    ~checkpoint_writer();
+
+    // the block of the newest checkpoint found at startup, 0 if there is none.
+    // It must not be called after states are queued.
+    uint32_t last_block() const { return _delta.block_num > 0 ? _delta.block_num : _base_block; }
+
+    // the next state needs to be full, because there is no usable base
+    bool needs_full() const;
+
+    void save(std::unique_ptr<receiver_state> state);
+
+    // waits until the queued states are written
+    void stop();
+
+  private:
+    std::string                                  _base_path;
+    std::string                                  _delta_path;
+    abi_validator                                _validate;
+    uint32_t                                     _base_block = 0;
+    checkpoint_delta                             _delta;
+
+    mutable std::mutex                           _mutex;
+    bool                                         _need_full = true;
+    worker_group                                 _tasks;
+
+    void write(const receiver_state& state);
+    void write_full(const receiver_state& state);
+    void write_incremental(const receiver_state& state);
+    void merge_into_base();
+  };
+}
@@ -11,3 +11,4 @@
 #define CHRONICLE_MSGTYPE_PERMISSION      1011
 #define CHRONICLE_MSGTYPE_PERMISSION_LINK 1012
 #define CHRONICLE_MSGTYPE_ACC_METADATA  1013
+#define CHRONICLE_MSGTYPE_REQ_STATUS    1014
@@ -0,0 +1,84 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include "process_stats.hpp"
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+#include <type_traits>
+#include <utility>
+
+namespace chronicle {
+
+  // calls the handler of a socket operation after counting its completion
+  template <typename Handler>
+  struct counting_handler {
+    Handler    handler;
+    uint64_t*  counter;
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+      ++*counter;
+      handler(std::forward<Args>(args)...);
+    }
+  };
+
+  // TCP socket that counts its completed asynchronous reads and writes in
+  // socket_counters(). Each of them is one receive or send, whether it is
+  // done with a system call after an epoll event or with an io_uring
+  // operation, so the counts are comparable between the backends.
+  // Websocket streams use it as the next layer.
+  class counted_socket : public boost::asio::ip::tcp::socket {
+  public:
+    explicit counted_socket(boost::asio::io_context& ios) : boost::asio::ip::tcp::socket(ios) {}
+
+    template <typename MutableBuffers, typename Handler>
+    auto async_read_some(const MutableBuffers& buffers, Handler&& handler) {
+      return boost::asio::ip::tcp::socket::async_read_some
+        (buffers, counting_handler<std::decay_t<Handler>>{std::forward<Handler>(handler),
+                                                          &socket_counters().socket_reads});
+    }
+
+    template <typename ConstBuffers, typename Handler>
+    auto async_write_some(const ConstBuffers& buffers, Handler&& handler) {
+      return boost::asio::ip::tcp::socket::async_write_some
+        (buffers, counting_handler<std::decay_t<Handler>>{std::forward<Handler>(handler),
+                                                          &socket_counters().socket_writes});
+    }
+  };
+
+  // websocket closing is done on the plain socket
+  inline void teardown(boost::beast::role_type role, counted_socket& socket, boost::beast::error_code& ec) {
+    boost::beast::websocket::teardown(role, static_cast<boost::asio::ip::tcp::socket&>(socket), ec);
+  }
+
+  template <typename TeardownHandler>
+  void async_teardown(boost::beast::role_type role, counted_socket& socket, TeardownHandler&& handler) {
+    boost::beast::websocket::async_teardown(role, static_cast<boost::asio::ip::tcp::socket&>(socket),
+                                            std::forward<TeardownHandler>(handler));
+  }
+}
+
+namespace boost {
+  namespace asio {
+
+    // intermediate handlers of Beast operations keep their executor and allocator
+
+    template <typename Handler, typename Executor>
+    struct associated_executor<chronicle::counting_handler<Handler>, Executor> {
+      using type = associated_executor_t<Handler, Executor>;
+      static type get(const chronicle::counting_handler<Handler>& h, const Executor& ex = Executor()) noexcept {
+        return associated_executor<Handler, Executor>::get(h.handler, ex);
+      }
+    };
+
+    template <typename Handler, typename Allocator>
+    struct associated_allocator<chronicle::counting_handler<Handler>, Allocator> {
+      using type = associated_allocator_t<Handler, Allocator>;
+      static type get(const chronicle::counting_handler<Handler>& h, const Allocator& a = Allocator()) noexcept {
+        return associated_allocator<Handler, Allocator>::get(h.handler, a);
+      }
+    };
+  }
+}
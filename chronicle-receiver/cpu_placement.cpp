@@ -0,0 +1,141 @@
+// copyright defined in LICENSE.txt
+
+#include "cpu_placement.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace chronicle {
+  namespace cpu_placement {
+
+    static const unsigned long max_nodes = 1024;
+    static const char* node_dir = "/sys/devices/system/node/";
+
+
+    std::vector<int> parse_cpu_list(const std::string& list) {
+      std::vector<int> result;
+      std::istringstream in(list);
+      std::string item;
+      while( std::getline(in, item, ',') ) {
+        if( item.empty() || item == "\n" )
+          continue;
+        int from, to;
+        char dash = 0;
+        std::istringstream range(item);
+        if( !(range >> from) || from < 0 )
+          throw std::runtime_error("Invalid CPU list: " + list);
+        to = from;
+        if( range >> dash ) {
+          if( dash != '-' || !(range >> to) || to < from )
+            throw std::runtime_error("Invalid CPU list: " + list);
+        }
+        for( int cpu = from; cpu <= to; ++cpu )
+          result.push_back(cpu);
+      }
+      return result;
+    }
+
+
+    std::string format_cpu_list(const std::vector<int>& cpus) {
+      std::ostringstream out;
+      size_t i = 0;
+      while( i < cpus.size() ) {
+        size_t j = i;
+        while( j+1 < cpus.size() && cpus[j+1] == cpus[j] + 1 )
+          ++j;
+        if( i > 0 )
+          out << ',';
+        out << cpus[i];
+        if( j > i )
+          out << '-' << cpus[j];
+        i = j + 1;
+      }
+      return out.str();
+    }
+
+
+    int numa_nodes() {
+      std::ifstream online(std::string(node_dir) + "online");
+      std::string list;
+      if( !std::getline(online, list) )
+        return 0;
+      auto nodes = parse_cpu_list(list);
+      return nodes.empty() ? 0 : nodes.back() + 1;
+    }
+
+
+    std::vector<int> node_cpus(int node) {
+      std::ifstream cpulist(std::string(node_dir) + "node" + std::to_string(node) + "/cpulist");
+      std::string list;
+      if( !std::getline(cpulist, list) )
+        throw std::runtime_error("NUMA node " + std::to_string(node) + " does not exist");
+      return parse_cpu_list(list);
+    }
+
+
+    void pin_thread(const std::vector<int>& cpus) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for( int cpu : cpus ) {
+        if( cpu >= CPU_SETSIZE )
+          throw std::runtime_error("CPU number is too high: " + std::to_string(cpu));
+        CPU_SET(cpu, &set);
+      }
+      if( sched_setaffinity(0, sizeof(set), &set) != 0 )
+        throw std::runtime_error("Cannot set CPU affinity to " + format_cpu_list(cpus) + ": " + strerror(errno));
+    }
+
+
+    std::string prefer_node(int node) {
+      if( node < 0 || (unsigned long)node >= max_nodes )
+        return "invalid node " + std::to_string(node);
+      unsigned long mask[max_nodes / (8 * sizeof(unsigned long))] = {};
+      mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+      if( syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, max_nodes) != 0 )
+        return std::string("set_mempolicy failed: ") + strerror(errno);
+      return "applied";
+    }
+
+
+    std::string describe() {
+      std::ostringstream out;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if( sched_getaffinity(0, sizeof(set), &set) == 0 ) {
+        std::vector<int> cpus;
+        for( int cpu = 0; cpu < CPU_SETSIZE; ++cpu )
+          if( CPU_ISSET(cpu, &set) )
+            cpus.push_back(cpu);
+        out << "cpus=" << format_cpu_list(cpus);
+      }
+
+      unsigned cpu = 0, node = 0;
+      if( syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 )
+        out << ", running on cpu " << cpu << " node " << node;
+
+      int mode = 0;
+      unsigned long mask[max_nodes / (8 * sizeof(unsigned long))] = {};
+      if( syscall(SYS_get_mempolicy, &mode, mask, max_nodes, nullptr, 0) == 0 ) {
+        std::vector<int> nodes;
+        for( unsigned long n = 0; n < max_nodes; ++n )
+          if( mask[n / (8 * sizeof(unsigned long))] & (1ul << (n % (8 * sizeof(unsigned long)))) )
+            nodes.push_back(n);
+        switch( mode ) {
+        case MPOL_DEFAULT:   out << ", memory policy: default"; break;
+        case MPOL_PREFERRED: out << ", memory policy: preferred node " << format_cpu_list(nodes); break;
+        case MPOL_BIND:      out << ", memory policy: bind to nodes " << format_cpu_list(nodes); break;
+        case MPOL_INTERLEAVE: out << ", memory policy: interleave nodes " << format_cpu_list(nodes); break;
+        default:             out << ", memory policy: " << mode;
+        }
+      }
+      return out.str();
+    }
+  }
+}
@@ -0,0 +1,36 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <string>
+#include <vector>
+
+namespace chronicle {
+
+  // CPU and NUMA placement of the pipeline. The receiver, decoder and
+  // exporter all run on the appbase thread, so placing that thread at
+  // startup places the whole pipeline. Threads started later, such as
+  // the ABI warmup, inherit both the CPU set and the memory policy.
+
+  namespace cpu_placement {
+
+    // parses a list like "0-3,8,10-11", as used in /sys and by taskset
+    std::vector<int> parse_cpu_list(const std::string& list);
+    std::string format_cpu_list(const std::vector<int>& cpus);
+
+    // number of NUMA nodes, or zero if the kernel does not expose them
+    int numa_nodes();
+
+    // CPUs of a NUMA node
+    std::vector<int> node_cpus(int node);
+
+    // restricts the calling thread to the CPUs; throws on failure
+    void pin_thread(const std::vector<int>& cpus);
+
+    // new memory of the calling thread is preferably allocated on the node.
+    // Returns "applied" or the error.
+    std::string prefer_node(int node);
+
+    // allowed CPUs, current CPU and node, and the memory policy of the calling thread
+    std::string describe();
+  }
+}
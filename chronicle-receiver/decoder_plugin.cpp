@@ -2,6 +2,7 @@
 
 #include "decoder_plugin.hpp"
 #include "receiver_plugin.hpp"
+#include "specialized_decoders.hpp"
 
 #include <iostream>
 #include <string>
@@ -31,8 +32,25 @@ namespace json_encoder {
   struct native_to_json_state {
     rapidjson::Writer<rapidjson::StringBuffer>& writer;
     vector<string>* encoder_errors;
+    const chronicle::channels::block_abis* abis = nullptr;
   };
 
+  // event ABI are used if the receiver has attached them
+  inline abieos_context* get_abi_ctxt(abieos::name account, native_to_json_state& state) {
+    if( !state.abis )
+      return get_contract_abi_ctxt(account);
+    auto abi = state.abis->get(account);
+    return abi ? abi->ctxt.get() : nullptr;
+  }
+
+  inline const chronicle::specialized_decoders::decoder_set* get_specialized(abieos::name account,
+                                                                           native_to_json_state& state) {
+    if( !state.abis )
+      return nullptr;
+    auto abi = state.abis->get(account);
+    return abi ? abi->specialized.get() : nullptr;
+  }
+
   inline void native_to_json(const std::string& str, native_to_json_state& state) {
     state.writer.String(str.data(), str.size());
   }
@@ -84,6 +102,11 @@ namespace json_encoder {
     state.writer.String(result.data(), result.size());
   }
 
+  inline void native_to_json(const chronicle::channels::interactive_status_val& obj, native_to_json_state& state) {
+    std::string result = to_string(obj);
+    state.writer.String(result.data(), result.size());
+  }
+
   inline void native_to_json(const abieos::name& obj, native_to_json_state& state) {
     std::string result = name_to_string(obj.value);
     state.writer.String(result.data(), result.size());
@@ -125,28 +148,30 @@ namespace json_encoder {
         state.writer.Key(name);
         if( string("data") == name ) {
           // encode action data according to ABI
-          auto ctxt = get_contract_abi_ctxt(obj.account);
-          try {
+          auto specialized = get_specialized(obj.account, state);
+          if( specialized ) {
+            auto decode = specialized->action(obj.name.value);
+            if( decode && decode(obj.data.pos, obj.data.end, state.writer) )
+              return;
+          }
+          auto ctxt = get_abi_ctxt(obj.account, state);
+          const char* datajs = nullptr;
+          if( ctxt ) {
             const char* action_type = abieos_get_type_for_action(ctxt, obj.account.value, obj.name.value);
             if( action_type == nullptr )
               action_type = abieos_name_to_string(ctxt, obj.name.value);
-            try {
-              const char* datajs = abieos_bin_to_json(ctxt, obj.account.value, action_type,
-                                                      obj.data.pos, obj.data.end-obj.data.pos);
-              if( datajs == nullptr )
-                throw runtime_error("abieos_bin_to_json returned null");
-              state.writer.RawValue(datajs, strlen(datajs), rapidjson::kObjectType);
-            }
-            catch (...) {
-              throw runtime_error(abieos_get_error(ctxt));
-            }
+            datajs = abieos_bin_to_json(ctxt, obj.account.value, action_type,
+                                        obj.data.pos, obj.data.end-obj.data.pos);
           }
-          catch ( const std::exception& e  ) {
+          if( datajs != nullptr ) {
+            state.writer.RawValue(datajs, strlen(datajs), rapidjson::kObjectType);
+          }
+          else {
+            // no exceptions here: contracts without ABI may produce thousands of actions per block
             if( state.encoder_errors ) {
               std::ostringstream os;
-              os << "Cannot decode action data for " << abieos_name_to_string(ctxt, obj.account.value) <<": "
-                 << abieos_name_to_string(ctxt, obj.name.value)
-                 << " - " << e.what();
+              os << "Cannot decode action data for " << (std::string)obj.account << ": "
+                 << (std::string)obj.name << " - " << (ctxt ? abieos_get_error(ctxt) : "no ABI");
               state.encoder_errors->emplace_back(os.str());
             }
             native_to_json(obj.data, state);
@@ -168,28 +193,29 @@ namespace json_encoder {
         state.writer.Key(name);
         if( string("value") == name ) {
           // encode table row according to ABI
-          auto ctxt = get_contract_abi_ctxt(obj.code);
-          try {
+          auto specialized = get_specialized(obj.code, state);
+          if( specialized ) {
+            auto decode = specialized->table(obj.table.value);
+            if( decode && decode(obj.value.pos, obj.value.end, state.writer) )
+              return;
+          }
+          auto ctxt = get_abi_ctxt(obj.code, state);
+          const char* valjs = nullptr;
+          if( ctxt ) {
             const char* table_type = abieos_get_type_for_table(ctxt, obj.code.value, obj.table.value);
             if( table_type == nullptr )
               table_type = abieos_name_to_string(ctxt, obj.table.value);
-            try {
-              const char* valjs = abieos_bin_to_json(ctxt, obj.code.value, table_type,
-                                                     obj.value.pos, obj.value.end-obj.value.pos);
-              if( valjs == nullptr )
-                throw runtime_error("abieos_bin_to_json returned null");
-              state.writer.RawValue(valjs, strlen(valjs), rapidjson::kObjectType);
-            }
-            catch (...) {
-              throw runtime_error(abieos_get_error(ctxt));
-            }
+            valjs = abieos_bin_to_json(ctxt, obj.code.value, table_type,
+                                       obj.value.pos, obj.value.end-obj.value.pos);
+          }
+          if( valjs != nullptr ) {
+            state.writer.RawValue(valjs, strlen(valjs), rapidjson::kObjectType);
           }
-          catch ( const std::exception& e ) {
+          else {
             if( state.encoder_errors ) {
               std::ostringstream os;
-              os << "Cannot decode table row for " << abieos_name_to_string(ctxt, obj.code.value)
-                 <<": " << abieos_name_to_string(ctxt, obj.table.value)
-                 << " - " << e.what();
+              os << "Cannot decode table row for " << (std::string)obj.code
+                 << ": " << (std::string)obj.table << " - " << (ctxt ? abieos_get_error(ctxt) : "no ABI");
               state.encoder_errors->emplace_back(os.str());
             }
             native_to_json(obj.value, state);
@@ -336,22 +362,25 @@ namespace json_encoder {
 class decoder_plugin_impl : std::enable_shared_from_this<decoder_plugin_impl> {
 public:
   decoder_plugin_impl():
-    _js_forks_chan(app().get_channel<chronicle::channels::js_forks>()),
-    _js_blocks_chan(app().get_channel<chronicle::channels::js_blocks>()),
-    _js_transaction_traces_chan(app().get_channel<chronicle::channels::js_transaction_traces>()),
-    _js_abi_updates_chan(app().get_channel<chronicle::channels::js_abi_updates>()),
-    _js_abi_removals_chan(app().get_channel<chronicle::channels::js_abi_removals>()),
-    _js_abi_errors_chan(app().get_channel<chronicle::channels::js_abi_errors>()),
-    _js_table_row_updates_chan(app().get_channel<chronicle::channels::js_table_row_updates>()),
-    _js_permission_updates_chan(app().get_channel<chronicle::channels::js_permission_updates>()),
-    _js_permission_link_updates_chan(app().get_channel<chronicle::channels::js_permission_link_updates>()),
-    _js_account_metadata_updates_chan(app().get_channel<chronicle::channels::js_account_metadata_updates>()),
-    _js_receiver_pauses_chan(app().get_channel<chronicle::channels::js_receiver_pauses>()),
-    _js_block_completed_chan(app().get_channel<chronicle::channels::js_block_completed>()),
-    _js_abi_decoder_errors_chan(app().get_channel<chronicle::channels::js_abi_decoder_errors>()),
+    chain(chronicle::default_chain()),
+    _js_forks_chan(chain.channel<chronicle::channels::js_forks>()),
+    _js_blocks_chan(chain.channel<chronicle::channels::js_blocks>()),
+    _js_transaction_traces_chan(chain.channel<chronicle::channels::js_transaction_traces>()),
+    _js_abi_updates_chan(chain.channel<chronicle::channels::js_abi_updates>()),
+    _js_abi_removals_chan(chain.channel<chronicle::channels::js_abi_removals>()),
+    _js_abi_errors_chan(chain.channel<chronicle::channels::js_abi_errors>()),
+    _js_table_row_updates_chan(chain.channel<chronicle::channels::js_table_row_updates>()),
+    _js_permission_updates_chan(chain.channel<chronicle::channels::js_permission_updates>()),
+    _js_permission_link_updates_chan(chain.channel<chronicle::channels::js_permission_link_updates>()),
+    _js_account_metadata_updates_chan(chain.channel<chronicle::channels::js_account_metadata_updates>()),
+    _js_receiver_pauses_chan(chain.channel<chronicle::channels::js_receiver_pauses>()),
+    _js_block_completed_chan(chain.channel<chronicle::channels::js_block_completed>()),
+    _js_abi_decoder_errors_chan(chain.channel<chronicle::channels::js_abi_decoder_errors>()),
+    _js_interactive_statuses_chan(chain.channel<chronicle::channels::js_interactive_statuses>()),
     impl_buffer(0, 262144)
   {}
 
+  chronicle::chain_instance&                                 chain;
   chronicle::channels::js_forks::channel_type&               _js_forks_chan;
   chronicle::channels::js_blocks::channel_type&              _js_blocks_chan;
   chronicle::channels::js_transaction_traces::channel_type&  _js_transaction_traces_chan;
@@ -365,6 +394,7 @@ public:
   chronicle::channels::js_receiver_pauses::channel_type&     _js_receiver_pauses_chan;
   chronicle::channels::js_block_completed::channel_type&     _js_block_completed_chan;
   chronicle::channels::js_abi_decoder_errors::channel_type&  _js_abi_decoder_errors_chan;
+  chronicle::channels::js_interactive_statuses::channel_type&  _js_interactive_statuses_chan;
 
   chronicle::channels::forks::channel_type::handle               _forks_subscription;
   chronicle::channels::blocks::channel_type::handle              _blocks_subscription;
@@ -378,6 +408,7 @@ public:
   chronicle::channels::account_metadata_updates::channel_type::handle  _account_metadata_updates_subscription;
   chronicle::channels::receiver_pauses::channel_type::handle     _receiver_pauses_subscription;
   chronicle::channels::block_completed::channel_type::handle     _block_completed_subscription;
+  chronicle::channels::interactive_statuses::channel_type::handle  _interactive_statuses_subscription;
 
   const int channel_priority = 50;
 
@@ -386,10 +417,11 @@ public:
   rapidjson::Writer<rapidjson::StringBuffer> impl_writer;
 
   template <typename T>
-  void impl_native_to_json(T& v, std::string& dest, vector<string>* encoder_errors=nullptr) {
+  void impl_native_to_json(T& v, std::string& dest, vector<string>* encoder_errors=nullptr,
+                           const chronicle::channels::block_abis* abis=nullptr) {
     impl_buffer.Clear();
     impl_writer.Reset(impl_buffer);
-    json_encoder::native_to_json_state state{impl_writer, encoder_errors};
+    json_encoder::native_to_json_state state{impl_writer, encoder_errors, abis};
     json_encoder::native_to_json(v, state);
     dest = impl_buffer.GetString();
   }
@@ -399,88 +431,95 @@ public:
   void start() {
     if (_js_forks_chan.has_subscribers()) {
       _forks_subscription =
-        app().get_channel<chronicle::channels::forks>().subscribe
+        chain.channel<chronicle::channels::forks>().subscribe
         ([this](std::shared_ptr<chronicle::channels::fork_event> fe){
           on_fork(fe);
         });
     }
     if (_js_blocks_chan.has_subscribers()) {
       _blocks_subscription =
-        app().get_channel<chronicle::channels::blocks>().subscribe
+        chain.channel<chronicle::channels::blocks>().subscribe
         ([this](std::shared_ptr<chronicle::channels::block> block_ptr){
           on_block(block_ptr);
         });
     }
     if (_js_transaction_traces_chan.has_subscribers()) {
       _transaction_traces_subscription =
-        app().get_channel<chronicle::channels::transaction_traces>().subscribe
+        chain.channel<chronicle::channels::transaction_traces>().subscribe
         ([this](std::shared_ptr<chronicle::channels::transaction_trace> tr){
           on_transaction_trace(tr);
         });
     }
     if (_js_abi_updates_chan.has_subscribers()) {
       _abi_updates_subscription =
-        app().get_channel<chronicle::channels::abi_updates>().subscribe
+        chain.channel<chronicle::channels::abi_updates>().subscribe
         ([this](std::shared_ptr<chronicle::channels::abi_update> abiupd){
           on_abi_update(abiupd);
         });
     }
     if (_js_abi_removals_chan.has_subscribers()) {
       _abi_removals_subscription =
-        app().get_channel<chronicle::channels::abi_removals>().subscribe
+        chain.channel<chronicle::channels::abi_removals>().subscribe
         ([this](std::shared_ptr<chronicle::channels::abi_removal> ar){
           on_abi_removal(ar);
         });
     }
     if (_js_abi_errors_chan.has_subscribers()) {
       _abi_errors_subscription =
-        app().get_channel<chronicle::channels::abi_errors>().subscribe
+        chain.channel<chronicle::channels::abi_errors>().subscribe
         ([this](std::shared_ptr<chronicle::channels::abi_error> abierr){
           on_abi_error(abierr);
         });
     }
     if (_js_table_row_updates_chan.has_subscribers()) {
       _table_row_updates_subscription =
-        app().get_channel<chronicle::channels::table_row_updates>().subscribe
+        chain.channel<chronicle::channels::table_row_updates>().subscribe
         ([this](std::shared_ptr<chronicle::channels::table_row_update> trupd){
           on_table_row_update(trupd);
         });
     }
     if (_js_permission_updates_chan.has_subscribers()) {
       _permission_updates_subscription =
-        app().get_channel<chronicle::channels::permission_updates>().subscribe
+        chain.channel<chronicle::channels::permission_updates>().subscribe
         ([this](std::shared_ptr<chronicle::channels::permission_update> trupd){
           on_permission_update(trupd);
         });
     }
     if (_js_permission_link_updates_chan.has_subscribers()) {
       _permission_link_updates_subscription =
-        app().get_channel<chronicle::channels::permission_link_updates>().subscribe
+        chain.channel<chronicle::channels::permission_link_updates>().subscribe
         ([this](std::shared_ptr<chronicle::channels::permission_link_update> trupd){
           on_permission_link_update(trupd);
         });
     }
     if (_js_account_metadata_updates_chan.has_subscribers()) {
       _account_metadata_updates_subscription =
-        app().get_channel<chronicle::channels::account_metadata_updates>().subscribe
+        chain.channel<chronicle::channels::account_metadata_updates>().subscribe
         ([this](std::shared_ptr<chronicle::channels::account_metadata_update> trupd){
           on_account_metadata_update(trupd);
         });
     }
     if (_js_receiver_pauses_chan.has_subscribers()) {
       _receiver_pauses_subscription =
-        app().get_channel<chronicle::channels::receiver_pauses>().subscribe
+        chain.channel<chronicle::channels::receiver_pauses>().subscribe
         ([this](std::shared_ptr<chronicle::channels::receiver_pause> rp){
           on_receiver_pause(rp);
         });
     }
     if (_js_block_completed_chan.has_subscribers()) {
       _block_completed_subscription =
-        app().get_channel<chronicle::channels::block_completed>().subscribe
+        chain.channel<chronicle::channels::block_completed>().subscribe
         ([this](std::shared_ptr<block_finished> bf){
           on_block_completed(bf);
         });
     }
+    if (_js_interactive_statuses_chan.has_subscribers()) {
+      _interactive_statuses_subscription =
+        chain.channel<chronicle::channels::interactive_statuses>().subscribe
+        ([this](std::shared_ptr<interactive_status> st){
+          on_interactive_status(st);
+        });
+    }
   }
 
   void on_fork(std::shared_ptr<chronicle::channels::fork_event> fe) {
@@ -498,7 +537,7 @@ public:
   void on_transaction_trace(std::shared_ptr<chronicle::channels::transaction_trace> ccttr) {
     vector<string> encoder_errors;
     auto output = make_shared<string>();
-    impl_native_to_json(*ccttr, *output, &encoder_errors);
+    impl_native_to_json(*ccttr, *output, &encoder_errors, ccttr->abis.get());
     _js_transaction_traces_chan.publish(channel_priority, output);
     if( encoder_errors.size() > 0 ) {
       map<string, string> attrs;
@@ -532,7 +571,7 @@ public:
   void on_table_row_update(std::shared_ptr<chronicle::channels::table_row_update> trupd) {
     vector<string> encoder_errors;
     auto output = make_shared<string>();
-    impl_native_to_json(*trupd, *output, &encoder_errors);
+    impl_native_to_json(*trupd, *output, &encoder_errors, trupd->abis.get());
     _js_table_row_updates_chan.publish(channel_priority, output);
     if( encoder_errors.size() > 0 ) {
       map<string, string> attrs;
@@ -580,6 +619,18 @@ public:
   }
 
 
+  // status events travel through the decoder, so that they stay in order with the request output
+  void on_interactive_status(std::shared_ptr<interactive_status> st) {
+    auto output = make_shared<js_interactive_status>();
+    output->client_id = st->client_id;
+    output->req_id = st->req_id;
+    output->active = (st->status == interactive_status_val::started);
+    output->json = make_shared<string>();
+    impl_native_to_json(*st, *output->json);
+    _js_interactive_statuses_chan.publish(channel_priority, output);
+  }
+
+
   inline void report_encoder_errors(vector<string>& encoder_errors, map<string, string>& attrs) {
     rapidjson::StringBuffer buffer(0, 1024);
     rapidjson::Writer<rapidjson::StringBuffer> writer{buffer};
@@ -19,6 +19,16 @@ namespace chronicle {
     using js_abi_decoder_errors  = channel_decl<struct js_abi_decoder_errors_tag, std::shared_ptr<string>>;
     using js_receiver_pauses     = channel_decl<struct js_receiver_pauses_tag, std::shared_ptr<string>>;
     using js_block_completed     = channel_decl<struct js_block_completed_tag, std::shared_ptr<string>>;
+
+    // the exporter needs the request ID in order to tag the messages that follow the status
+    struct js_interactive_status {
+      uint32_t                   client_id;
+      uint32_t                   req_id;
+      bool                       active; // true if the request output follows
+      std::shared_ptr<string>    json;
+    };
+
+    using js_interactive_statuses = channel_decl<struct js_interactive_statuses_tag, std::shared_ptr<js_interactive_status>>;
   }
 }
 
@@ -6,18 +6,25 @@
 #include "decoder_plugin.hpp"
 #include "receiver_plugin.hpp"
 #include "chronicle_msgtypes.h"
+#include "counted_socket.hpp"
 
 #include <queue>
+#include <map>
+#include <algorithm>
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/core.hpp>
+#include <boost/asio/coroutine.hpp>
 #include <stdexcept>
 #include <limits>
 
+#include "rapidjson/document.h"
 #include "rapidjson/reader.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 
 
+#include <fc/crypto/hex.hpp>
+#include <fc/time.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/exception/exception.hpp>
 
@@ -34,10 +41,14 @@ namespace {
   const char* WS_MAXUNACK_OPT = "exp-ws-max-unack";
   const char* WS_MAXQUEUE_OPT = "exp-ws-max-queue";
   const char* WS_BINHDR = "exp-ws-bin-header";
+  const char* WS_LISTEN_OPT = "exp-ws-listen";
+  const char* WS_CLIENT_TIMEOUT_OPT = "exp-ws-client-timeout";
 }
 
 class exp_ws_plugin_impl : std::enable_shared_from_this<exp_ws_plugin_impl> {
 public:
+  chronicle::chain_instance&                                        chain;
+
   chronicle::channels::js_forks::channel_type::handle               _js_forks_subscription;
   chronicle::channels::js_blocks::channel_type::handle              _js_blocks_subscription;
   chronicle::channels::js_transaction_traces::channel_type::handle  _js_transaction_traces_subscription;
@@ -51,6 +62,7 @@ public:
   chronicle::channels::js_receiver_pauses::channel_type::handle     _js_receiver_pauses_subscription;
   chronicle::channels::js_block_completed::channel_type::handle     _js_block_completed_subscription;
   chronicle::channels::js_abi_decoder_errors::channel_type::handle  _js_abi_decoder_errors_subscription;
+  chronicle::channels::js_interactive_statuses::channel_type::handle  _js_interactive_statuses_subscription;
 
   chronicle::channels::interactive_requests::channel_type&          _interactive_requests_chan;
 
@@ -59,8 +71,9 @@ public:
   string ws_path;
   bool use_bin_headers;
   uint32_t maxunack;
+  bool listen_mode;
 
-  using wstream = boost::beast::websocket::stream<boost::asio::ip::tcp::socket>;
+  using wstream = boost::beast::websocket::stream<chronicle::counted_socket>;
   std::shared_ptr<wstream> ws;
   const int ws_priority = 60;
 
@@ -73,131 +86,164 @@ public:
   uint32_t queue_hwm;
   uint32_t queue_lwm;
   boost::asio::const_buffer async_out_buffer;
-  std::shared_ptr<boost::asio::deadline_timer> mytimer;
+  bool async_writing = false;
 
-  uint32_t pause_time_msec = 0;
   uint32_t msg_report_counter = 1000;
 
+  // client and request IDs of interactive requests whose output is being exported.
+  // Each message is sent once per request.
+  std::vector<std::pair<uint32_t, uint32_t>> active_reqs;
+
+  // in listen mode, every client connection is a session
+  struct ws_session {
+    uint32_t                             client_id;
+    std::shared_ptr<wstream>             ws;
+    std::queue<std::shared_ptr<msgbuf>>  queue;
+    std::shared_ptr<msgbuf>              msg; // this to prevent deallocation during async write
+    bool                                 writing = false;
+    bool                                 closed = false;
+    bool                                 full = false; // the queue has reached the limit and pauses the receiver
+    fc::time_point                       last_write;   // completion of the last write
+  };
+
+  std::shared_ptr<boost::asio::ip::tcp::acceptor>   acceptor;
+  std::map<uint32_t, std::shared_ptr<ws_session>>   sessions;
+  uint32_t next_client_id = 1;
+  size_t sessions_queue_size = 0;
+  uint32_t client_timeout_sec;
+  std::shared_ptr<boost::asio::deadline_timer>      accept_retry_timer;
+  std::shared_ptr<boost::asio::deadline_timer>      client_timer;
+  bool client_timer_armed = false;
+
   exp_ws_plugin_impl() :
-    _interactive_requests_chan(app().get_channel<chronicle::channels::interactive_requests>())
+    chain(chronicle::default_chain()),
+    _interactive_requests_chan(chain.channel<chronicle::channels::interactive_requests>())
   {};
 
   void init() {
     ws = std::make_shared<wstream>(std::ref(app().get_io_service()));
-    mytimer = std::make_shared<boost::asio::deadline_timer>(std::ref(app().get_io_service()));
 
     if (use_bin_headers) {
       _js_forks_subscription =
-        app().get_channel<chronicle::channels::js_forks>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_FORK, 0, event); });
+        chain.channel<chronicle::channels::js_forks>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_FORK, event); });
 
       _js_blocks_subscription =
-        app().get_channel<chronicle::channels::js_blocks>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_BLOCK, 0, event); });
+        chain.channel<chronicle::channels::js_blocks>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_BLOCK, event); });
 
       _js_transaction_traces_subscription =
-        app().get_channel<chronicle::channels::js_transaction_traces>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_TX_TRACE, 0, event); });
+        chain.channel<chronicle::channels::js_transaction_traces>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_TX_TRACE, event); });
 
       _js_abi_updates_subscription =
-        app().get_channel<chronicle::channels::js_abi_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_ABI_UPD, 0, event); });
+        chain.channel<chronicle::channels::js_abi_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_ABI_UPD, event); });
 
       _js_abi_removals_subscription =
-        app().get_channel<chronicle::channels::js_abi_removals>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_ABI_REM, 0, event); });
+        chain.channel<chronicle::channels::js_abi_removals>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_ABI_REM, event); });
 
       _js_abi_errors_subscription =
-        app().get_channel<chronicle::channels::js_abi_errors>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_ABI_ERR, 0, event); });
+        chain.channel<chronicle::channels::js_abi_errors>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_ABI_ERR, event); });
 
       _js_table_row_updates_subscription =
-        app().get_channel<chronicle::channels::js_table_row_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_TBL_ROW, 0, event); });
+        chain.channel<chronicle::channels::js_table_row_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_TBL_ROW, event); });
 
       _js_permission_updates_subscription =
-        app().get_channel<chronicle::channels::js_permission_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_PERMISSION, 0, event); });
+        chain.channel<chronicle::channels::js_permission_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_PERMISSION, event); });
 
       _js_permission_link_updates_subscription =
-        app().get_channel<chronicle::channels::js_permission_link_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_PERMISSION_LINK, 0, event); });
+        chain.channel<chronicle::channels::js_permission_link_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_PERMISSION_LINK, event); });
 
       _js_account_metadata_updates_subscription =
-        app().get_channel<chronicle::channels::js_account_metadata_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_ACC_METADATA, 0, event); });
+        chain.channel<chronicle::channels::js_account_metadata_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_ACC_METADATA, event); });
 
       _js_abi_decoder_errors_subscription =
-        app().get_channel<chronicle::channels::js_abi_decoder_errors>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_ENCODER_ERR, 0, event); });
+        chain.channel<chronicle::channels::js_abi_decoder_errors>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_ENCODER_ERR, event); });
 
       _js_receiver_pauses_subscription =
-        app().get_channel<chronicle::channels::js_receiver_pauses>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_RCVR_PAUSE, 0, event); });
+        chain.channel<chronicle::channels::js_receiver_pauses>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_RCVR_PAUSE, event); });
 
       _js_block_completed_subscription =
-        app().get_channel<chronicle::channels::js_block_completed>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_bin(CHRONICLE_MSGTYPE_BLOCK_COMPLETED, 0, event); });
+        chain.channel<chronicle::channels::js_block_completed>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_bin(CHRONICLE_MSGTYPE_BLOCK_COMPLETED, event); });
     }
     else {
       json_buffer.Reserve(1024*256);
 
       _js_forks_subscription =
-        app().get_channel<chronicle::channels::js_forks>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("FORK", event); });
+        chain.channel<chronicle::channels::js_forks>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("FORK", event); });
 
       _js_blocks_subscription =
-        app().get_channel<chronicle::channels::js_blocks>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("BLOCK", event); });
+        chain.channel<chronicle::channels::js_blocks>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("BLOCK", event); });
 
       _js_transaction_traces_subscription =
-        app().get_channel<chronicle::channels::js_transaction_traces>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("TX_TRACE", event); });
+        chain.channel<chronicle::channels::js_transaction_traces>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("TX_TRACE", event); });
 
       _js_abi_updates_subscription =
-        app().get_channel<chronicle::channels::js_abi_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("ABI_UPD", event); });
+        chain.channel<chronicle::channels::js_abi_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("ABI_UPD", event); });
 
       _js_abi_removals_subscription =
-        app().get_channel<chronicle::channels::js_abi_removals>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("ABI_REM", event); });
+        chain.channel<chronicle::channels::js_abi_removals>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("ABI_REM", event); });
 
       _js_abi_errors_subscription =
-        app().get_channel<chronicle::channels::js_abi_errors>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("ABI_ERR", event); });
+        chain.channel<chronicle::channels::js_abi_errors>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("ABI_ERR", event); });
 
       _js_table_row_updates_subscription =
-        app().get_channel<chronicle::channels::js_table_row_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("TBL_ROW", event); });
+        chain.channel<chronicle::channels::js_table_row_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("TBL_ROW", event); });
 
       _js_permission_updates_subscription =
-        app().get_channel<chronicle::channels::js_permission_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("PERMISSION", event); });
+        chain.channel<chronicle::channels::js_permission_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("PERMISSION", event); });
 
       _js_permission_link_updates_subscription =
-        app().get_channel<chronicle::channels::js_permission_link_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("PERMISSION_LINK", event); });
+        chain.channel<chronicle::channels::js_permission_link_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("PERMISSION_LINK", event); });
 
       _js_account_metadata_updates_subscription =
-        app().get_channel<chronicle::channels::js_account_metadata_updates>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("ACC_METADATA", event); });
+        chain.channel<chronicle::channels::js_account_metadata_updates>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("ACC_METADATA", event); });
 
       _js_receiver_pauses_subscription =
-        app().get_channel<chronicle::channels::js_receiver_pauses>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("RCVR_PAUSE", event); });
+        chain.channel<chronicle::channels::js_receiver_pauses>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("RCVR_PAUSE", event); });
 
       _js_block_completed_subscription =
-        app().get_channel<chronicle::channels::js_block_completed>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("BLOCK_COMPLETED", event); });
+        chain.channel<chronicle::channels::js_block_completed>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("BLOCK_COMPLETED", event); });
 
       _js_abi_decoder_errors_subscription =
-        app().get_channel<chronicle::channels::js_abi_decoder_errors>().subscribe
-        ([this](std::shared_ptr<string> event){ on_event_json("ENCODER_ERR", event); });
+        chain.channel<chronicle::channels::js_abi_decoder_errors>().subscribe
+        ([this](std::shared_ptr<string> event){ on_data_json("ENCODER_ERR", event); });
     }
+
+    _js_interactive_statuses_subscription =
+      chain.channel<chronicle::channels::js_interactive_statuses>().subscribe
+      ([this](std::shared_ptr<chronicle::channels::js_interactive_status> st){ on_interactive_status(st); });
   }
 
 
   void start() {
+    if (listen_mode) {
+      start_listen();
+      return;
+    }
+
     if (!is_interactive_mode())
       exporter_will_ack_blocks(maxunack);
 
@@ -209,146 +255,504 @@ public:
     boost::asio::connect(ws->next_layer(), results.begin(), results.end());
     ws->handshake(ws_host, ws_path);
     ilog("Connected");
-    if (is_interactive_mode()) {
-      async_read_interactive_reqs();
-    }
-    else {
-      async_read_acks();
-    }
-    async_send_events();
+    read_loop(this)();
+    send_loop(this)();
   }
 
 
   void stop() {
+    if (listen_mode) {
+      if (acceptor)
+        acceptor->close();
+      auto all_sessions = sessions;
+      for (auto& item : all_sessions)
+        close_session(item.second);
+      return;
+    }
     close_ws(boost::beast::websocket::close_code::normal);
   }
 
 
-  void close_ws(boost::beast::websocket::close_reason reason) {
-    ws->next_layer().cancel();
-    if( ws->is_open() ) {
-      ilog("Closing websocket connection to ${h}:${p}", ("h",ws_host)("p",ws_port));
-      ws->async_close(reason, app().get_priority_queue().wrap(ws_priority, [&](error_code ec) {
-            if (ec) elog(ec.message());
-            abort_receiver();
-          }));
-    }
-    else {
-      abort_receiver();
-    }
+  void start_listen() {
+    auto address = boost::asio::ip::make_address(ws_host);
+    boost::asio::ip::tcp::endpoint endpoint(address, std::stoul(ws_port));
+    acceptor = std::make_shared<boost::asio::ip::tcp::acceptor>(std::ref(app().get_io_service()));
+    acceptor->open(endpoint.protocol());
+    acceptor->set_option(boost::asio::socket_base::reuse_address(true));
+    acceptor->bind(endpoint);
+    acceptor->listen();
+    accept_retry_timer = std::make_shared<boost::asio::deadline_timer>(std::ref(app().get_io_service()));
+    client_timer = std::make_shared<boost::asio::deadline_timer>(std::ref(app().get_io_service()));
+    ilog("Listening for websocket clients on ${h}:${p}", ("h",ws_host)("p",ws_port));
+    async_accept();
   }
 
 
+  void async_accept() {
+    auto session = std::make_shared<ws_session>();
+    session->ws = std::make_shared<wstream>(std::ref(app().get_io_service()));
+    acceptor->async_accept
+      (session->ws->next_layer(),
+       app().get_priority_queue().wrap(ws_priority, [this, session](error_code ec) {
+           if (ec) {
+             if (ec == boost::asio::error::operation_aborted)
+               return;
+             // such as running out of file descriptors: try again a bit later
+             elog("Error accepting websocket client: ${e}", ("e",ec.message()));
+             accept_retry_timer->expires_from_now(boost::posix_time::seconds(1));
+             accept_retry_timer->async_wait
+               (app().get_priority_queue().wrap(ws_priority, [this](error_code ec) {
+                   if (!ec && acceptor->is_open())
+                     async_accept();
+                 }));
+             return;
+           }
+           session->ws->binary(true);
+           session->ws->auto_fragment(true);
+           session->ws->async_accept
+             (app().get_priority_queue().wrap(ws_priority, [this, session](error_code ec) {
+                 if (ec) {
+                   elog("Websocket handshake failed: ${e}", ("e",ec.message()));
+                   return;
+                 }
+                 session->client_id = next_client_id++;
+                 session->last_write = fc::time_point::now();
+                 sessions[session->client_id] = session;
+                 error_code epec;
+                 auto endpoint = session->ws->next_layer().remote_endpoint(epec);
+                 ilog("Websocket client ${c} connected from ${a}",
+                      ("c",session->client_id)("a",endpoint.address().to_string()));
+                 session_read(session);
+               }));
+           async_accept();
+         }));
+  }
+
 
-  void async_read_acks() {
+  void session_read(std::shared_ptr<ws_session> session) {
     auto in_buffer = std::make_shared<flat_buffer>();
-    ws->async_read
+    session->ws->async_read
       (*in_buffer,
-       app().get_priority_queue().wrap(ws_priority, [this, in_buffer](error_code ec, size_t) {
+       app().get_priority_queue().wrap(ws_priority, [this, session, in_buffer](error_code ec, size_t) {
            if (ec) {
-             close_ws(boost::beast::websocket::close_code::unknown_data);
+             close_session(session);
+             return;
            }
-           else {
-             const auto in_data = in_buffer->data();
-             uint64_t ack = std::stoul(string((const char*)in_data.data(), in_data.size()));
-             if( ack > std::numeric_limits<uint32_t>::max() ) {
-               elog("Wrong data in acknowledgement: ${s}",
-                    ("s",string((const char*)in_data.data(), in_data.size())));
-               throw std::runtime_error("Consumer acknowledged block number higher than UINT32_MAX");
-             }
-             ack_block(ack);
-             async_read_acks();
+           const auto in_data = in_buffer->data();
+           std::shared_ptr<chronicle::channels::interactive_request> req;
+           try {
+             req = parse_interactive_req(string((const char*)in_data.data(), in_data.size()));
+           }
+           catch (const std::exception& e) {
+             // a wrong request only disconnects its client
+             elog("Client ${c} sent a wrong request: ${e}", ("c",session->client_id)("e",e.what()));
+             close_session(session);
+             return;
            }
+           req->client_id = session->client_id;
+           _interactive_requests_chan.publish(ws_priority, req);
+           session_read(session);
          }));
   }
 
 
-  void async_read_interactive_reqs() {
-    auto in_buffer = std::make_shared<flat_buffer>();
-    ws->async_read
-      (*in_buffer,
-       app().get_priority_queue().wrap(ws_priority, [this, in_buffer](error_code ec, size_t) {
+  void session_write(std::shared_ptr<ws_session> session) {
+    if (session->writing || session->closed || session->queue.empty())
+      return;
+    session->writing = true;
+    session->msg = session->queue.front();
+    session->queue.pop();
+    sessions_queue_size--;
+    session->ws->async_write
+      (boost::asio::const_buffer(session->msg->data(), session->msg->size()),
+       app().get_priority_queue().wrap(ws_priority, [this, session](error_code ec, size_t) {
+           session->writing = false;
            if (ec) {
-             close_ws(boost::beast::websocket::close_code::unknown_data);
+             elog("ERROR writing to websocket client ${c}: ${e}", ("c",session->client_id)("e",ec.message()));
+             close_session(session);
            }
            else {
-             auto req = std::make_shared<chronicle::channels::interactive_request>();
-             const auto in_data = in_buffer->data();
-             string reqstr((const char*)in_data.data(), in_data.size());
-             auto pos = reqstr.find('-');
-             if (pos == string::npos) {
-               req->block_num_start = std::stoul(reqstr);
-               req->block_num_end = req->block_num_start+1;
-             } else {
-               req->block_num_start = std::stoul(string(reqstr, 0, pos));
-               req->block_num_end = std::stoul(string(reqstr, pos+1));
-             }
-             if (req->block_num_end <= req->block_num_start) {
-               elog("Wrong interactive request: start=${s}, end=${e}", ("s",req->block_num_start)("e",req->block_num_end));
-               throw std::runtime_error("End block in interactive request not higher than start block");
+             session->last_write = fc::time_point::now();
+             if (session->full && session->queue.size() < queue_lwm) {
+               session->full = false;
+               update_listen_slowdown();
              }
-             ilog("Interactive request: start=${s}, end=${e}", ("s",req->block_num_start)("e",req->block_num_end));
-             _interactive_requests_chan.publish(ws_priority, req);
-             async_read_interactive_reqs();
+             session_write(session);
            }
          }));
   }
 
 
+  // The receiver is paused while any client's queue is above the limit,
+  // the same way as for a single exporter connection
+  void update_listen_slowdown() {
+    size_t max_queue = 0;
+    bool any_full = false;
+    for (auto& item : sessions) {
+      max_queue = std::max(max_queue, item.second->queue.size());
+      any_full = any_full || item.second->full;
+    }
+    update_slowdown(max_queue);
+    if (any_full && !client_timer_armed)
+      arm_client_timer();
+  }
+
+
+  // a client that holds back the receiver and has not completed a write
+  // within the timeout is disconnected, so that it does not stall the others
+  void arm_client_timer() {
+    client_timer_armed = true;
+    client_timer->expires_from_now(boost::posix_time::seconds(1));
+    client_timer->async_wait
+      (app().get_priority_queue().wrap(ws_priority, [this](error_code ec) {
+          client_timer_armed = false;
+          if (ec)
+            return;
+          auto deadline = fc::time_point::now() - fc::seconds(client_timeout_sec);
+          bool any_full = false;
+          auto all_sessions = sessions;
+          for (auto& item : all_sessions) {
+            auto& session = item.second;
+            if (!session->full)
+              continue;
+            if (session->last_write < deadline) {
+              elog("Websocket client ${c} has not received anything in ${t} seconds, its queue has ${q} messages",
+                   ("c",session->client_id)("t",client_timeout_sec)("q",session->queue.size()));
+              close_session(session);
+            }
+            else {
+              any_full = true;
+            }
+          }
+          if (any_full)
+            arm_client_timer();
+        }));
+  }
 
-  void async_send_events() {
-    if( async_queue.empty() ) {
-      if( pause_time_msec == 0 ) {
-        pause_time_msec = 5;
-      }
-      else if( pause_time_msec < 256 ) {
-        pause_time_msec *= 2;
-      }
 
-      mytimer->expires_from_now(boost::posix_time::milliseconds(pause_time_msec));
-      mytimer->async_wait(app().get_priority_queue().wrap(ws_priority, [this](const error_code ec) {
-            async_send_events();
+  void close_session(std::shared_ptr<ws_session> session) {
+    if (session->closed)
+      return;
+    session->closed = true;
+    sessions_queue_size -= session->queue.size();
+    session->queue = {};
+    sessions.erase(session->client_id);
+    ilog("Websocket client ${c} disconnected", ("c",session->client_id));
+    if (session->full)
+      update_listen_slowdown();
+
+    // drop everything that the client has requested
+    auto cancel = std::make_shared<chronicle::channels::interactive_request>();
+    cancel->client_id = session->client_id;
+    cancel->cancel = true;
+    _interactive_requests_chan.publish(ws_priority, cancel);
+
+    error_code ec;
+    session->ws->next_layer().close(ec);
+  }
+
+
+  void update_slowdown(size_t queue_size) {
+    if( queue_size >= queue_hwm ) {
+      slowdown_receiver(true);
+    }
+    else if( queue_size < queue_lwm ) {
+      slowdown_receiver(false);
+    }
+  }
+
+
+  void close_ws(boost::beast::websocket::close_reason reason) {
+    ws->next_layer().cancel();
+    if( ws->is_open() ) {
+      ilog("Closing websocket connection to ${h}:${p}", ("h",ws_host)("p",ws_port));
+      ws->async_close(reason, app().get_priority_queue().wrap(ws_priority, [&](error_code ec) {
+            if (ec) elog(ec.message());
+            abort_receiver();
           }));
     }
     else {
-      pause_time_msec = 0;
-      if( async_queue.size() >= queue_hwm ) {
-        slowdown_receiver(true);
-      }
-      else if( async_queue.size() < queue_lwm ) {
-        slowdown_receiver(false);
+      abort_receiver();
+    }
+  }
+
+
+
+  // Reads the messages from the server: block acknowledgements, or
+  // requests in interactive mode. It's a stackless coroutine that is
+  // resumed through the priority queue when a read completes.
+  struct read_loop : boost::asio::coroutine {
+    exp_ws_plugin_impl*            impl;
+    std::shared_ptr<flat_buffer>   in_buffer = std::make_shared<flat_buffer>();
+
+    explicit read_loop(exp_ws_plugin_impl* i) : impl(i) {}
+
+    void operator()(error_code ec = {}, size_t = 0);
+
+    auto resume() {
+      return app().get_priority_queue().wrap(impl->ws_priority, *this);
+    }
+  };
+
+
+  void on_server_message(const string& msg) {
+    if (is_interactive_mode()) {
+      _interactive_requests_chan.publish(ws_priority, parse_interactive_req(msg));
+      return;
+    }
+    uint64_t ack = std::stoul(msg);
+    if( ack > std::numeric_limits<uint32_t>::max() ) {
+      elog("Wrong data in acknowledgement: ${s}", ("s",msg));
+      throw std::runtime_error("Consumer acknowledged block number higher than UINT32_MAX");
+    }
+    ack_block(ack);
+  }
+
+
+  // Request is either a JSON object, or a single range in text format
+  std::shared_ptr<chronicle::channels::interactive_request> parse_interactive_req(const string& reqstr) {
+    auto req = std::make_shared<chronicle::channels::interactive_request>();
+    if (reqstr.size() > 0 && reqstr[0] == '{') {
+      parse_json_req(reqstr, *req);
+    }
+    else {
+      req->ranges.push_back(parse_interactive_range(reqstr));
+    }
+    return req;
+  }
+
+
+  // {"id":N, "ranges":[...], "fetch_block":bool, "fetch_traces":bool, "fetch_deltas":bool,
+  //  "accounts":[...], "priority":N} or {"cancel":N}
+  void parse_json_req(const string& reqstr, chronicle::channels::interactive_request& req) {
+    rapidjson::Document doc;
+    if (doc.Parse(reqstr.c_str()).HasParseError() || !doc.IsObject())
+      throw std::runtime_error("Cannot parse interactive request: " + reqstr);
+
+    if (doc.HasMember("cancel")) {
+      req.req_id = json_uint(doc["cancel"], "cancel");
+      req.cancel = true;
+      ilog("Interactive request: cancel ${r}", ("r",req.req_id));
+      return;
+    }
+
+    if (!doc.HasMember("id"))
+      throw std::runtime_error("Interactive request needs an id: " + reqstr);
+    req.req_id = json_uint(doc["id"], "id");
+    if (req.req_id == 0)
+      throw std::runtime_error("Interactive request id must be a positive integer");
+
+    if (!doc.HasMember("ranges") || !doc["ranges"].IsArray() || doc["ranges"].Size() == 0)
+      throw std::runtime_error("Interactive request needs a non-empty array of ranges: " + reqstr);
+    for (auto& r : doc["ranges"].GetArray()) {
+      if (!r.IsString())
+        throw std::runtime_error("Range in interactive request must be a string: " + reqstr);
+      req.ranges.push_back(parse_interactive_range(string(r.GetString(), r.GetStringLength())));
+    }
+
+    req.fetch_block = json_bool(doc, "fetch_block", true);
+    req.fetch_traces = json_bool(doc, "fetch_traces", true);
+    req.fetch_deltas = json_bool(doc, "fetch_deltas", true);
+
+    if (doc.HasMember("accounts")) {
+      if (!doc["accounts"].IsArray())
+        throw std::runtime_error("accounts in interactive request must be an array: " + reqstr);
+      for (auto& a : doc["accounts"].GetArray()) {
+        if (!a.IsString())
+          throw std::runtime_error("Account in interactive request must be a string: " + reqstr);
+        req.accounts.insert(abieos::name(string(a.GetString(), a.GetStringLength())).value);
       }
-      async_msg = async_queue.front();
-      async_queue.pop();
-      async_out_buffer = boost::asio::const_buffer(async_msg->data(), async_msg->size());
-      ws->async_write
-        (async_out_buffer,
-         app().get_priority_queue().wrap(ws_priority, [this](error_code ec, size_t) {
-             if (ec) {
-               elog("ERROR writing to websocket: ${e}", ("e",ec.message()));
-               close_ws(boost::beast::websocket::close_code::unknown_data);
-             }
-             else {
-               async_send_events();
-             }
-           }));
     }
+
+    if (doc.HasMember("priority"))
+      req.priority = json_uint(doc["priority"], "priority");
+
+    ilog("Interactive request ${r}: ${n} ranges, block=${b}, traces=${t}, deltas=${d}, accounts=${a}, priority=${p}",
+         ("r",req.req_id)("n",req.ranges.size())("b",req.fetch_block)("t",req.fetch_traces)
+         ("d",req.fetch_deltas)("a",req.accounts.size())("p",req.priority));
   }
 
 
-  inline void push_msg(std::shared_ptr<msgbuf> buf) {
-    async_queue.push(buf);
-    if( pause_time_msec > 0 )
-      mytimer->cancel();
+  static uint32_t json_uint(const rapidjson::Value& v, const char* field) {
+    if (v.IsUint())
+      return v.GetUint();
+    if (v.IsString())
+      return std::stoul(v.GetString());
+    throw std::runtime_error(string("Interactive request field must be an unsigned integer: ") + field);
+  }
+
+
+  static bool json_bool(const rapidjson::Document& doc, const char* field, bool default_value) {
+    if (!doc.HasMember(field))
+      return default_value;
+    if (!doc[field].IsBool())
+      throw std::runtime_error(string("Interactive request field must be boolean: ") + field);
+    return doc[field].GetBool();
+  }
+
+
+  // Range is either a block number, a range of blocks (N-M), a time range (T1/T2) in ISO format,
+  // a transaction ID in hex, or an account name followed by colon and a block or time range
+  chronicle::channels::interactive_range parse_interactive_range(string reqstr) {
+    chronicle::channels::interactive_range range;
+    if (reqstr.size() == 64 &&
+        reqstr.find_first_not_of("0123456789abcdefABCDEF") == string::npos) {
+      abieos::checksum256 trx_id;
+      fc::from_hex(reqstr, (char*)trx_id.value.data(), trx_id.value.size());
+      range.trx_id = trx_id;
+      ilog("Interactive request: trx_id=${t}", ("t",reqstr));
+      return range;
+    }
+
+    auto colon = reqstr.find(':');
+    if (colon != string::npos &&
+        reqstr.find_first_not_of("abcdefghijklmnopqrstuvwxyz12345.") == colon) {
+      range.account = abieos::name(string(reqstr, 0, colon));
+      reqstr.erase(0, colon+1);
+    }
+
+    auto pos = reqstr.find('/');
+    if (pos != string::npos) {
+      range.time_start.emplace();
+      range.time_start->slot = time_to_slot(string(reqstr, 0, pos));
+      range.time_end.emplace();
+      range.time_end->slot = time_to_slot(string(reqstr, pos+1));
+      if (range.time_end->slot <= range.time_start->slot)
+        throw std::runtime_error("End time in interactive request not higher than start time");
+      ilog("Interactive request: account=${a}, time=${t}",
+           ("a",range.account ? (string)(*range.account) : string())("t",reqstr));
+      return range;
+    }
+
+    pos = reqstr.find('-');
+    if (pos == string::npos) {
+      range.block_num_start = std::stoul(reqstr);
+      range.block_num_end = range.block_num_start+1;
+    } else {
+      range.block_num_start = std::stoul(string(reqstr, 0, pos));
+      range.block_num_end = std::stoul(string(reqstr, pos+1));
+    }
+    if (range.block_num_end <= range.block_num_start) {
+      elog("Wrong interactive request: start=${s}, end=${e}", ("s",range.block_num_start)("e",range.block_num_end));
+      throw std::runtime_error("End block in interactive request not higher than start block");
+    }
+    if (range.account) {
+      ilog("Interactive request: account=${a}, start=${s}, end=${e}",
+           ("a",(string)(*range.account))("s",range.block_num_start)("e",range.block_num_end));
+    }
+    else {
+      ilog("Interactive request: start=${s}, end=${e}", ("s",range.block_num_start)("e",range.block_num_end));
+    }
+    return range;
+  }
+
+
+
+  static constexpr int64_t block_timestamp_epoch_ms = 946684800000ll; // year 2000
+  static constexpr int64_t block_interval_ms = 500;
+
+  // converts ISO time to block timestamp slot
+  static uint32_t time_to_slot(const string& timestr) {
+    auto tp = fc::time_point::from_iso_string(timestr);
+    int64_t msec = tp.time_since_epoch().count() / 1000;
+    if (msec < block_timestamp_epoch_ms)
+      throw std::runtime_error("Time in interactive request is before the blockchain epoch: " + timestr);
+    return (msec - block_timestamp_epoch_ms) / block_interval_ms;
+  }
+
+
+  // Writes the queue until it's empty, as a stackless coroutine. The
+  // writer is idle afterwards, and push_msg starts it again, so there is
+  // no polling.
+  struct send_loop : boost::asio::coroutine {
+    exp_ws_plugin_impl*  impl;
+
+    explicit send_loop(exp_ws_plugin_impl* i) : impl(i) {}
+
+    void operator()(error_code ec = {}, size_t = 0);
+
+    auto resume() {
+      return app().get_priority_queue().wrap(impl->ws_priority, *this);
+    }
+  };
+
+
+  inline void push_msg(uint32_t client_id, std::shared_ptr<msgbuf> buf) {
+    size_t queue_size;
+    if( listen_mode ) {
+      auto itr = sessions.find(client_id);
+      if( itr == sessions.end() )
+        return; // the client has disconnected
+      auto& session = itr->second;
+      session->queue.push(buf);
+      queue_size = ++sessions_queue_size;
+      if( !session->full && session->queue.size() >= queue_hwm ) {
+        session->full = true;
+        update_listen_slowdown();
+      }
+      session_write(session);
+    }
+    else {
+      async_queue.push(buf);
+      queue_size = async_queue.size();
+      if( !async_writing && ws->is_open() )
+        send_loop(this)();
+    }
     msg_report_counter--;
     if( msg_report_counter == 0 ) {
-      ilog("exp_ws_plugin queue_size=${q}", ("q",async_queue.size()));
+      ilog("exp_ws_plugin queue_size=${q}", ("q",queue_size));
+      if( listen_mode )
+        ilog("exp_ws_plugin clients=${c}", ("c",sessions.size()));
       msg_report_counter = 10000;
     }
   }
 
 
-  void on_event_json(const char* msgtype, std::shared_ptr<string> event) {
+  void on_interactive_status(std::shared_ptr<chronicle::channels::js_interactive_status> st) {
+    auto key = std::make_pair(st->client_id, st->req_id);
+    auto pos = std::find(active_reqs.begin(), active_reqs.end(), key);
+    if (st->active) {
+      if (pos == active_reqs.end())
+        active_reqs.push_back(key);
+    }
+    else if (pos != active_reqs.end()) {
+      active_reqs.erase(pos);
+    }
+    // statuses of untagged requests are only used for routing
+    if (st->req_id == 0)
+      return;
+    if (use_bin_headers)
+      on_event_bin(CHRONICLE_MSGTYPE_REQ_STATUS, st->client_id, st->req_id, st->json);
+    else
+      on_event_json("REQ_STATUS", st->client_id, st->req_id, st->json);
+  }
+
+
+  void on_data_json(const char* msgtype, std::shared_ptr<string> event) {
+    if (active_reqs.empty()) {
+      if (!listen_mode)
+        on_event_json(msgtype, 0, 0, event);
+    }
+    else {
+      for (auto& r : active_reqs)
+        on_event_json(msgtype, r.first, r.second, event);
+    }
+  }
+
+
+  void on_data_bin(int32_t msgtype, std::shared_ptr<string> event) {
+    if (active_reqs.empty()) {
+      if (!listen_mode)
+        on_event_bin(msgtype, 0, 0, event);
+    }
+    else {
+      for (auto& r : active_reqs)
+        on_event_bin(msgtype, r.first, r.second, event);
+    }
+  }
+
+
+  void on_event_json(const char* msgtype, uint32_t client_id, uint32_t req_id, std::shared_ptr<string> event) {
     try {
       try {
         json_buffer.Clear();
@@ -356,6 +760,10 @@ public:
         json_writer.StartObject();
         json_writer.Key("msgtype");
         json_writer.String(msgtype);
+        if (req_id != 0) {
+          json_writer.Key("req_id");
+          json_writer.Uint(req_id);
+        }
         json_writer.Key("data");
         json_writer.RawValue(event->data(), event->length(), rapidjson::kObjectType);
         json_writer.EndObject();
@@ -364,7 +772,7 @@ public:
         string msg(json_buffer.GetString());
         auto buf = std::make_shared<msgbuf>(sz);
         memcpy(buf->data(), msg.data(), sz);
-        push_msg(buf);
+        push_msg(client_id, buf);
       }
       FC_LOG_AND_RETHROW();
     }
@@ -374,7 +782,7 @@ public:
   }
 
 
-  void on_event_bin(int32_t msgtype, int32_t msgopts, std::shared_ptr<string> event) {
+  void on_event_bin(int32_t msgtype, uint32_t client_id, int32_t msgopts, std::shared_ptr<string> event) {
     try {
       try {
         auto buf = std::make_shared<msgbuf>(event->length()+sizeof(msgtype)+sizeof(msgopts));
@@ -384,7 +792,7 @@ public:
         memcpy(ptr, &msgopts, sizeof(msgopts));
         ptr += sizeof(msgopts);
         memcpy(ptr, event->data(), event->length());
-        push_msg(buf);
+        push_msg(client_id, buf);
       }
       FC_LOG_AND_RETHROW();
     }
@@ -395,6 +803,47 @@ public:
 
 };
 
+#include <boost/asio/yield.hpp>
+
+void exp_ws_plugin_impl::read_loop::operator()(error_code ec, size_t) {
+  if (ec) {
+    impl->close_ws(boost::beast::websocket::close_code::unknown_data);
+    return;
+  }
+  reenter (this) {
+    for (;;) {
+      yield impl->ws->async_read(*in_buffer, resume());
+      const auto in_data = in_buffer->data();
+      impl->on_server_message(string((const char*)in_data.data(), in_data.size()));
+      in_buffer->consume(in_buffer->size());
+    }
+  }
+}
+
+
+void exp_ws_plugin_impl::send_loop::operator()(error_code ec, size_t) {
+  if (ec) {
+    elog("ERROR writing to websocket: ${e}", ("e",ec.message()));
+    impl->close_ws(boost::beast::websocket::close_code::unknown_data);
+    return;
+  }
+  reenter (this) {
+    impl->async_writing = true;
+    while( !impl->async_queue.empty() ) {
+      impl->update_slowdown(impl->async_queue.size());
+      impl->async_msg = impl->async_queue.front();
+      impl->async_queue.pop();
+      impl->async_out_buffer = boost::asio::const_buffer(impl->async_msg->data(), impl->async_msg->size());
+      yield impl->ws->async_write(impl->async_out_buffer, resume());
+    }
+    impl->async_writing = false;
+    impl->async_msg.reset();
+  }
+}
+
+#include <boost/asio/unyield.hpp>
+
+
 
 
 exp_ws_plugin::exp_ws_plugin() :my(new exp_ws_plugin_impl){
@@ -412,9 +861,13 @@ void exp_ws_plugin::set_program_options( options_description& cli, options_descr
     (WS_MAXUNACK_OPT, bpo::value<uint32_t>()->default_value(1000),
      "Receiver will pause at so many unacknowledged blocks")
     (WS_MAXQUEUE_OPT, bpo::value<uint32_t>()->default_value(10000),
-     "Receiver will pause if outbound queue exceeds this limit")
+     "Receiver will pause if outbound queue exceeds this limit. In listen mode, the limit applies to each client")
     (WS_BINHDR, bpo::value<bool>()->default_value(false),
      "Start export messages with 32-bit native msgtype,msgopt")
+    (WS_LISTEN_OPT, bpo::value<bool>()->default_value(false),
+     "Interactive mode: accept client connections on host and port instead of connecting to them")
+    (WS_CLIENT_TIMEOUT_OPT, bpo::value<uint32_t>()->default_value(60),
+     "In listen mode, disconnect a client that pauses the receiver and does not receive anything for so many seconds")
     ;
 }
 
@@ -454,6 +907,14 @@ void exp_ws_plugin::plugin_initialize( const variables_map& options ) {
 
     my->use_bin_headers = options.at(WS_BINHDR).as<bool>();
 
+    my->listen_mode = options.at(WS_LISTEN_OPT).as<bool>();
+    if( my->listen_mode && !is_interactive_opt(options) )
+      throw std::runtime_error(string(WS_LISTEN_OPT) + " is only supported in interactive mode");
+
+    my->client_timeout_sec = options.at(WS_CLIENT_TIMEOUT_OPT).as<uint32_t>();
+    if( my->client_timeout_sec == 0 )
+      throw std::runtime_error("Client timeout must be a positive integer");
+
     my->init();
     ilog("Initialized exp_ws_plugin");
     exporter_initialized();
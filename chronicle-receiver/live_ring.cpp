@@ -0,0 +1,191 @@
+// copyright defined in LICENSE.txt
+
+#include "live_ring.hpp"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fc/log/logger.hpp>
+
+namespace bip = boost::interprocess;
+namespace bfs = boost::filesystem;
+
+namespace chronicle {
+
+  static const uint64_t LIVE_RING_MAGIC = 0x474e4952564c4443ull; // "CDLVRING"
+  static const uint32_t LIVE_RING_VERSION = 1;
+
+  struct live_ring::header {
+    uint64_t    magic;
+    uint32_t    version;
+    uint32_t    slots;
+    uint64_t    data_size;
+    uint64_t    write_pos;  // total bytes ever written to the data area
+    uint32_t    last_block;
+    char        reserved[28];
+  };
+
+  struct live_ring::slot {
+    uint32_t    seq;        // odd while the writer updates the slot
+    uint32_t    block_num;
+    uint64_t    pos;        // position in the data area, not wrapped
+    uint32_t    size;
+    uint32_t    reserved;
+  };
+
+
+  live_ring::live_ring(const std::string& path, bool writable, uint32_t slots, uint64_t data_size)
+  {
+    if( !bfs::exists(path) ) {
+      if( !writable )
+        throw std::runtime_error("Live ring does not exist: " + path);
+      create(path, slots, data_size);
+    }
+
+    bip::mode_t mode = writable ? bip::read_write : bip::read_only;
+    _file = bip::file_mapping(path.c_str(), mode);
+    _region = bip::mapped_region(_file, mode);
+    _hdr = static_cast<header*>(_region.get_address());
+
+    if( _hdr->magic != LIVE_RING_MAGIC || _hdr->version != LIVE_RING_VERSION ) {
+      if( !writable )
+        throw std::runtime_error("Invalid live ring file: " + path);
+    }
+    if( writable && (_hdr->magic != LIVE_RING_MAGIC || _hdr->version != LIVE_RING_VERSION ||
+                     _hdr->slots != slots || _hdr->data_size != data_size) ) {
+      ilog("Recreating live ring ${f}", ("f",path));
+      _region = bip::mapped_region();
+      _file = bip::file_mapping();
+      bfs::remove(path);
+      create(path, slots, data_size);
+      _file = bip::file_mapping(path.c_str(), mode);
+      _region = bip::mapped_region(_file, mode);
+      _hdr = static_cast<header*>(_region.get_address());
+    }
+
+    _slots = reinterpret_cast<slot*>(reinterpret_cast<char*>(_hdr) + sizeof(header));
+    _data = reinterpret_cast<char*>(_slots + _hdr->slots);
+
+    ilog("Live ring ${f}: ${n} blocks, ${s} MB, last block ${b}",
+         ("f",path)("n",_hdr->slots)("s",_hdr->data_size/1024/1024)("b",last_block()));
+  }
+
+
+  void live_ring::create(const std::string& path, uint32_t slots, uint64_t data_size) {
+    if( slots == 0 || data_size == 0 )
+      throw std::runtime_error("Live ring size cannot be zero");
+    std::ofstream ofs(path, std::ofstream::trunc);
+    ofs.close();
+    // a new file is filled with zeros, so all slots are empty
+    bfs::resize_file(path, sizeof(header) + slots * sizeof(slot) + data_size);
+
+    bip::file_mapping file(path.c_str(), bip::read_write);
+    bip::mapped_region region(file, bip::read_write, 0, sizeof(header));
+    header* hdr = static_cast<header*>(region.get_address());
+    hdr->version = LIVE_RING_VERSION;
+    hdr->slots = slots;
+    hdr->data_size = data_size;
+    hdr->magic = LIVE_RING_MAGIC;
+    region.flush();
+  }
+
+
+  bool live_ring::exists(const std::string& path) {
+    return bfs::exists(path);
+  }
+
+
+  void live_ring::add(uint32_t block_num, const char* data, size_t size) {
+    _pending.emplace_back(block_num, std::string(data, size));
+  }
+
+
+  void live_ring::flush(uint32_t irreversible) {
+    while( !_pending.empty() && _pending.front().first <= irreversible ) {
+      store(_pending.front().first, _pending.front().second);
+      _pending.pop_front();
+    }
+  }
+
+
+  void live_ring::rollback(uint32_t block_num) {
+    while( !_pending.empty() && _pending.back().first >= block_num )
+      _pending.pop_back();
+  }
+
+
+  void live_ring::store(uint32_t block_num, const std::string& data) {
+    slot& s = _slots[block_num % _hdr->slots];
+    uint64_t data_size = _hdr->data_size;
+    uint64_t pos = _hdr->write_pos;
+    bool fits = data.size() <= data_size;
+
+    uint32_t seq = s.seq;
+    __atomic_store_n(&s.seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if( fits ) {
+      // readers of older blocks detect the overwrite by the advanced position
+      __atomic_store_n(&_hdr->write_pos, pos + data.size(), __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      uint64_t offset = pos % data_size;
+      size_t first = std::min<uint64_t>(data.size(), data_size - offset);
+      memcpy(_data + offset, data.data(), first);
+      memcpy(_data, data.data() + first, data.size() - first);
+    }
+
+    __atomic_store_n(&s.block_num, fits ? block_num : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s.pos, pos, __ATOMIC_RELAXED);
+    __atomic_store_n(&s.size, (uint32_t)data.size(), __ATOMIC_RELAXED);
+    __atomic_store_n(&s.seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&_hdr->last_block, block_num, __ATOMIC_RELEASE);
+  }
+
+
+  bool live_ring::get(uint32_t block_num, std::string& out) const {
+    const slot& s = _slots[block_num % _hdr->slots];
+    uint32_t seq = __atomic_load_n(&s.seq, __ATOMIC_ACQUIRE);
+    if( seq & 1 )
+      return false;
+    uint32_t slot_block = __atomic_load_n(&s.block_num, __ATOMIC_RELAXED);
+    uint64_t pos = __atomic_load_n(&s.pos, __ATOMIC_RELAXED);
+    uint32_t size = __atomic_load_n(&s.size, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if( __atomic_load_n(&s.seq, __ATOMIC_RELAXED) != seq || slot_block != block_num )
+      return false;
+
+    uint64_t data_size = _hdr->data_size;
+    uint64_t offset = pos % data_size;
+    size_t first = std::min<uint64_t>(size, data_size - offset);
+    out.resize(size);
+    memcpy(&out[0], _data + offset, first);
+    memcpy(&out[first], _data, size - first);
+
+    // the data is valid only if the writer has not wrapped around over it while we copied
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&_hdr->write_pos, __ATOMIC_RELAXED) <= pos + data_size;
+  }
+
+
+  bool live_ring::covers(uint32_t start, uint32_t end) const {
+    uint32_t last = last_block();
+    if( last == 0 || end == 0 || end - 1 > last )
+      return false;
+    return last - start < _hdr->slots;
+  }
+
+
+  uint32_t live_ring::last_block() const {
+    return __atomic_load_n(&_hdr->last_block, __ATOMIC_ACQUIRE);
+  }
+
+
+  uint32_t live_ring::first_block() const {
+    uint32_t last = last_block();
+    if( last == 0 )
+      return 0;
+    return (last >= _hdr->slots) ? last - _hdr->slots + 1 : 1;
+  }
+}
@@ -0,0 +1,63 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+
+namespace chronicle {
+
+  // Memory-mapped ring of the latest irreversible block results, as they
+  // were received from the state history plugin.
+  //
+  // The scanning receiver is the only writer. Results of every block are
+  // kept in a circular data area, and a slot per block number points to
+  // them. Slots are protected by sequence counters, so that interactive
+  // readers in other processes never take a lock: a reader that overlaps
+  // with the writer detects it and treats the block as missing.
+
+  class live_ring {
+  public:
+    // the writer recreates the file if its geometry has changed
+    live_ring(const std::string& path, bool writable, uint32_t slots = 0, uint64_t data_size = 0);
+
+    static bool exists(const std::string& path);
+
+    // memorize a block result until the block becomes irreversible
+    void add(uint32_t block_num, const char* data, size_t size);
+
+    // write pending results for blocks up to and including the given block
+    void flush(uint32_t irreversible);
+
+    // forget pending results at or above the fork block
+    void rollback(uint32_t block_num);
+
+    // copies the result of a block, returns false if it's not in the ring
+    bool get(uint32_t block_num, std::string& out) const;
+
+    // true if all blocks in [start, end) are expected to be in the ring
+    bool covers(uint32_t start, uint32_t end) const;
+
+    uint32_t last_block() const;
+
+    // the oldest block that is expected in the ring, 0 if it's empty
+    uint32_t first_block() const;
+
+  private:
+    struct header;
+    struct slot;
+
+    boost::interprocess::file_mapping   _file;
+    boost::interprocess::mapped_region  _region;
+    header*                             _hdr = nullptr;
+    slot*                               _slots = nullptr;
+    char*                               _data = nullptr;
+    std::deque<std::pair<uint32_t, std::string>>  _pending;
+
+    void create(const std::string& path, uint32_t slots, uint64_t data_size);
+    void store(uint32_t block_num, const std::string& data);
+  };
+}
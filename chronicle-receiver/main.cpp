@@ -32,6 +32,9 @@ int main( int argc, char** argv ) {
     initialize_logging();
     appbase::app().startup();
     appbase::app().exec();
+  } catch ( const chronicle::state_operation_finished& e ) {
+    std::cout << e.what() << "\n";
+    return 0;
   } catch ( const boost::exception& e ) {
     std::cerr << boost::diagnostic_information(e) << "\n";
   } catch ( const std::exception& e ) {
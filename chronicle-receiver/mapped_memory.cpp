@@ -0,0 +1,160 @@
+// copyright defined in LICENSE.txt
+
+#include "mapped_memory.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22  // Linux 5.14
+#endif
+
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC 0x958458f6
+#endif
+
+namespace chronicle {
+  namespace mapped_memory {
+
+    static std::string error_text(const char* what) {
+      return std::string(what) + " failed: " + strerror(errno);
+    }
+
+
+    // sums up the counters of all mappings that overlap the range
+    static void read_smaps(uintptr_t start, uintptr_t end, result& res) {
+      std::ifstream smaps("/proc/self/smaps");
+      std::string line;
+      bool inside = false;
+      while( std::getline(smaps, line) ) {
+        uintptr_t from, to;
+        char dash;
+        std::istringstream hdr(line);
+        if( line.find(':') > line.find(' ') && (hdr >> std::hex >> from >> dash >> to) && dash == '-' ) {
+          inside = (from < end && to > start);
+          continue;
+        }
+        if( !inside )
+          continue;
+        std::istringstream field(line);
+        std::string name;
+        uint64_t kb = 0;
+        field >> name >> kb;
+        if( name == "Rss:" )
+          res.rss_kb += kb;
+        else if( name == "AnonHugePages:" || name == "ShmemPmdMapped:" || name == "FilePmdMapped:" ||
+                 name == "Shared_Hugetlb:" || name == "Private_Hugetlb:" )
+          res.huge_kb += kb;
+        else if( name == "Locked:" )
+          res.locked_kb += kb;
+        else if( name == "KernelPageSize:" )
+          res.page_kb = kb;
+      }
+    }
+
+
+    // resident pages of the mappings that start inside the range, per NUMA node
+    static void read_numa_maps(uintptr_t start, uintptr_t end, result& res) {
+      std::ifstream numa_maps("/proc/self/numa_maps");
+      std::string line;
+      std::map<int, uint64_t> node_kb;
+      while( std::getline(numa_maps, line) ) {
+        std::istringstream in(line);
+        uintptr_t addr;
+        if( !(in >> std::hex >> addr) || addr < start || addr >= end )
+          continue;
+        std::map<int, uint64_t> pages;
+        uint64_t page_kb = 4;
+        std::string field;
+        while( in >> field ) {
+          if( field.size() > 1 && field[0] == 'N' && field.find('=') != std::string::npos ) {
+            pages[std::stoi(field.substr(1))] += std::stoull(field.substr(field.find('=') + 1));
+          }
+          else if( field.compare(0, 17, "kernelpagesize_kB") == 0 ) {
+            page_kb = std::stoull(field.substr(18));
+          }
+        }
+        for( auto& p : pages )
+          node_kb[p.first] += p.second * page_kb;
+      }
+      std::ostringstream out;
+      for( auto& n : node_kb )
+        out << (out.tellp() > 0 ? " " : "") << "node" << n.first << "=" << n.second/1024 << "MB";
+      res.nodes = node_kb.empty() ? "none resident" : out.str();
+    }
+
+
+    result apply(const void* addr, uint64_t size, const options& opts) {
+      result res;
+      uintptr_t page = sysconf(_SC_PAGESIZE);
+      uintptr_t start = reinterpret_cast<uintptr_t>(addr) & ~(page - 1);
+      uintptr_t end = (reinterpret_cast<uintptr_t>(addr) + size + page - 1) & ~(page - 1);
+      void* base = reinterpret_cast<void*>(start);
+      size_t len = end - start;
+      res.size_kb = len / 1024;
+
+      res.huge_pages = "not requested";
+      if( opts.huge_pages )
+        res.huge_pages = (madvise(base, len, MADV_HUGEPAGE) == 0) ? "applied" : error_text("madvise(MADV_HUGEPAGE)");
+
+      res.prefault = "not requested";
+      if( opts.prefault ) {
+        auto started = std::chrono::steady_clock::now();
+        // pages are only read, so that a sparse file does not get allocated on disk
+        if( madvise(base, len, MADV_POPULATE_READ) == 0 ) {
+          res.prefault = "applied";
+        }
+        else if( errno == EINVAL ) {
+          // older kernels do not support MADV_POPULATE_READ
+          volatile const char* p = reinterpret_cast<const char*>(start);
+          for( size_t off = 0; off < len; off += page )
+            (void)p[off];
+          res.prefault = "applied by reading";
+        }
+        else {
+          res.prefault = error_text("madvise(MADV_POPULATE_READ)");
+        }
+        res.prefault_msec = std::chrono::duration_cast<std::chrono::milliseconds>
+          (std::chrono::steady_clock::now() - started).count();
+      }
+
+      res.lock = "not requested";
+      if( opts.lock )
+        res.lock = (mlock(base, len) == 0) ? "applied" : error_text("mlock");
+
+      read_smaps(start, end, res);
+      if( opts.numa )
+        read_numa_maps(start, end, res);
+      return res;
+    }
+
+
+    std::string result::to_string() const {
+      std::ostringstream out;
+      out << "size_MB=" << size_kb/1024 << ", page_kB=" << page_kb
+          << ", rss_MB=" << rss_kb/1024 << ", huge_MB=" << huge_kb/1024 << ", locked_MB=" << locked_kb/1024
+          << ", huge_pages: " << huge_pages << ", prefault: " << prefault;
+      if( prefault_msec > 0 )
+        out << " in " << prefault_msec << " ms";
+      out << ", mlock: " << lock;
+      if( !nodes.empty() )
+        out << ", NUMA: " << nodes;
+      return out.str();
+    }
+
+
+    uint64_t hugetlbfs_page_size(const std::string& path) {
+      struct statfs st;
+      if( statfs(path.c_str(), &st) != 0 || st.f_type != HUGETLBFS_MAGIC )
+        return 0;
+      return st.f_bsize;
+    }
+  }
+}
@@ -0,0 +1,44 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace chronicle {
+
+  // Page placement of memory-mapped files, such as the chainbase segment
+  // of the state database. Every setting is applied on a best-effort
+  // basis, and the result tells what the kernel has actually done, so
+  // that a misconfigured host is visible in the log instead of failing.
+
+  namespace mapped_memory {
+
+    struct options {
+      bool  huge_pages = false;  // madvise(MADV_HUGEPAGE) for transparent huge pages
+      bool  prefault = false;    // fault all pages in, without writing to them
+      bool  lock = false;        // mlock the mapping
+      bool  numa = false;        // report the pages per NUMA node
+    };
+
+    struct result {
+      std::string  huge_pages;      // "applied", "not requested", or the error
+      std::string  prefault;
+      std::string  lock;
+      uint64_t     prefault_msec = 0;
+      uint64_t     size_kb = 0;
+      uint64_t     rss_kb = 0;      // as reported in /proc/self/smaps
+      uint64_t     huge_kb = 0;     // backed by transparent or hugetlbfs pages
+      uint64_t     locked_kb = 0;
+      uint64_t     page_kb = 0;     // kernel page size of the mapping
+      std::string  nodes;           // resident memory per NUMA node, if requested
+
+      std::string to_string() const;
+    };
+
+    // applies the options to the pages that cover [addr, addr+size)
+    result apply(const void* addr, uint64_t size, const options& opts);
+
+    // huge page size of a hugetlbfs mount containing the path, or zero if it's another filesystem
+    uint64_t hugetlbfs_page_size(const std::string& path);
+  }
+}
@@ -0,0 +1,34 @@
+// copyright defined in LICENSE.txt
+
+#include "process_stats.hpp"
+
+#include <boost/asio/detail/config.hpp>
+#include <sys/resource.h>
+
+namespace chronicle {
+
+  process_counters& socket_counters() {
+    static process_counters counters;
+    return counters;
+  }
+
+
+  process_counters read_process_counters() {
+    process_counters result = socket_counters();
+    struct rusage usage;
+    if( getrusage(RUSAGE_SELF, &usage) == 0 ) {
+      result.cpu_usec = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ull +
+        usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    }
+    return result;
+  }
+
+
+  const char* socket_backend() {
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+    return "io_uring";
+#else
+    return "epoll";
+#endif
+  }
+}
@@ -0,0 +1,24 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <cstdint>
+
+namespace chronicle {
+
+  // Process-wide resource counters, used to measure the cost of socket
+  // I/O per block and per transferred gigabyte.
+
+  struct process_counters {
+    uint64_t  socket_reads = 0;    // completed reads on counted sockets
+    uint64_t  socket_writes = 0;   // completed writes on counted sockets
+    uint64_t  cpu_usec = 0;        // user and system CPU time
+  };
+
+  process_counters read_process_counters();
+
+  // updated by all counted sockets in the process
+  process_counters& socket_counters();
+
+  // the reactor that Boost.Asio was compiled with: "io_uring" or "epoll"
+  const char* socket_backend();
+}
@@ -1,6 +1,21 @@
 // copyright defined in LICENSE.txt
 
 #include "receiver_plugin.hpp"
+#include "trx_index.hpp"
+#include "time_index.hpp"
+#include "live_ring.hpp"
+#include "abi_log.hpp"
+#include "state_file.hpp"
+#include "checkpoint_writer.hpp"
+#include "replication.hpp"
+#include "mapped_memory.hpp"
+#include "process_stats.hpp"
+#include "counted_socket.hpp"
+#include "cpu_placement.hpp"
+#include "ship_relay.hpp"
+#include "specialized_decoders.hpp"
+#include "activity_bitmap.hpp"
+#include "worker_pool.hpp"
 #include <chainbase/chainbase.hpp>
 
 #include <boost/multi_index_container.hpp>
@@ -9,6 +24,8 @@
 #include <boost/multi_index/composite_key.hpp>
 
 #include <boost/asio/connect.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
@@ -20,19 +37,27 @@
 #include <boost/filesystem.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
 #include <boost/interprocess/mapped_region.hpp>
-#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/interprocess_sharable_mutex.hpp>
 #include <boost/interprocess/sync/scoped_lock.hpp>
 #include <chrono>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <string>
 #include <memory>
 #include <string_view>
+#include <fc/crypto/sha256.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/exception/exception.hpp>
 #include <queue>
+#include <deque>
+#include <list>
+#include <map>
+#include <algorithm>
 #include <limits>
+#include <unistd.h>
 
 using namespace abieos;
 using namespace appbase;
@@ -76,7 +101,14 @@ namespace {
   const char* RCV_HOST_OPT = "host";
   const char* RCV_PORT_OPT = "port";
   const char* RCV_DBSIZE_OPT = "receiver-state-db-size";
+  const char* RCV_DB_HUGETLBFS_OPT = "receiver-state-db-hugetlbfs";
+  const char* RCV_DB_HUGE_PAGES_OPT = "receiver-state-db-huge-pages";
+  const char* RCV_DB_PREFAULT_OPT = "receiver-state-db-prefault";
+  const char* RCV_DB_MLOCK_OPT = "receiver-state-db-mlock";
   const char* RCV_MODE_OPT = "mode";
+  const char* RCV_CPU_AFFINITY_OPT = "cpu-affinity";
+  const char* RCV_NUMA_NODE_OPT = "numa-node";
+  const char* RCV_WORKER_THREADS_OPT = "worker-threads";
   const char* RCV_EVERY_OPT = "report-every";
   const char* RCV_MAX_QUEUE_OPT = "max-queue-size";
   const char* RCV_SKIP_BLOCK_EVT_OPT = "skip-block-events";
@@ -86,10 +118,29 @@ namespace {
   const char* RCV_START_BLOCK_OPT = "start-block";
   const char* RCV_END_BLOCK_OPT = "end-block";
   const char* RCV_STALE_DEADLINE_OPT = "stale-deadline";
+  const char* RCV_TRX_INDEX_SIZE_OPT = "trx-index-size";
+  const char* RCV_ACCOUNT_INDEX_OPT = "account-index";
+  const char* RCV_TIME_INDEX_EVERY_OPT = "time-index-every";
+  const char* RCV_SORT_INTERACTIVE_OPT = "sort-interactive-ranges";
+  const char* RCV_PREFETCH_OPT = "interactive-prefetch";
+  const char* RCV_LIVE_RING_BLOCKS_OPT = "live-ring-blocks";
+  const char* RCV_LIVE_RING_SIZE_OPT = "live-ring-size";
+  const char* RCV_ABI_CACHE_OPT = "abi-cache-contracts";
+  const char* RCV_ABI_WARMUP_OPT = "abi-warmup-contracts";
+  const char* RCV_ABI_LOG_SIZE_OPT = "abi-log-size";
+  const char* RCV_CHECKPOINT_EVERY_OPT = "checkpoint-every";
+  const char* RCV_EXPORT_STATE_OPT = "export-state";
+  const char* RCV_IMPORT_STATE_OPT = "import-state";
+  const char* RCV_REPL_LISTEN_OPT = "replication-listen";
+  const char* RCV_REPL_MAX_QUEUE_OPT = "replication-max-queue";
+  const char* RCV_REPL_SOURCE_OPT = "replication-source";
+  const char* RCV_RELAY_LISTEN_OPT = "relay-listen";
+  const char* RCV_RELAY_CACHE_OPT = "relay-cache-blocks";
 
   const char* RCV_MODE_SCAN = "scan";
   const char* RCV_MODE_SCAN_NOEXP = "scan-noexport";
   const char* RCV_MODE_INTERACTIVE = "interactive";
+  const char* RCV_MODE_REPLICA = "replica";
 }
 
 
@@ -103,7 +154,8 @@ namespace chronicle {
     state_table,
     received_blocks_table,
     contract_abi_objects_table,
-    contract_abi_history_table
+    contract_abi_history_table,
+    account_activity_table
   };
 
   struct by_id;
@@ -111,6 +163,7 @@ namespace chronicle {
   struct by_name;
   struct by_name_and_block;
   struct by_name_and_block_rev;
+  struct by_name_and_chunk;
 
   // this is a singleton keeping the state of the receiver
 
@@ -207,9 +260,47 @@ namespace chronicle {
       >
     >;
 
-  // shared-memory mutex for accessing chainbase
+  // Blocks where an account was active as action receiver or contract table owner.
+  // Each object keeps one chunk of an activity_bitmap container.
+
+  struct account_activity_object : public chainbase::object<account_activity_table, account_activity_object> {
+    template<typename Constructor, typename Allocator>
+    account_activity_object( Constructor&& c, Allocator&& a ) : blocks(a) { c(*this); }
+    id_type                   id;
+    uint64_t                  account;
+    uint32_t                  chunk;
+    chainbase::shared_string  blocks;
+
+    void set_blocks(const std::string& data) {
+      blocks.resize(data.size());
+      blocks.assign(data.data(), data.size());
+    }
+  };
+
+  using account_activity_index = chainbase::shared_multi_index_container<
+    account_activity_object,
+    indexed_by<
+      ordered_unique<tag<by_id>,
+                     member<account_activity_object, account_activity_object::id_type, &account_activity_object::id>
+                     >,
+      ordered_unique<tag<by_name_and_chunk>,
+                     composite_key<
+                       account_activity_object,
+                       member<account_activity_object, uint64_t, &account_activity_object::account>,
+                       member<account_activity_object, uint32_t, &account_activity_object::chunk>
+                       >
+                     >
+      >
+    >;
+
+  // shared-memory lock for accessing chainbase. The scanner takes it
+  // exclusively, and any number of interactive readers share it. Waiting
+  // writers have priority over new readers.
   struct shmem_lock {
-    bip::interprocess_mutex mutex;
+    bip::interprocess_sharable_mutex mutex;
+    // head of the scanner, published after every saved block, so
+    // that readers do not need the lock to check it
+    uint32_t                         published_head = 0;
   };
 }
 
@@ -217,6 +308,7 @@ CHAINBASE_SET_INDEX_TYPE(chronicle::state_object, chronicle::state_index)
 CHAINBASE_SET_INDEX_TYPE(chronicle::received_block_object, chronicle::received_block_index)
 CHAINBASE_SET_INDEX_TYPE(chronicle::contract_abi_object, chronicle::contract_abi_index)
 CHAINBASE_SET_INDEX_TYPE(chronicle::contract_abi_history, chronicle::contract_abi_hist_index)
+CHAINBASE_SET_INDEX_TYPE(chronicle::account_activity_object, chronicle::account_activity_index)
 
 
 
@@ -225,19 +317,21 @@ CHAINBASE_SET_INDEX_TYPE(chronicle::contract_abi_history, chronicle::contract_ab
 class receiver_plugin_impl : std::enable_shared_from_this<receiver_plugin_impl> {
 public:
   receiver_plugin_impl() :
-    _forks_chan(app().get_channel<chronicle::channels::forks>()),
-    _blocks_chan(app().get_channel<chronicle::channels::blocks>()),
-    _block_table_deltas_chan(app().get_channel<chronicle::channels::block_table_deltas>()),
-    _transaction_traces_chan(app().get_channel<chronicle::channels::transaction_traces>()),
-    _abi_updates_chan(app().get_channel<chronicle::channels::abi_updates>()),
-    _abi_removals_chan(app().get_channel<chronicle::channels::abi_removals>()),
-    _abi_errors_chan(app().get_channel<chronicle::channels::abi_errors>()),
-    _table_row_updates_chan(app().get_channel<chronicle::channels::table_row_updates>()),
-    _permission_updates_chan(app().get_channel<chronicle::channels::permission_updates>()),
-    _permission_link_updates_chan(app().get_channel<chronicle::channels::permission_link_updates>()),
-    _account_metadata_updates_chan(app().get_channel<chronicle::channels::account_metadata_updates>()),
-    _receiver_pauses_chan(app().get_channel<chronicle::channels::receiver_pauses>()),
-    _block_completed_chan(app().get_channel<chronicle::channels::block_completed>()),
+    chain(chronicle::default_chain()),
+    _forks_chan(chain.channel<chronicle::channels::forks>()),
+    _blocks_chan(chain.channel<chronicle::channels::blocks>()),
+    _block_table_deltas_chan(chain.channel<chronicle::channels::block_table_deltas>()),
+    _transaction_traces_chan(chain.channel<chronicle::channels::transaction_traces>()),
+    _abi_updates_chan(chain.channel<chronicle::channels::abi_updates>()),
+    _abi_removals_chan(chain.channel<chronicle::channels::abi_removals>()),
+    _abi_errors_chan(chain.channel<chronicle::channels::abi_errors>()),
+    _table_row_updates_chan(chain.channel<chronicle::channels::table_row_updates>()),
+    _permission_updates_chan(chain.channel<chronicle::channels::permission_updates>()),
+    _permission_link_updates_chan(chain.channel<chronicle::channels::permission_link_updates>()),
+    _account_metadata_updates_chan(chain.channel<chronicle::channels::account_metadata_updates>()),
+    _receiver_pauses_chan(chain.channel<chronicle::channels::receiver_pauses>()),
+    _block_completed_chan(chain.channel<chronicle::channels::block_completed>()),
+    _interactive_statuses_chan(chain.channel<chronicle::channels::interactive_statuses>()),
     pause_timer(std::ref(app().get_io_service())),
     stale_check_timer(std::ref(app().get_io_service()))
   {};
@@ -246,8 +340,20 @@ public:
   bip::mapped_region                    _dblock_mapped_region;
   chronicle::shmem_lock*                dblock;
 
+  // state database lock usage by this process
+  uint64_t                              db_lock_acquired = 0;
+  uint64_t                              db_lock_contended = 0;
+  uint64_t                              db_lock_wait_usec = 0;
+
+  // exclusive for the scanner, shared for interactive readers
+  struct db_lock_guard {
+    receiver_plugin_impl& impl;
+    db_lock_guard(receiver_plugin_impl& i) : impl(i) { impl.lock_db(); }
+    ~db_lock_guard() { impl.unlock_db(); }
+  };
+
   shared_ptr<tcp::resolver>             resolver;
-  shared_ptr<websocket::stream<tcp::socket>> stream;
+  shared_ptr<websocket::stream<chronicle::counted_socket>> stream;
   const int                             stream_priority = 40;
 
   string                                host;
@@ -259,8 +365,80 @@ public:
 
   bool                                  interactive_mode;
   chronicle::channels::interactive_requests::channel_type::handle          _interactive_requests_subscription;
-  std::queue<std::shared_ptr<chronicle::channels::interactive_request>>    interactive_req_queue;
+
+  // block ranges of an interactive request, resolved from its specification
+  struct interactive_job {
+    std::shared_ptr<chronicle::channels::interactive_request>  req;
+    std::vector<std::pair<uint32_t, uint32_t>>                 ranges;
+    size_t                                                     next_range = 0;
+    bool                                                       cancelled = false;
+  };
+
+  // a job whose block range is included in the current request to nodeos
+  struct interactive_participant {
+    std::shared_ptr<interactive_job>    job;
+    uint32_t                            block_num_start;
+    uint32_t                            block_num_end;
+  };
+
+  std::deque<std::shared_ptr<interactive_job>>  interactive_req_queue; // ordered by priority
+  std::vector<interactive_participant>  current_participants;
+  std::shared_ptr<chronicle::channels::interactive_request> current_req; // projection of current participants
   bool                                  interactive_req_pending = false;
+  bool                                  sort_interactive_ranges = false;
+  uint32_t                              last_interactive_end = 0;
+
+  // raw results of blocks fetched ahead of a client that reads history sequentially
+  struct interactive_prefetch {
+    uint32_t                            client_id;
+    bool                                fetch_traces;
+    bool                                fetch_deltas;
+    uint32_t                            next_block; // the block that the client is expected to request next
+    std::map<uint32_t, shared_ptr<flat_buffer>>  results;
+    bool                                in_flight = false;
+    bool                                cancelled = false; // results in flight are dropped
+  };
+
+  uint32_t                              prefetch_blocks = 0;
+  std::shared_ptr<interactive_prefetch> prefetch;
+  bool                                  prefetch_wanted = false;
+  std::map<uint32_t, uint32_t>          client_last_end; // end of last request of each client
+
+  std::unique_ptr<chronicle::trx_index> trx_idx;
+  std::unique_ptr<chronicle::time_index> time_idx;
+  uint32_t                              time_index_every = 0;
+  std::unique_ptr<chronicle::live_ring> live_ring;
+  std::unique_ptr<chronicle::abi_log>   abi_log; // irreversible ABI history, read without locking
+
+  bool                                  account_index;
+
+  // consistent copy of the state at the last committed block, used after a crash
+  uint32_t                              checkpoint_every = 0;
+  string                                checkpoint_file;
+  string                                checkpoint_delta_file;
+  uint32_t                              last_checkpoint = 0;
+  std::unique_ptr<chronicle::checkpoint_writer> checkpoints;
+  // what changed after the last checkpoint: (block, account) of ABI revisions, and (account, chunk) of activity
+  std::set<std::pair<uint32_t, uint64_t>>  checkpoint_abi_changes;
+  std::set<std::pair<uint64_t, uint32_t>>  checkpoint_activity_changes;
+  bool                                  restored_from_checkpoint = false;
+  std::map<uint32_t, checksum256>       recent_block_ids; // blocks above the last committed
+  set<uint64_t>                         block_accounts; // active accounts in current block
+
+  // the scanner sends irreversible state to replicas, and a replica applies it
+  std::unique_ptr<chronicle::replication_server> repl_server;
+  std::unique_ptr<chronicle::replication_client> repl_client;
+  bool                                  replica_mode = false;
+  string                                repl_listen_host;
+  string                                repl_listen_port;
+  string                                repl_source_host;
+  string                                repl_source_port;
+  uint64_t                              repl_applied = 0;
+
+  // the scanner serves the state history protocol to downstream clients
+  std::unique_ptr<chronicle::ship_relay> relay;
+  string                                relay_listen_host;
+  string                                relay_listen_port;
 
   bool                                  noexport_mode;
   bool                                  skip_block_events;
@@ -278,16 +456,72 @@ public:
   uint32_t                              first_bulk      = 0;
   abieos::block_timestamp               block_timestamp;
   uint32_t                              received_blocks = 0;
+  uint64_t                              received_bytes = 0;
+  uint64_t                              read_messages = 0;
+  uint64_t                              read_process_usec = 0;
+  uint64_t                              read_buffers_reused = 0;
+
+  // values at the previous report, for measuring the cost of socket I/O
+  chronicle::process_counters           reported_counters;
+  uint32_t                              reported_blocks = 0;
+  uint64_t                              reported_bytes = 0;
+  uint64_t                              reported_messages = 0;
+  uint64_t                              reported_process_usec = 0;
+  uint64_t                              reported_buffers_reused = 0;
 
   // needed for decoding state history input
   map<string, abi_type>                 abi_types;
 
-  // The context keeps decoded versions of contract ABI
-  abieos_context*                       contract_abi_ctxt = nullptr;
-  set<uint64_t>                         contract_abi_imported;
+  // Every contract ABI is parsed into its own context, so that it can be
+  // replaced without parsing all others again. Each context is valid for a
+  // range of blocks: in interactive mode, it's the range between the ABI
+  // revision (the block of setabi in the history) and the next revision,
+  // and the contexts are reused between requests. If the number of
+  // contexts is limited, the least recently used ones are destroyed.
+  struct contract_abi_entry {
+    chronicle::channels::contract_abi   abi; // events may keep it after eviction
+    uint32_t                            revision;
+    uint32_t                            valid_until; // first block where the ABI may be different
+    size_t                              abi_size;
+    std::list<uint64_t>::iterator       lru_pos;
+  };
+
+  // contract ABI copied from the state database
+  struct contract_abi_lookup {
+    uint64_t                            account;
+    bool                                found;
+    uint32_t                            revision;
+    uint32_t                            valid_until;
+    std::vector<char>                   data;
+  };
+
+  std::map<uint64_t, contract_abi_entry> contract_abi_ctxts;
+  std::list<uint64_t>                   contract_abi_lru; // most recently used first
+  uint32_t                              abi_cache_max = 0;
+  uint64_t                              abi_cache_bytes = 0;
+  uint64_t                              abi_cache_hits = 0;
+  uint64_t                              abi_cache_misses = 0;
+  uint64_t                              abi_cache_evictions = 0;
+
+  // contracts without a usable ABI within a range of blocks, so that
+  // their actions and rows do not cause a database lookup every time
+  std::map<uint64_t, std::pair<uint32_t, uint32_t>> contract_abi_missing;
+  uint64_t                              abi_cache_negative_hits = 0;
+  uint64_t                              abi_log_lookups = 0;
+
+  // results of matching specialized decoders, by hash of the binary ABI
+  std::map<fc::sha256, std::shared_ptr<const chronicle::specialized_decoders::decoder_set>> specialized_by_abi_hash;
+
+  // the most used contracts are saved, and their ABI are parsed in background at next start
+  uint32_t                              abi_warmup_max = 0;
+  string                                abi_usage_file;
+  std::map<uint64_t, uint64_t>          contract_abi_usage;
+  std::unique_ptr<chronicle::worker_group>  abi_warmup_tasks;
+  std::vector<std::pair<contract_abi_lookup, std::shared_ptr<abieos_context>>> abi_warmup_results;
 
   std::map<name,std::set<name>>         blacklist_actions;
 
+  chronicle::chain_instance&                              chain;
   chronicle::channels::forks::channel_type&               _forks_chan;
   chronicle::channels::blocks::channel_type&              _blocks_chan;
   chronicle::channels::block_table_deltas::channel_type&  _block_table_deltas_chan;
@@ -301,6 +535,7 @@ public:
   chronicle::channels::account_metadata_updates::channel_type&  _account_metadata_updates_chan;
   chronicle::channels::receiver_pauses::channel_type&     _receiver_pauses_chan;
   chronicle::channels::block_completed::channel_type&     _block_completed_chan;
+  chronicle::channels::interactive_statuses::channel_type&  _interactive_statuses_chan;
 
   const int channel_priority = 50;
 
@@ -316,49 +551,116 @@ public:
   uint32_t                              stale_check_deadline_msec;
 
 
+  void lock_db() {
+    db_lock_acquired++;
+    if( interactive_mode ? dblock->mutex.try_lock_sharable() : dblock->mutex.try_lock() )
+      return;
+    db_lock_contended++;
+    auto started = std::chrono::steady_clock::now();
+    if( interactive_mode )
+      dblock->mutex.lock_sharable();
+    else
+      dblock->mutex.lock();
+    db_lock_wait_usec += std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::steady_clock::now() - started).count();
+  }
+
+
+  void unlock_db() {
+    if( interactive_mode )
+      dblock->mutex.unlock_sharable();
+    else
+      dblock->mutex.unlock();
+  }
+
+
+  void report_db_lock() {
+    ilog("State DB lock: acquired=${a}, contended=${c}, wait_ms=${w}",
+         ("a", db_lock_acquired)("c", db_lock_contended)("w", db_lock_wait_usec/1000));
+  }
+
+
+  void publish_head() {
+    __atomic_store_n(&dblock->published_head, head, __ATOMIC_RELEASE);
+  }
+
+
+  // returns false if the scanner has not published its head yet
+  bool get_published_head(uint32_t& result) {
+    result = __atomic_load_n(&dblock->published_head, __ATOMIC_ACQUIRE);
+    return result > 0;
+  }
+
+
   void init() {
     if (interactive_mode) {
       _interactive_requests_subscription =
-        app().get_channel<chronicle::channels::interactive_requests>().subscribe
+        chain.channel<chronicle::channels::interactive_requests>().subscribe
         ([this](std::shared_ptr<chronicle::channels::interactive_request> req){ on_block_req(req); });
     }
   }
 
 
   void start() {
+    if (replica_mode) {
+      start_replica();
+      return;
+    }
     if (!interactive_mode)
       load_state();
-    resolver->async_resolve
-      (host, port,
-       [this](const error_code ec, tcp::resolver::results_type results) {
-        if (ec)
-          elog("Error during lookup of ${h}:${p} - ${e}", ("h",host)("p",port)("e", ec.message()));
-
-        callback(ec, "resolve", [&] {
-            asio::async_connect
-              (
-               stream->next_layer(),
-               results.begin(),
-               results.end(),
-               [this](const error_code ec, auto&) {
-                 callback(ec, "connect", [&] {
-                     stream->async_handshake(host, "/", [this](const error_code ec) {
-                         callback(ec, "handshake", [&] {
-                             start_read();
-                           });
-                       });
-                   });
-               });
-          });
-      });
+    if (repl_server) {
+      uint32_t flushed = std::min(head, irreversible);
+      const checksum256& flushed_id = (flushed == head) ? head_id : irreversible_id;
+      repl_server->listen(repl_listen_host, repl_listen_port, flushed, (const char*)flushed_id.value.data());
+    }
+    start_abi_warmup();
+    receive_loop(this)();
   }
 
 
+  // The connection to the state history plugin and the loop reading its
+  // results, as a stackless coroutine. Every yield starts an asynchronous
+  // operation, and its completion resumes the coroutine through the
+  // priority queue.
+  struct receive_loop : asio::coroutine {
+    receiver_plugin_impl*               impl;
+    const char*                         what = "";
+    tcp::resolver::results_type         endpoints;
+    shared_ptr<flat_buffer>             in_buffer;
+
+    explicit receive_loop(receiver_plugin_impl* i) : impl(i) {}
+
+    void operator()(error_code ec, tcp::resolver::results_type results) {
+      if (ec)
+        elog("Error during lookup of ${h}:${p} - ${e}", ("h",impl->host)("p",impl->port)("e", ec.message()));
+      endpoints = results;
+      (*this)(ec);
+    }
+
+    template <typename T>
+    void operator()(error_code ec, const T&) {
+      (*this)(ec);
+    }
+
+    void operator()(error_code ec = {}) {
+      if (ec)
+        return impl->on_fail(ec, what);
+      impl->catch_and_close([&] { step(); });
+    }
+
+    auto resume() {
+      return app().get_priority_queue().wrap(impl->stream_priority, *this);
+    }
+
+    void step();
+  };
+
+
   void load_state() {
     bool did_undo = false;
-    uint32_t depth;
+    uint32_t depth = 0;
     {
-      bip::scoped_lock<bip::interprocess_mutex> lock(dblock->mutex);
+      db_lock_guard lock(*this);
       auto &index = db->get_index<chronicle::state_index>();
       if( index.stack().size() > 0 ) {
         depth = index.stack().size();
@@ -376,6 +678,7 @@ public:
       head_id = itr->head_id;
       irreversible = itr->irreversible;
       irreversible_id = itr->irreversible_id;
+      publish_head();
 
       if( start_block_num > 0 ) {
         string errmsg = string("start-block can only be specified for initial startup. ") +
@@ -385,6 +688,11 @@ public:
       }
     }
     else {
+      if( abi_log && abi_log->last_block() > 0 ) {
+        string errmsg = "ABI history log belongs to a previous state database, it needs to be deleted";
+        elog(errmsg);
+        throw runtime_error(errmsg);
+      }
       if( start_block_num > 0 ) {
         head = start_block_num - 1;
         ilog("Re-scanning the state history from block ${b}", ("b",start_block_num));
@@ -400,7 +708,7 @@ public:
       _forks_chan.publish(channel_priority, fe);
     }
 
-    if( did_undo ) {
+    if( did_undo || restored_from_checkpoint ) {
       ilog("Reverted to block=${b}, issuing an explicit fork event", ("b",head));
       auto fe = std::make_shared<chronicle::channels::fork_event>();
       fe->fork_block_num = head + 1;
@@ -419,6 +727,32 @@ public:
     }
 
     init_contract_abi_ctxt();
+    sync_abi_log();
+  }
+
+
+  // revisions that were saved before the log was enabled, or that were not
+  // irreversible at shutdown, are copied from the state database
+  void sync_abi_log() {
+    if( !abi_log )
+      return;
+    uint32_t last_block = abi_log->last_block();
+    std::vector<chronicle::contract_abi_history::id_type> ids;
+    db_lock_guard lock(*this);
+    // objects are created in the order of blocks
+    const auto& idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_id>();
+    for( auto itr = idx.rbegin(); itr != idx.rend() && itr->block_index > last_block; ++itr )
+      ids.push_back(itr->id);
+    if( ids.empty() )
+      return;
+    ilog("Copying ${n} ABI revisions to the history log", ("n",ids.size()));
+    for( auto id = ids.rbegin(); id != ids.rend(); ++id ) {
+      const auto& o = db->get<chronicle::contract_abi_history>(*id);
+      // previous blocks are written right away, so that the whole history is not kept in memory
+      abi_log->flush(std::min(o.block_index - 1, irreversible));
+      abi_log->add(o.account, o.block_index, o.abi.data(), o.abi.size());
+    }
+    abi_log->flush(irreversible);
   }
 
 
@@ -445,23 +779,44 @@ public:
   }
 
 
-  void start_read() {
-    auto in_buffer = make_shared<flat_buffer>();
-    stream->async_read
-      (*in_buffer,
-       app().get_priority_queue().wrap(stream_priority, [this, in_buffer](const error_code ec, size_t) {
-           callback(ec, "async_read", [&] {
-               receive_abi(in_buffer);
-               receiver_ready = true;
-               if (interactive_mode) {
-                 process_interactive_reqs();
-               } else {
-                 request_blocks();
-               }
-               continue_read();
-             });
-         }));
+  void on_connected(const shared_ptr<flat_buffer>& abi_buffer) {
+    receive_abi(abi_buffer);
+    if (relay && !relay->listening()) {
+      auto data = abi_buffer->data();
+      relay->listen(relay_listen_host, relay_listen_port, string((const char*)data.data(), data.size()));
+    }
+    finish_abi_warmup();
+    receiver_ready = true;
+    if (interactive_mode) {
+      process_interactive_reqs();
+    } else {
+      request_blocks();
+    }
+  }
+
+
+  // the buffer of the previous result is reused, unless an event still refers to it
+  shared_ptr<flat_buffer> next_read_buffer(shared_ptr<flat_buffer> prev) {
+    if (prev && prev.use_count() == 1) {
+      prev->consume(prev->size());
+      read_buffers_reused++;
+      return prev;
+    }
+    return make_shared<flat_buffer>();
+  }
+
+
+  bool process_result(const shared_ptr<flat_buffer>& p) {
+    auto started = std::chrono::steady_clock::now();
+    bool result = receive_result(p);
+    read_messages++;
+    read_process_usec += std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::steady_clock::now() - started).count();
+    return result;
+  }
+
 
+  void start_stale_check() {
     stale_check_last_head = head;
     stale_check_timer.expires_from_now(boost::posix_time::milliseconds(stale_check_deadline_msec));
     stale_check_timer.async_wait
@@ -475,24 +830,8 @@ public:
   }
 
 
-  void continue_read() {
-    if (check_pause()) {
-      pause_time_msec = 0;
-      auto in_buffer = make_shared<flat_buffer>();
-      stream->async_read
-        (*in_buffer,
-         app().get_priority_queue().wrap(stream_priority, [this, in_buffer](const error_code ec, size_t) {
-             callback(ec, "async_read", [&] {
-                 if (!receive_result(in_buffer))
-                   return;
-                 continue_read();
-               });
-           }));
-    }
-  }
-
-
-  // if consumer fails to acknowledge on time, or processing queues get too big, we pacify the receiver
+  // If consumer fails to acknowledge on time, or processing queues get too big, we pacify the receiver.
+  // Returns false if the reader needs to wait for pause_time_msec, or if it has stopped.
   bool check_pause() {
     if (slowdown_requested ||
         (exporter_will_ack && head - exporter_acked_block >= exporter_max_unconfirmed) ||
@@ -521,14 +860,6 @@ public:
         _receiver_pauses_chan.publish(channel_priority, rp);
         ilog("Pausing the reader");
       }
-
-      pause_timer.expires_from_now(boost::posix_time::milliseconds(pause_time_msec));
-      pause_timer.async_wait
-        (app().get_priority_queue().wrap(stream_priority, [this](const error_code ec) {
-            callback(ec, "async_wait", [&] {
-                continue_read();
-              });
-          }));
       return false;
     }
     return true;
@@ -572,7 +903,7 @@ public:
   void request_blocks() {
     jarray positions;
     {
-      bip::scoped_lock<bip::interprocess_mutex> lock(dblock->mutex);
+      db_lock_guard lock(*this);
       const auto& idx = db->get_index<chronicle::received_block_index, chronicle::by_blocknum>();
       auto itr = idx.lower_bound(irreversible);
       while( itr != idx.end() && itr->block_index <= head ) {
@@ -587,8 +918,8 @@ public:
     uint32_t start_block = head + 1;
     ilog("Start block: ${b}", ("b",start_block));
 
-    bool fetch_block = noexport_mode ? false:true;
-    bool fetch_traces = (skip_traces || noexport_mode) ? false:true;
+    bool fetch_block = (time_idx || live_ring || relay || !noexport_mode) ? true:false;
+    bool fetch_traces = (trx_idx || account_index || live_ring || relay || !(skip_traces || noexport_mode)) ? true:false;
     bool fetch_deltas = true;
     send_request(jvalue{jarray{{"get_blocks_request_v0"s},
             {jobject{
@@ -605,43 +936,438 @@ public:
   }
 
 
+  // the head is taken from the state database only if the scanner has not published it
+  bool get_scanner_head(uint32_t& result) {
+    if( get_published_head(result) )
+      return true;
+    db_lock_guard lock(*this);
+    const auto& idx = db->get_index<chronicle::state_index, chronicle::by_id>();
+    auto itr = idx.begin();
+    if( itr == idx.end() )
+      return false;
+    result = itr->head;
+    return true;
+  }
+
+
   void on_block_req(std::shared_ptr<chronicle::channels::interactive_request> req) {
-    {
-      bip::scoped_lock<bip::interprocess_mutex> lock(dblock->mutex);
-      const auto& idx = db->get_index<chronicle::state_index, chronicle::by_id>();
-      auto itr = idx.begin();
-      if( itr == idx.end() ) {
-        elog("Receiver did not process any blocks yet");
+    if( req->cancel ) {
+      cancel_interactive_req(*req);
+      return;
+    }
+
+    auto job = std::make_shared<interactive_job>();
+    job->req = req;
+    string error;
+    for( auto& range : req->ranges ) {
+      if( !resolve_interactive_range(range, job->ranges, error) ) {
+        elog(error);
+        publish_interactive_status(*req, chronicle::channels::interactive_status_val::failed, error);
         return;
       }
-      if( req->block_num_start > itr->head ) {
-        elog("Requested start block ${b} is higher than current head ${h}",
-             ("b",req->block_num_start)("h", itr->head));
-        return;
+    }
+
+    uint32_t scanner_head;
+    if( !get_scanner_head(scanner_head) ) {
+      error = "Receiver did not process any blocks yet";
+    }
+    else {
+      for( auto& r : job->ranges ) {
+        if( r.first > scanner_head ) {
+          error = "Requested start block " + to_string(r.first) +
+            " is higher than current head " + to_string(scanner_head);
+          break;
+        }
+        if( r.second > scanner_head ) {
+          error = "Requested end block " + to_string(r.second) +
+            " is higher than current head " + to_string(scanner_head);
+          break;
+        }
+      }
+    }
+
+    if( !error.empty() ) {
+      elog(error);
+      publish_interactive_status(*req, chronicle::channels::interactive_status_val::failed, error);
+      return;
+    }
+
+    if( job->ranges.empty() ) {
+      publish_interactive_status(*req, chronicle::channels::interactive_status_val::finished, "");
+      return;
+    }
+
+    if( prefetch_blocks > 0 )
+      detect_sequential_access(*job);
+
+    // the job goes after all jobs of the same or higher priority
+    auto pos = std::find_if(interactive_req_queue.begin(), interactive_req_queue.end(),
+                            [&](auto& j) { return j->req->priority < req->priority; });
+    interactive_req_queue.insert(pos, job);
+    process_interactive_reqs();
+  }
+
+
+  // a client requesting a range that starts where its previous request ended is
+  // likely to continue, so the following blocks are fetched in advance
+  void detect_sequential_access(const interactive_job& job) {
+    const auto& req = *job.req;
+    if( job.ranges.size() != 1 ) {
+      client_last_end.erase(req.client_id);
+      return;
+    }
+    const auto& range = job.ranges[0];
+    auto itr = client_last_end.find(req.client_id);
+    bool sequential = (itr != client_last_end.end() && itr->second == range.first);
+    client_last_end[req.client_id] = range.second;
+
+    bool fetch_traces = (skip_traces || !req.fetch_traces) ? false:true;
+    bool fetch_deltas = (skip_table_deltas || !req.fetch_deltas) ? false:true;
+    bool same_client = (prefetch && prefetch->client_id == req.client_id &&
+                        prefetch->fetch_traces == fetch_traces && prefetch->fetch_deltas == fetch_deltas);
+
+    if( !sequential ) {
+      if( same_client ) {
+        dlog("Client ${c} stopped sequential access, dropping prefetched blocks", ("c",req.client_id));
+        drop_prefetch();
       }
-      if( req->block_num_end > itr->head ) {
-        elog("Requested end block ${b} is higher than current head ${h}",
-             ("b",req->block_num_end)("h", itr->head));
+      return;
+    }
+
+    if( prefetch && !same_client ) {
+      // only one client is served by prefetch at a time, the most recent one wins
+      if( prefetch->in_flight ) {
+        prefetch->cancelled = true;
         return;
       }
+      prefetch.reset();
     }
-    interactive_req_queue.push(req);
-    process_interactive_reqs();
+
+    if( !prefetch ) {
+      prefetch = std::make_shared<interactive_prefetch>();
+      prefetch->client_id = req.client_id;
+      prefetch->fetch_traces = fetch_traces;
+      prefetch->fetch_deltas = fetch_deltas;
+    }
+    else if( prefetch->cancelled ) {
+      return; // wait until the cancelled blocks are delivered
+    }
+    prefetch->next_block = range.second;
+    prefetch_wanted = true;
+  }
+
+
+  void drop_prefetch() {
+    if( prefetch->in_flight ) {
+      // nodeos will still deliver the blocks in flight
+      prefetch->cancelled = true;
+    }
+    else {
+      prefetch.reset();
+    }
+    prefetch_wanted = false;
+  }
+
+
+  // fetches the blocks following the expected next request, up to the prefetch window
+  void start_prefetch() {
+    prefetch_wanted = false;
+    auto& pf = *prefetch;
+
+    // blocks below the expected request are already consumed
+    pf.results.erase(pf.results.begin(), pf.results.lower_bound(pf.next_block));
+    uint32_t block_num_start = pf.next_block;
+    if( !pf.results.empty() )
+      block_num_start = pf.results.rbegin()->first + 1;
+    uint32_t block_num_end = pf.next_block + prefetch_blocks;
+    uint32_t scanner_head;
+    if( !get_scanner_head(scanner_head) )
+      return;
+    block_num_end = std::min(block_num_end, scanner_head);
+    if( block_num_start >= block_num_end )
+      return;
+
+    string block_req_str = to_string(block_num_start);
+    string end_block_str = to_string(block_num_end);
+    dlog("Prefetching blocks ${s} to ${e} for client ${c}",
+         ("s", block_req_str)("e",end_block_str)("c",pf.client_id));
+    end_block_num = block_num_end;
+    pf.in_flight = true;
+    interactive_req_pending = true;
+    send_request(jvalue{jarray{{"get_blocks_request_v0"s},
+            {jobject{
+                {{"start_block_num"s}, {block_req_str}},
+                  {{"end_block_num"s}, {end_block_str}},
+                    {{"max_messages_in_flight"s}, {max_uint32_str}},
+                      {{"have_positions"s}, {jarray()}},
+                        {{"irreversible_only"s}, {false}},
+                          {{"fetch_block"s}, {true}},
+                            {{"fetch_traces"s}, {pf.fetch_traces}},
+                              {{"fetch_deltas"s}, {pf.fetch_deltas}},
+                                }}}},
+      [&]() {} );
+  }
+
+
+  void receive_prefetch(uint32_t block_num, const shared_ptr<flat_buffer>& p) {
+    if( !prefetch->cancelled )
+      prefetch->results[block_num] = p;
+    if( block_num == end_block_num - 1 ) {
+      prefetch->in_flight = false;
+      if( prefetch->cancelled )
+        prefetch.reset();
+      interactive_req_pending = false;
+      process_interactive_reqs();
+    }
+  }
+
+
+  // the whole range must be available in prefetched results with the same projection
+  bool is_prefetched(uint32_t block_num_start, uint32_t block_num_end) {
+    if( !prefetch || prefetch->in_flight )
+      return false;
+    bool fetch_traces = (skip_traces || !current_req->fetch_traces) ? false:true;
+    bool fetch_deltas = (skip_table_deltas || !current_req->fetch_deltas) ? false:true;
+    if( prefetch->fetch_traces != fetch_traces || prefetch->fetch_deltas != fetch_deltas )
+      return false;
+    // prefetched results are always contiguous
+    return prefetch->results.count(block_num_start) > 0 && prefetch->results.count(block_num_end - 1) > 0;
+  }
+
+
+  void serve_from_prefetch(uint32_t block_num_start, uint32_t block_num_end) {
+    dlog("Serving blocks ${s} to ${e} from prefetched data", ("s",block_num_start)("e",block_num_end));
+    std::vector<shared_ptr<flat_buffer>> results;
+    auto itr = prefetch->results.find(block_num_start);
+    while( itr != prefetch->results.end() && itr->first < block_num_end ) {
+      results.push_back(itr->second);
+      itr = prefetch->results.erase(itr);
+    }
+    replay_results(std::move(results), block_num_end);
+  }
+
+
+  // takes the range from the scanner's ring if all of its blocks are there
+  bool serve_from_live_ring(uint32_t block_num_start, uint32_t block_num_end) {
+    if( !live_ring || !live_ring->covers(block_num_start, block_num_end) )
+      return false;
+    std::vector<shared_ptr<flat_buffer>> results;
+    string data;
+    for( uint32_t block_num = block_num_start; block_num < block_num_end; block_num++ ) {
+      if( !live_ring->get(block_num, data) )
+        return false;
+      auto p = make_shared<flat_buffer>();
+      p->commit(boost::asio::buffer_copy(p->prepare(data.size()), boost::asio::buffer(data)));
+      results.push_back(p);
+    }
+    dlog("Serving blocks ${s} to ${e} from the live ring", ("s",block_num_start)("e",block_num_end));
+    replay_results(std::move(results), block_num_end);
+    return true;
+  }
+
+
+  void replay_results(std::vector<shared_ptr<flat_buffer>>&& results, uint32_t block_num_end) {
+    end_block_num = block_num_end;
+    interactive_req_pending = true;
+    // the results are processed as if they arrived from nodeos, outside of the current call chain
+    boost::asio::post(app().get_io_service(),
+                      app().get_priority_queue().wrap(stream_priority, [this, results]() {
+                          for( auto& p : results ) {
+                            if( !receive_result(p) )
+                              return;
+                          }
+                        }));
+  }
+
+
+  // converts a range specification into block ranges
+  bool resolve_interactive_range(const chronicle::channels::interactive_range& range,
+                                 std::vector<std::pair<uint32_t, uint32_t>>& result, string& error) {
+    uint32_t block_num_start = range.block_num_start;
+    uint32_t block_num_end = range.block_num_end;
+
+    if( range.time_start ) {
+      string time_str = "slots " + to_string(range.time_start->slot) + "-" + to_string(range.time_end->slot);
+      if( !time_idx || time_idx->entries() == 0 ) {
+        error = "Cannot look up time range " + time_str + ": timestamp index is not available";
+        return false;
+      }
+      block_num_start = time_idx->block_at(range.time_start->slot);
+      block_num_end = time_idx->block_at(range.time_end->slot);
+      if( block_num_end <= block_num_start ) {
+        error = "No blocks found in time range " + time_str;
+        return false;
+      }
+      dlog("Time range ${t} corresponds to blocks ${s} to ${e}",
+           ("t",time_str)("s",block_num_start)("e",block_num_end));
+    }
+
+    if( range.trx_id ) {
+      string trx_id_str = (string)(*range.trx_id);
+      if( !trx_idx ) {
+        error = "Cannot look up transaction " + trx_id_str + ": transaction index is not available";
+        return false;
+      }
+      auto blocks = trx_idx->lookup(range.trx_id->value.data());
+      if( blocks.empty() ) {
+        error = "Transaction " + trx_id_str + " is not found in transaction index";
+        return false;
+      }
+      for( uint32_t block_num : blocks ) {
+        dlog("Transaction ${t} is in block ${b}", ("t",trx_id_str)("b",block_num));
+        result.emplace_back(block_num, block_num + 1);
+      }
+    }
+    else if( range.account ) {
+      std::vector<uint32_t> blocks;
+      {
+        db_lock_guard lock(*this);
+        const auto& idx = db->get_index<chronicle::account_activity_index, chronicle::by_name_and_chunk>();
+        uint32_t last_chunk = chronicle::activity_bitmap::chunk_of(block_num_end - 1);
+        auto itr = idx.lower_bound(boost::make_tuple(range.account->value,
+                                                     chronicle::activity_bitmap::chunk_of(block_num_start)));
+        while( itr != idx.end() && itr->account == range.account->value && itr->chunk <= last_chunk ) {
+          chronicle::activity_bitmap::get_blocks(itr->blocks, itr->chunk, block_num_start,
+                                                 block_num_end, blocks);
+          itr++;
+        }
+      }
+      dlog("Account ${a} was active in ${n} blocks between ${s} and ${e}",
+           ("a",(std::string)(*range.account))("n",blocks.size())
+           ("s",block_num_start)("e",block_num_end));
+      // contiguous blocks are requested as ranges
+      size_t first = result.size();
+      for( uint32_t block_num : blocks ) {
+        if( result.size() > first && result.back().second == block_num ) {
+          result.back().second++;
+        }
+        else {
+          result.emplace_back(block_num, block_num + 1);
+        }
+      }
+    }
+    else {
+      result.emplace_back(block_num_start, block_num_end);
+    }
+    return true;
+  }
+
+
+  // cancels a request of the client, or all its requests if req_id is zero
+  void cancel_interactive_req(const chronicle::channels::interactive_request& cancel) {
+    auto matches = [&](const std::shared_ptr<interactive_job>& job) {
+      return job->req->client_id == cancel.client_id && (cancel.req_id == 0 || job->req->req_id == cancel.req_id);
+    };
+
+    std::vector<std::shared_ptr<interactive_job>> cancelled;
+    auto itr = interactive_req_queue.begin();
+    while( itr != interactive_req_queue.end() ) {
+      if( matches(*itr) ) {
+        cancelled.push_back(*itr);
+        itr = interactive_req_queue.erase(itr);
+      }
+      else {
+        itr++;
+      }
+    }
+    // the current range is still delivered by nodeos, but its output is dropped
+    for( auto& part : current_participants ) {
+      if( matches(part.job) && !part.job->cancelled ) {
+        part.job->cancelled = true;
+        cancelled.push_back(part.job);
+      }
+    }
+
+    if( cancel.req_id == 0 ) {
+      client_last_end.erase(cancel.client_id);
+      if( prefetch && prefetch->client_id == cancel.client_id )
+        drop_prefetch();
+    }
+
+    if( cancelled.empty() && cancel.req_id != 0 ) {
+      wlog("Cannot cancel interactive request ${r}: not found", ("r",cancel.req_id));
+    }
+    for( auto& job : cancelled ) {
+      ilog("Cancelled interactive request ${r} of client ${c}", ("r",job->req->req_id)("c",job->req->client_id));
+      publish_interactive_status(*job->req, chronicle::channels::interactive_status_val::cancelled, "");
+    }
+  }
+
+
+  // output of requests from identified clients or with an ID can be routed to their requesters
+  static bool is_routable(const chronicle::channels::interactive_request& req) {
+    return req.req_id != 0 || req.client_id != 0;
+  }
+
+
+  void publish_interactive_status(const chronicle::channels::interactive_request& req,
+                                  chronicle::channels::interactive_status_val status, const string& error) {
+    if( !is_routable(req) )
+      return;
+    auto st = std::make_shared<chronicle::channels::interactive_status>();
+    st->client_id = req.client_id;
+    st->req_id = req.req_id;
+    st->status = status;
+    st->error = error;
+    _interactive_statuses_chan.publish(channel_priority, st);
   }
 
 
   void process_interactive_reqs() {
-    if (receiver_ready && !interactive_req_pending && interactive_req_queue.size() > 0 ) {
-      auto req = interactive_req_queue.front();
-      interactive_req_queue.pop();
-      string block_req_str = to_string(req->block_num_start);
-      string end_block_str = to_string(req->block_num_end);
-      end_block_num = req->block_num_end;
+    if (receiver_ready && !interactive_req_pending && interactive_req_queue.empty() && prefetch_wanted) {
+      start_prefetch();
+    }
+    else if (receiver_ready && !interactive_req_pending && interactive_req_queue.size() > 0 ) {
+      auto first = next_interactive_job();
+      current_req = first->req;
+      auto& first_range = first->ranges[first->next_range];
+      uint32_t block_num_start = first_range.first;
+      uint32_t block_num_end = first_range.second;
+      current_participants.clear();
+      current_participants.push_back(interactive_participant{first, block_num_start, block_num_end});
+
+      // overlapping and adjacent ranges of other routable requests with the same projection are
+      // served by the same request to nodeos
+      if( is_routable(*first->req) ) {
+        bool extended = true;
+        while( extended ) {
+          extended = false;
+          auto itr = interactive_req_queue.begin();
+          while( itr != interactive_req_queue.end() ) {
+            auto& job = *itr;
+            auto& range = job->ranges[job->next_range];
+            if( is_routable(*job->req) && same_projection(*job->req, *first->req) &&
+                range.first <= block_num_end && range.second >= block_num_start ) {
+              current_participants.push_back(interactive_participant{job, range.first, range.second});
+              block_num_start = std::min(block_num_start, range.first);
+              block_num_end = std::max(block_num_end, range.second);
+              itr = interactive_req_queue.erase(itr);
+              extended = true;
+            }
+            else {
+              itr++;
+            }
+          }
+        }
+      }
+
+      last_interactive_end = block_num_end;
       init_contract_abi_ctxt();
-      dlog("Requesting blocks ${s} to ${e}", ("s", block_req_str)("e",end_block_str));
-      bool fetch_block = true;
-      bool fetch_traces = skip_traces ? false:true;
-      bool fetch_deltas = skip_table_deltas ? false:true;
+      if( is_prefetched(block_num_start, block_num_end) ) {
+        serve_from_prefetch(block_num_start, block_num_end);
+        return;
+      }
+      if( serve_from_live_ring(block_num_start, block_num_end) )
+        return;
+
+      string block_req_str = to_string(block_num_start);
+      string end_block_str = to_string(block_num_end);
+      end_block_num = block_num_end;
+      dlog("Requesting blocks ${s} to ${e} for ${n} requests",
+           ("s", block_req_str)("e",end_block_str)("n",current_participants.size()));
+      bool fetch_block = true; // block timestamp is needed for traces and deltas
+      bool fetch_traces = (skip_traces || !current_req->fetch_traces) ? false:true;
+      bool fetch_deltas = (skip_table_deltas || !current_req->fetch_deltas) ? false:true;
       interactive_req_pending = true;
       send_request(jvalue{jarray{{"get_blocks_request_v0"s},
               {jobject{
@@ -659,8 +1385,92 @@ public:
   }
 
 
+  // takes the next job from the queue. Optionally, among the jobs of the highest priority, the one
+  // that continues sequentially from the last served block is preferred.
+  std::shared_ptr<interactive_job> next_interactive_job() {
+    auto selected = interactive_req_queue.begin();
+    if( sort_interactive_ranges ) {
+      uint32_t priority = (*selected)->req->priority;
+      auto lowest = selected;
+      selected = interactive_req_queue.end();
+      for( auto itr = interactive_req_queue.begin();
+           itr != interactive_req_queue.end() && (*itr)->req->priority == priority; itr++ ) {
+        uint32_t start = (*itr)->ranges[(*itr)->next_range].first;
+        if( start < (*lowest)->ranges[(*lowest)->next_range].first )
+          lowest = itr;
+        if( start >= last_interactive_end &&
+            (selected == interactive_req_queue.end() ||
+             start < (*selected)->ranges[(*selected)->next_range].first) )
+          selected = itr;
+      }
+      if( selected == interactive_req_queue.end() )
+        selected = lowest;
+    }
+    auto job = *selected;
+    interactive_req_queue.erase(selected);
+    return job;
+  }
+
+
+  static bool same_projection(const chronicle::channels::interactive_request& a,
+                              const chronicle::channels::interactive_request& b) {
+    return a.fetch_block == b.fetch_block && a.fetch_traces == b.fetch_traces &&
+      a.fetch_deltas == b.fetch_deltas && a.accounts == b.accounts;
+  }
+
+
+  // returns false if none of the requesters needs the block
+  bool interactive_block_start(uint32_t block_num) {
+    bool needed = false;
+    for( auto& part : current_participants ) {
+      if( !part.job->cancelled && block_num >= part.block_num_start && block_num < part.block_num_end ) {
+        needed = true;
+        if( block_num == part.block_num_start )
+          publish_interactive_status(*part.job->req, chronicle::channels::interactive_status_val::started, "");
+      }
+    }
+    return needed;
+  }
+
+
+  void interactive_block_end(uint32_t block_num) {
+    for( auto& part : current_participants ) {
+      if( block_num == part.block_num_end - 1 ) {
+        auto& job = part.job;
+        job->next_range++;
+        if( job->cancelled )
+          continue;
+        if( job->next_range < job->ranges.size() ) {
+          publish_interactive_status(*job->req, chronicle::channels::interactive_status_val::suspended, "");
+          // remaining ranges go before other jobs of the same priority
+          auto pos = std::find_if(interactive_req_queue.begin(), interactive_req_queue.end(),
+                                  [&](auto& j) { return j->req->priority <= job->req->priority; });
+          interactive_req_queue.insert(pos, job);
+        }
+        else {
+          publish_interactive_status(*job->req, chronicle::channels::interactive_status_val::finished, "");
+        }
+      }
+    }
+
+    if( block_num == end_block_num - 1 ) {
+      interactive_req_pending = false;
+      current_participants.clear();
+      process_interactive_reqs();
+    }
+  }
+
+
+  // in interactive mode, the request may restrict the output to specific accounts
+  bool is_exported_account(name account) {
+    return !interactive_mode || !current_req || current_req->accounts.empty() ||
+      current_req->accounts.count(account.value) > 0;
+  }
+
+
   bool receive_result(const shared_ptr<flat_buffer> p) {
     auto         data = p->data();
+    received_bytes += data.size();
     input_buffer bin{(const char*)data.data(), (const char*)data.data() + data.size()};
     check_variant(bin, get_type("result"), "get_blocks_result_v0");
 
@@ -680,13 +1490,17 @@ public:
     checksum256 block_id = result.this_block->block_id;
 
     if (interactive_mode) {
-      if( block_num == end_block_num-1 ) {
-        interactive_req_pending = false;
-        process_interactive_reqs();
+      if( prefetch && prefetch->in_flight ) {
+        receive_prefetch(block_num, p);
+        return true;
+      }
+      if( !interactive_block_start(block_num) ) {
+        interactive_block_end(block_num);
+        return true;
       }
     }
     else {
-      bip::scoped_lock<bip::interprocess_mutex> lock(dblock->mutex);
+      db_lock_guard lock(*this);
       if( db->revision() < block_num-1 ) {
         uint32_t newrev = block_num-1;
         dlog("Current DB revision: ${r}. Setting to ${n}", ("r",db->revision())("n",newrev));
@@ -718,6 +1532,18 @@ public:
           if( exporter_will_ack && exporter_acked_block > block_num - 1 )
             exporter_acked_block = block_num - 1;
 
+          if( trx_idx )
+            trx_idx->rollback(block_num);
+          if( time_idx )
+            time_idx->rollback(block_num);
+          if( live_ring )
+            live_ring->rollback(block_num);
+          if( abi_log )
+            abi_log->rollback(block_num);
+          if( repl_server )
+            repl_server->rollback(block_num);
+          recent_block_ids.erase(recent_block_ids.lower_bound(block_num), recent_block_ids.end());
+
           auto fe = std::make_shared<chronicle::channels::fork_event>();
           fe->fork_block_num = block_num;
           fe->depth = depth;
@@ -737,12 +1563,36 @@ public:
     irreversible    = last_irreversible_num;
     irreversible_id = result.last_irreversible.block_id;
 
-    if (result.block)
+    if (!interactive_mode && checkpoint_every > 0)
+      recent_block_ids[block_num] = block_id;
+
+    if (result.block) {
       receive_block(*result.block, p);
+      if (!interactive_mode && time_idx && block_num % time_index_every == 0)
+        time_idx->add(block_num, block_timestamp.slot);
+    }
+
+    if (!interactive_mode && live_ring) {
+      auto data = p->data();
+      live_ring->add(block_num, (const char*)data.data(), data.size());
+    }
+
+    if (!interactive_mode && relay) {
+      auto data = p->data();
+      relay->add(block_num, (const char*)block_id.value.data(), (const char*)data.data(), data.size(),
+                 result.head.block_num, (const char*)result.head.block_id.value.data(),
+                 irreversible, (const char*)irreversible_id.value.data());
+    }
+
+    // results from the live ring or prefetch may carry more than the request needs
+    block_accounts.clear();
+    std::vector<std::shared_ptr<chronicle::channels::transaction_trace>> traces;
+    if (result.traces && (!interactive_mode || current_req->fetch_traces))
+      traces = receive_traces(*result.traces, p);
 
     // state changing activities
     if (!interactive_mode) {
-        bip::scoped_lock<bip::interprocess_mutex> lock(dblock->mutex);
+        db_lock_guard lock(*this);
         auto undo_session = db->start_undo_session(true);
 
         if (block_num > irreversible) {
@@ -763,17 +1613,48 @@ public:
         if (result.deltas)
           receive_deltas(*result.deltas, p);
 
+        if (account_index)
+          save_account_activity();
+
         save_state();
         undo_session.push();     // save a new revision
         commit_db();
+        publish_head();
+        if (checkpoints)
+          checkpoint_if_due();
     }
     else {
-      if (result.deltas)
+      if (result.deltas && current_req->fetch_deltas)
         receive_deltas(*result.deltas, p);
     }
+    if (!traces.empty()) {
+      std::set<uint64_t> contracts;
+      for (auto& tr : traces) {
+        for (auto& atrace : std::get<state_history::transaction_trace_v0>(tr->trace).action_traces)
+          contracts.insert(std::get<state_history::action_trace_v0>(atrace).act.account.value);
+      }
+      auto abis = resolve_block_abis(contracts, true);
+      for (auto& tr : traces) {
+        tr->abis = abis;
+        _transaction_traces_chan.publish(channel_priority, tr);
+      }
+    }
 
-    if (result.traces)
-      receive_traces(*result.traces, p);
+    if (!interactive_mode && trx_idx)
+      trx_idx->flush(irreversible);
+    if (!interactive_mode && time_idx)
+      time_idx->flush(irreversible);
+    if (!interactive_mode && live_ring)
+      live_ring->flush(irreversible);
+    if (!interactive_mode && abi_log)
+      abi_log->flush(irreversible);
+    if (!interactive_mode && repl_server) {
+      // replicas only get the blocks that are already in the state database
+      if (head <= irreversible)
+        repl_server->flush(head, (const char*)head_id.value.data());
+      else
+        repl_server->flush(irreversible, (const char*)irreversible_id.value.data());
+    }
 
     auto bf = std::make_shared<chronicle::channels::block_finished>();
     bf->block_num = head;
@@ -782,12 +1663,19 @@ public:
     bf->block_timestamp = block_timestamp;
     _block_completed_chan.publish(channel_priority, bf);
 
+    if (interactive_mode)
+      interactive_block_end(block_num);
+
     if( aborting )
       return false;
 
     if (interactive_mode) {
       if (report_every > 0 && head % report_every == 0) {
         ilog("block=${h}; irreversible=${i}", ("h",head)("i",irreversible));
+        report_db_lock();
+        report_abi_cache();
+        report_transport();
+        save_abi_usage();
         ilog("appbase priority queue size: ${q}", ("q", app().get_priority_queue().size()));
       }
     }
@@ -803,6 +1691,24 @@ public:
         if( exporter_will_ack )
           ilog("Exporter acknowledged block=${b}, unacknowledged=${u}",
                ("b", exporter_acked_block)("u", head-exporter_acked_block));
+        if( trx_idx )
+          ilog("Transaction index entries: ${e}, capacity: ${c}",
+               ("e", trx_idx->entries())("c", trx_idx->capacity()));
+        if( abi_log )
+          ilog("ABI history log revisions: ${e}, used: ${u} of ${c} MB",
+               ("e", abi_log->entries())("u", abi_log->data_used()/(1024*1024))
+               ("c", abi_log->data_capacity()/(1024*1024)));
+        if( repl_server )
+          ilog("Replicas connected: ${n}, sent: ${s} MB, dropped: ${d}",
+               ("n", repl_server->replicas())("s", repl_server->bytes_sent()/(1024*1024))
+               ("d", repl_server->replicas_dropped()));
+        if( relay )
+          ilog("State history relay clients: ${n}, sent: ${s} MB, blocks from live ring: ${f}",
+               ("n", relay->clients())("s", relay->bytes_sent()/(1024*1024))("f", relay->fetched_blocks()));
+        report_db_lock();
+        report_abi_cache();
+        report_transport();
+        save_abi_usage();
         ilog("appbase priority queue size: ${q}", ("q", app().get_priority_queue().size()));
       }
     }
@@ -811,13 +1717,430 @@ public:
   }
 
 
-  void commit_db() {
+  // socket operations of the state history connection and the exporter, and CPU time of the whole process
+  void report_transport() {
+    auto counters = chronicle::read_process_counters();
+    uint32_t blocks = received_blocks - reported_blocks;
+    uint64_t bytes = received_bytes - reported_bytes;
+    if( blocks > 0 && bytes > 0 ) {
+      char per_block[64];
+      snprintf(per_block, sizeof(per_block), "%.1f/%.1f",
+               double(counters.socket_reads - reported_counters.socket_reads) / blocks,
+               double(counters.socket_writes - reported_counters.socket_writes) / blocks);
+      ilog("Transport: backend=${b}, received_MB=${m}, socket_reads/writes_per_block=${s}, cpu_ms_per_GB=${c}",
+           ("b", chronicle::socket_backend())("m", bytes/(1024*1024))("s", string(per_block))
+           ("c", (counters.cpu_usec - reported_counters.cpu_usec) * 1024 / (bytes / (1024*1024) + 1) / 1000));
+    }
+    uint64_t messages = read_messages - reported_messages;
+    if( messages > 0 ) {
+      ilog("Read loop: messages=${n}, process_usec_per_msg=${p}, buffers_reused=${r}%",
+           ("n", messages)("p", (read_process_usec - reported_process_usec) / messages)
+           ("r", (read_buffers_reused - reported_buffers_reused) * 100 / messages));
+    }
+    reported_counters = counters;
+    reported_blocks = received_blocks;
+    reported_bytes = received_bytes;
+    reported_messages = read_messages;
+    reported_process_usec = read_process_usec;
+    reported_buffers_reused = read_buffers_reused;
+  }
+
+
+  void report_abi_cache() {
+    uint64_t lookups = abi_cache_hits + abi_cache_misses;
+    ilog("ABI cache: contracts=${c}, abi_bytes=${b}, hit_rate=${r}%, misses=${m}, evictions=${e}, "
+         "without_abi=${n}, negative_hits=${h}, from_log=${l}",
+         ("c", contract_abi_ctxts.size())("b", abi_cache_bytes)
+         ("r", lookups > 0 ? abi_cache_hits*100/lookups : 0)("m", abi_cache_misses)("e", abi_cache_evictions)
+         ("n", contract_abi_missing.size())("h", abi_cache_negative_hits)("l", abi_log_lookups));
+  }
+
+
+  uint32_t committed_block() {
     // if exporter is acknowledging, we only commit what is confirmed
     auto commit_rev = irreversible;
     if( exporter_will_ack && exporter_acked_block < commit_rev ) {
       commit_rev = exporter_acked_block;
     }
-    db->commit(commit_rev);
+    return commit_rev;
+  }
+
+
+  void commit_db() {
+    db->commit(committed_block());
+  }
+
+
+  // the state database must be locked by the caller. Only the changes since
+  // the previous checkpoint are copied, unless there is no full one yet.
+  void checkpoint_if_due() {
+    uint32_t block_num = committed_block();
+    recent_block_ids.erase(recent_block_ids.begin(), recent_block_ids.lower_bound(block_num));
+    if( block_num < last_checkpoint + checkpoint_every )
+      return;
+    // the ID is unknown until the committed block is one of the blocks received after start
+    auto itr = recent_block_ids.find(block_num);
+    if( itr == recent_block_ids.end() )
+      return;
+    std::unique_ptr<chronicle::receiver_state> state;
+    if( last_checkpoint == 0 || checkpoints->needs_full() )
+      state = collect_receiver_state(block_num, itr->second);
+    else
+      state = collect_receiver_changes(last_checkpoint, block_num, itr->second);
+    forget_checkpoint_changes(block_num);
+    last_checkpoint = block_num;
+    checkpoints->save(std::move(state));
+  }
+
+
+  void add_checkpoint_abi_change(uint64_t account, uint32_t block_num) {
+    if( checkpoints )
+      checkpoint_abi_changes.emplace(block_num, account);
+  }
+
+
+  void add_checkpoint_activity_change(uint64_t account, uint32_t chunk) {
+    if( checkpoints )
+      checkpoint_activity_changes.emplace(account, chunk);
+  }
+
+
+  // the chunk of the checkpoint block may still receive newer blocks, so it stays in the changes
+  void forget_checkpoint_changes(uint32_t block_num) {
+    checkpoint_abi_changes.erase(checkpoint_abi_changes.begin(),
+                                 checkpoint_abi_changes.upper_bound(std::make_pair(block_num, std::numeric_limits<uint64_t>::max())));
+    uint32_t last_chunk = chronicle::activity_bitmap::chunk_of(block_num);
+    for( auto itr = checkpoint_activity_changes.begin(); itr != checkpoint_activity_changes.end(); ) {
+      if( itr->second < last_chunk )
+        itr = checkpoint_activity_changes.erase(itr);
+      else
+        ++itr;
+    }
+  }
+
+
+  // Continues from the checkpoint files found at startup. Changes after the
+  // last checkpoint are not known after a restart, so they are looked up in
+  // the state database once, without copying the data.
+  void start_checkpoints() {
+    checkpoints = std::make_unique<chronicle::checkpoint_writer>(chronicle::shared_workers(), checkpoint_file,
+                                                                 checkpoint_delta_file, abi_is_valid);
+    last_checkpoint = checkpoints->last_block();
+    if( last_checkpoint == 0 )
+      return;
+
+    db_lock_guard lock(*this);
+    const auto& st_idx = db->get_index<chronicle::state_index, chronicle::by_id>();
+    if( st_idx.begin() == st_idx.end() || st_idx.begin()->irreversible < last_checkpoint ) {
+      wlog("Checkpoint at block ${c} is ahead of the state database, the next checkpoint will be full",
+           ("c",last_checkpoint));
+      last_checkpoint = 0;
+      return;
+    }
+
+    const auto& hist_idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_id>();
+    for( auto& o : hist_idx ) {
+      if( o.block_index > last_checkpoint )
+        checkpoint_abi_changes.emplace(o.block_index, o.account);
+    }
+    uint32_t first_chunk = chronicle::activity_bitmap::chunk_of(last_checkpoint + 1);
+    const auto& act_idx = db->get_index<chronicle::account_activity_index, chronicle::by_name_and_chunk>();
+    for( auto& o : act_idx ) {
+      if( o.chunk >= first_chunk )
+        checkpoint_activity_changes.emplace(o.account, o.chunk);
+    }
+  }
+
+
+  // the state database must be locked by the caller
+  std::unique_ptr<chronicle::receiver_state> collect_receiver_state(uint32_t block_num, const checksum256& block_id) {
+    auto state = std::make_unique<chronicle::receiver_state>();
+    state->block_num = block_num;
+    state->block_id = block_id.value;
+
+    const auto& hist_idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_name_and_block>();
+    auto itr = hist_idx.begin();
+    while( itr != hist_idx.end() ) {
+      uint64_t account = itr->account;
+      state->abis.push_back(collect_account_abis(account, 0, block_num));
+      itr = hist_idx.upper_bound(boost::make_tuple(account));
+    }
+
+    uint32_t last_chunk = chronicle::activity_bitmap::chunk_of(block_num);
+    const auto& act_idx = db->get_index<chronicle::account_activity_index, chronicle::by_name_and_chunk>();
+    for( auto& o : act_idx ) {
+      if( o.chunk <= last_chunk )
+        state->activity.push_back(collect_activity_chunk(o, block_num));
+    }
+    return state;
+  }
+
+
+  // the state database must be locked by the caller
+  std::unique_ptr<chronicle::receiver_state> collect_receiver_changes(uint32_t after_block, uint32_t block_num,
+                                                                      const checksum256& block_id) {
+    auto state = std::make_unique<chronicle::receiver_state>();
+    state->incremental = true;
+    state->block_num = block_num;
+    state->block_id = block_id.value;
+
+    std::set<uint64_t> accounts;
+    for( auto& change : checkpoint_abi_changes ) {
+      if( change.first > block_num )
+        break;
+      accounts.insert(change.second);
+    }
+    for( uint64_t account : accounts )
+      state->abis.push_back(collect_account_abis(account, after_block + 1, block_num));
+
+    uint32_t last_chunk = chronicle::activity_bitmap::chunk_of(block_num);
+    const auto& act_idx = db->get_index<chronicle::account_activity_index, chronicle::by_name_and_chunk>();
+    for( auto& key : checkpoint_activity_changes ) {
+      if( key.second > last_chunk )
+        continue;
+      auto itr = act_idx.find(boost::make_tuple(key.first, key.second));
+      if( itr == act_idx.end() )
+        continue;
+      auto chunk = collect_activity_chunk(*itr, block_num);
+      if( !chunk.blocks.empty() )
+        state->activity.push_back(std::move(chunk));
+    }
+    return state;
+  }
+
+
+  // revisions of an account from the first block up to the checkpoint block, and its ABI at that block
+  chronicle::receiver_state::account_abis collect_account_abis(uint64_t account, uint32_t first_block, uint32_t block_num) {
+    const auto& hist_idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_name_and_block>();
+    const auto& hist_rev_idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_name_and_block_rev>();
+    const auto& abi_idx = db->get_index<chronicle::contract_abi_index, chronicle::by_name>();
+
+    chronicle::receiver_state::account_abis acc;
+    acc.account = account;
+    bool changed_later = false;
+    auto itr = hist_idx.lower_bound(boost::make_tuple(account, first_block));
+    for( ; itr != hist_idx.end() && itr->account == account; ++itr ) {
+      if( itr->block_index > block_num ) {
+        changed_later = true;
+        break;
+      }
+      acc.revisions.emplace_back(itr->block_index, string(itr->abi.data(), itr->abi.size()));
+    }
+
+    if( !changed_later ) {
+      auto cur = abi_idx.find(account);
+      if( cur != abi_idx.end() )
+        acc.current.assign(cur->abi.data(), cur->abi.size());
+    }
+    else {
+      // the current ABI is replaced later, so the last valid revision at the block is taken
+      auto rev = hist_rev_idx.lower_bound(boost::make_tuple(account, block_num));
+      for( ; rev != hist_rev_idx.end() && rev->account == account; ++rev ) {
+        if( rev->abi.size() == 0 )
+          break;
+        acc.candidates.emplace_back(rev->abi.data(), rev->abi.size());
+      }
+    }
+    return acc;
+  }
+
+
+  // blocks after the checkpoint block are left out
+  chronicle::receiver_state::activity_chunk collect_activity_chunk(const chronicle::account_activity_object& o,
+                                                                   uint32_t block_num) {
+    chronicle::receiver_state::activity_chunk chunk{o.account, o.chunk, {}};
+    if( o.chunk < chronicle::activity_bitmap::chunk_of(block_num) ) {
+      chunk.blocks.assign(o.blocks.data(), o.blocks.size());
+    }
+    else {
+      std::vector<uint32_t> blocks;
+      chronicle::activity_bitmap::get_blocks(o.blocks, o.chunk, 0, block_num + 1, blocks);
+      for( uint32_t b : blocks )
+        chronicle::activity_bitmap::add(chunk.blocks, b);
+    }
+    return chunk;
+  }
+
+
+  static bool abi_is_valid(uint64_t account, const string& abi) {
+    auto ctxt = create_abi_ctxt();
+    return abieos_set_abi_bin(ctxt.get(), account, abi.data(), abi.size());
+  }
+
+
+  // snapshot of the state at the last irreversible block
+  string export_receiver_state(const string& file) {
+    ilog("Exporting state to ${f}", ("f", file));
+    auto started = std::chrono::steady_clock::now();
+    chronicle::state_file_writer writer(file, true);
+    std::unique_ptr<chronicle::receiver_state> state;
+    {
+      db_lock_guard lock(*this);
+      const auto& idx = db->get_index<chronicle::state_index, chronicle::by_id>();
+      auto itr = idx.begin();
+      if( itr == idx.end() )
+        throw runtime_error("State database is empty, there is nothing to export");
+      state = collect_receiver_state(itr->irreversible, itr->irreversible_id);
+    }
+    uint32_t block_num = state->block_num;
+    chronicle::write_receiver_state(writer, *state, abi_is_valid);
+    writer.commit();
+    ilog("Exported ${s} bytes in ${t} seconds", ("s",writer.bytes_written())
+         ("t",std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started).count()));
+    return "Exported state at block " + to_string(block_num) + " to " + file;
+  }
+
+
+  // Loads the state written by write_receiver_state() into an empty state
+  // database. Objects are created without undo sessions.
+  uint32_t read_receiver_state(chronicle::state_file_reader& reader) {
+    const auto& st_idx = db->get_index<chronicle::state_index, chronicle::by_id>();
+    if( st_idx.begin() != st_idx.end() )
+      throw runtime_error("State database is not empty");
+
+    uint32_t block_num = reader.read_u32();
+    checksum256 block_id;
+    reader.read_raw((char*)block_id.value.data(), block_id.value.size());
+
+    uint64_t rows = 0;
+    string data;
+    while( true ) {
+      uint8_t type = reader.read_u8();
+      if( type == chronicle::state_rec_end )
+        break;
+      switch( type ) {
+      case chronicle::state_rec_abi_history:
+        {
+          uint64_t account = reader.read_u64();
+          uint32_t block_index = reader.read_u32();
+          reader.read_bytes(data);
+          db->create<chronicle::contract_abi_history>( [&]( chronicle::contract_abi_history& o ) {
+              o.account = account;
+              o.block_index = block_index;
+              o.abi.assign(data.data(), data.size());
+            });
+        }
+        break;
+      case chronicle::state_rec_contract_abi:
+        {
+          uint64_t account = reader.read_u64();
+          reader.read_bytes(data);
+          db->create<chronicle::contract_abi_object>( [&]( chronicle::contract_abi_object& o ) {
+              o.account = account;
+              o.abi.assign(data.data(), data.size());
+            });
+        }
+        break;
+      case chronicle::state_rec_account_activity:
+        {
+          uint64_t account = reader.read_u64();
+          uint32_t chunk = reader.read_u32();
+          reader.read_bytes(data);
+          db->create<chronicle::account_activity_object>( [&]( chronicle::account_activity_object& o ) {
+              o.account = account;
+              o.chunk = chunk;
+              o.set_blocks(data);
+            });
+        }
+        break;
+      default:
+        throw runtime_error("Unknown record type " + to_string(type) + " in state file");
+      }
+      rows++;
+    }
+    reader.finish();
+
+    db->create<chronicle::state_object>( [&]( chronicle::state_object& o ) {
+        o.head = block_num;
+        o.head_id = block_id;
+        o.irreversible = block_num;
+        o.irreversible_id = block_id;
+      });
+    db->create<chronicle::received_block_object>( [&]( chronicle::received_block_object& o ) {
+        o.block_index = block_num;
+        o.block_id = block_id;
+      });
+    db->set_revision(block_num);
+    ilog("Loaded ${r} records, state is at block ${b}", ("r",rows)("b",block_num));
+    return block_num;
+  }
+
+
+  // Applies the changes saved after the full checkpoint on top of the state
+  // loaded by read_receiver_state(). Objects are modified without undo sessions.
+  uint32_t apply_checkpoint_delta(const chronicle::checkpoint_delta& delta) {
+    const auto& hist_idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_name_and_block>();
+    for( auto& e : delta.abi_history ) {
+      auto itr = hist_idx.find(boost::make_tuple(e.first.first, e.first.second));
+      if( itr != hist_idx.end() ) {
+        db->modify( *itr, [&]( chronicle::contract_abi_history& o ) {
+            o.abi.assign(e.second.data(), e.second.size());
+          });
+      }
+      else {
+        db->create<chronicle::contract_abi_history>( [&]( chronicle::contract_abi_history& o ) {
+            o.account = e.first.first;
+            o.block_index = e.first.second;
+            o.abi.assign(e.second.data(), e.second.size());
+          });
+      }
+    }
+
+    const auto& abi_idx = db->get_index<chronicle::contract_abi_index, chronicle::by_name>();
+    for( auto& e : delta.contract_abi ) {
+      auto itr = abi_idx.find(e.first);
+      if( e.second.empty() ) {
+        if( itr != abi_idx.end() )
+          db->remove(*itr);
+      }
+      else if( itr != abi_idx.end() ) {
+        db->modify( *itr, [&]( chronicle::contract_abi_object& o ) {
+            o.abi.assign(e.second.data(), e.second.size());
+          });
+      }
+      else {
+        db->create<chronicle::contract_abi_object>( [&]( chronicle::contract_abi_object& o ) {
+            o.account = e.first;
+            o.abi.assign(e.second.data(), e.second.size());
+          });
+      }
+    }
+
+    const auto& act_idx = db->get_index<chronicle::account_activity_index, chronicle::by_name_and_chunk>();
+    for( auto& e : delta.activity ) {
+      auto itr = act_idx.find(boost::make_tuple(e.first.first, e.first.second));
+      if( itr != act_idx.end() ) {
+        db->modify( *itr, [&]( chronicle::account_activity_object& o ) {
+            o.set_blocks(e.second);
+          });
+      }
+      else {
+        db->create<chronicle::account_activity_object>( [&]( chronicle::account_activity_object& o ) {
+            o.account = e.first.first;
+            o.chunk = e.first.second;
+            o.set_blocks(e.second);
+          });
+      }
+    }
+
+    checksum256 block_id;
+    block_id.value = delta.block_id;
+    const auto& st_idx = db->get_index<chronicle::state_index, chronicle::by_id>();
+    db->modify( *st_idx.begin(), [&]( chronicle::state_object& o ) {
+        o.head = delta.block_num;
+        o.head_id = block_id;
+        o.irreversible = delta.block_num;
+        o.irreversible_id = block_id;
+      });
+    const auto& blk_idx = db->get_index<chronicle::received_block_index, chronicle::by_blocknum>();
+    db->modify( *blk_idx.begin(), [&]( chronicle::received_block_object& o ) {
+        o.block_index = delta.block_num;
+        o.block_id = block_id;
+      });
+    db->set_revision(delta.block_num);
+    ilog("Applied ${a} ABI revisions and ${c} activity chunks, state is at block ${b}",
+         ("a",delta.abi_history.size())("c",delta.activity.size())("b",delta.block_num));
+    return delta.block_num;
   }
 
 
@@ -836,7 +2159,7 @@ public:
     if (!bin_to_native(block_ptr->block, error, bin))
       throw runtime_error("block conversion error: " + error);
     block_timestamp = block_ptr->block.timestamp;
-    if (!skip_block_events) {
+    if (!skip_block_events && (!interactive_mode || current_req->fetch_block)) {
       _blocks_chan.publish(channel_priority, block_ptr);
     }
   }
@@ -869,6 +2192,14 @@ public:
         check_variant(row.data, variant_type, 0u);
       }
 
+      if ( !interactive_mode && account_index && bltd->table_delta.name == "contract_row") {
+        for (auto& row : bltd->table_delta.rows) {
+          // contract code is the first field of the row
+          input_buffer rowbin = row.data;
+          block_accounts.insert(read_raw<uint64_t>(rowbin));
+        }
+      }
+
       if ( !interactive_mode && bltd->table_delta.name == "account") {  // memorize contract ABI
         for (auto& row : bltd->table_delta.rows) {
           if (row.present) {
@@ -888,6 +2219,8 @@ public:
       else if (!noexport_mode && !skip_table_deltas) {
         if (bltd->table_delta.name == "contract_row" &&
             (_table_row_updates_chan.has_subscribers() || _abi_errors_chan.has_subscribers())) {
+          std::vector<std::shared_ptr<chronicle::channels::table_row_update>> rows;
+          std::set<uint64_t> contracts;
           for (auto& row : bltd->table_delta.rows) {
             auto tru = std::make_shared<chronicle::channels::table_row_update>();
             tru->block_num = head;
@@ -897,8 +2230,19 @@ public:
             string error;
             if (!bin_to_native(tru->kvo, error, row.data))
               throw runtime_error("cannot read table row object" + error);
-            if( get_contract_abi_ready(tru->kvo.code, interactive_mode) ) {
-              tru->added = row.present;
+            if( !is_exported_account(tru->kvo.code) ) {
+              continue;
+            }
+            tru->added = row.present;
+            rows.push_back(tru);
+            contracts.insert(tru->kvo.code.value);
+          }
+
+          // in scanning mode, the database is already locked
+          auto abis = resolve_block_abis(contracts, interactive_mode);
+          for (auto& tru : rows) {
+            if( abis->contracts.count(tru->kvo.code.value) > 0 ) {
+              tru->abis = abis;
               _table_row_updates_chan.publish(channel_priority, tru);
             }
             else {
@@ -920,6 +2264,8 @@ public:
             string error;
             if (!bin_to_native(pu->permission, error, row.data))
               throw runtime_error("cannot read permission object" + error);
+            if( !is_exported_account(pu->permission.owner) )
+              continue;
             pu->added = row.present;
             _permission_updates_chan.publish(channel_priority, pu);
           }
@@ -933,6 +2279,8 @@ public:
             string error;
             if (!bin_to_native(plu->permission_link, error, row.data))
               throw runtime_error("cannot read permission_link object" + error);
+            if( !is_exported_account(plu->permission_link.account) )
+              continue;
             plu->added = row.present;
             _permission_link_updates_chan.publish(channel_priority, plu);
           }
@@ -946,6 +2294,8 @@ public:
             string error;
             if (!bin_to_native(amu->account_metadata, error, row.data))
               throw runtime_error("cannot read account_metadata object" + error);
+            if( !is_exported_account(amu->account_metadata.name) )
+              continue;
             _account_metadata_updates_chan.publish(channel_priority, amu);
           }
         }
@@ -956,18 +2306,108 @@ public:
 
 
   void init_contract_abi_ctxt() {
-    if( contract_abi_ctxt ) {
+    // interactive mode checks the validity ranges before reusing the contexts
+    if( !interactive_mode ) {
       // dlog("Destroying ABI cache");
-      abieos_destroy(contract_abi_ctxt);
-      contract_abi_imported.clear();
+      contract_abi_ctxts.clear();
+      contract_abi_lru.clear();
+      contract_abi_missing.clear();
+      abi_cache_bytes = 0;
     }
-    contract_abi_ctxt = abieos_create();
+  }
+
+
+  // abieos_contract does not support removals, so we destroy the whole context
+  void drop_contract_abi(uint64_t account) {
+    auto itr = contract_abi_ctxts.find(account);
+    if( itr != contract_abi_ctxts.end() ) {
+      abi_cache_bytes -= itr->second.abi_size;
+      contract_abi_lru.erase(itr->second.lru_pos);
+      contract_abi_ctxts.erase(itr);
+    }
+    contract_abi_missing.erase(account);
+  }
+
+
+  static std::shared_ptr<abieos_context> create_abi_ctxt() {
+    return std::shared_ptr<abieos_context>(abieos_create(), abieos_destroy);
+  }
+
+
+  // Most contracts have none of the specialized actions and tables, and are skipped without
+  // parsing. Token contracts mostly deploy the same ABI, so the results are kept by ABI hash.
+  std::shared_ptr<const chronicle::specialized_decoders::decoder_set> match_specialized_decoders(const char* data,
+                                                                                                 size_t size) {
+    if( !chronicle::specialized_decoders::may_match(data, size) )
+      return nullptr;
+    auto hash = fc::sha256::hash(data, size);
+    auto itr = specialized_by_abi_hash.find(hash);
+    if( itr != specialized_by_abi_hash.end() )
+      return itr->second;
+
+    std::shared_ptr<const chronicle::specialized_decoders::decoder_set> result;
+    abieos::abi_def def;
+    input_buffer buf{data, data + size};
+    string error;
+    if( bin_to_native(def, error, buf) )
+      result = chronicle::specialized_decoders::match_abi(def);
+    if( specialized_by_abi_hash.size() >= 4096 )
+      specialized_by_abi_hash.clear();
+    specialized_by_abi_hash.emplace(hash, result);
+    return result;
+  }
+
+
+  void add_contract_abi(uint64_t account, std::shared_ptr<abieos_context> ctxt, uint32_t revision,
+                        uint32_t valid_until, const char* data, size_t size) {
+    chronicle::channels::contract_abi abi{ctxt, nullptr};
+    abi.specialized = match_specialized_decoders(data, size);
+    if( abi.specialized )
+      dlog("Using specialized decoders for ${a}", ("a",(std::string)name{account}));
+
+    contract_abi_lru.push_front(account);
+    contract_abi_ctxts.emplace(account, contract_abi_entry{abi, revision, valid_until, size,
+          contract_abi_lru.begin()});
+    abi_cache_bytes += size;
+    while( abi_cache_max > 0 && contract_abi_ctxts.size() > abi_cache_max ) {
+      drop_contract_abi(contract_abi_lru.back());
+      abi_cache_evictions++;
+    }
+  }
+
+
+  // moves the contract to the head of LRU list
+  void touch_contract_abi(contract_abi_entry& entry) {
+    contract_abi_lru.splice(contract_abi_lru.begin(), contract_abi_lru, entry.lru_pos);
+  }
+
+
+  bool load_contract_abi(uint64_t account, uint32_t revision, uint32_t valid_until, const char* data, size_t size) {
+    drop_contract_abi(account);
+    abi_cache_misses++;
+    auto ctxt = create_abi_ctxt();
+    if( size == 0 || !abieos_set_abi_bin(ctxt.get(), account, data, size) ) {
+      contract_abi_missing[account] = std::make_pair(revision, valid_until);
+      return false;
+    }
+    add_contract_abi(account, ctxt, revision, valid_until, data, size);
+    if( abi_warmup_max > 0 )
+      contract_abi_usage[account]++;
+    return true;
+  }
+
+
+  // returns nullptr if the contract has no usable ABI
+  abieos_context* get_contract_abi_ctxt(uint64_t account) {
+    auto itr = contract_abi_ctxts.find(account);
+    if( itr != contract_abi_ctxts.end() )
+      return itr->second.abi.ctxt.get();
+    return nullptr;
   }
 
 
   void clear_contract_abi(name account) {
-    if( contract_abi_imported.count(account.value) > 0 )
-      init_contract_abi_ctxt(); // abieos_contract does not support removals, so we have to destroy it
+    drop_contract_abi(account.value);
     {
       const auto& idx = db->get_index<chronicle::contract_abi_index, chronicle::by_name>();
       auto itr = idx.find(account.value);
@@ -989,16 +2429,15 @@ public:
 
   void save_contract_abi(name account, std::vector<char> data) {
     // dlog("Saving contract ABI for ${a}", ("a",(std::string)account));
-    if( contract_abi_imported.count(account.value) > 0 ) {
-      init_contract_abi_ctxt();
-    }
+    drop_contract_abi(account.value);
 
     try {
       // this checks the validity of ABI
-      if( !abieos_set_abi_bin(contract_abi_ctxt, account.value, data.data(), data.size()) ) {
-        throw runtime_error( abieos_get_error(contract_abi_ctxt) );
+      auto ctxt = create_abi_ctxt();
+      if( !abieos_set_abi_bin(ctxt.get(), account.value, data.data(), data.size()) ) {
+        throw runtime_error( abieos_get_error(ctxt.get()) );
       }
-      contract_abi_imported.insert(account.value);
+      add_contract_abi(account.value, ctxt, 0, std::numeric_limits<uint32_t>::max(), data.data(), data.size());
 
       {
         const auto& idx = db->get_index<chronicle::contract_abi_index, chronicle::by_name>();
@@ -1059,6 +2498,11 @@ public:
           o.set_abi(data);
         });
     }
+    add_checkpoint_abi_change(account.value, head);
+    if( abi_log )
+      abi_log->add(account.value, head, data.data(), data.size());
+    if( repl_server )
+      repl_server->add(head, chronicle::replication::encode_abi_history(account.value, head, data.data(), data.size()));
     /* debugging */
     /*
     int count = 0;
@@ -1077,44 +2521,281 @@ public:
   }
 
 
-  bool get_contract_abi_ready(name account, bool lock) {
-    if( contract_abi_imported.count(account.value) > 0 )
-      return true; // the context has this contract loaded
+  // returns true if the cache knows whether the contract has a usable ABI at the current block
+  bool contract_abi_cached(uint64_t account, bool& usable) {
+    auto cached = contract_abi_ctxts.find(account);
+    if( cached != contract_abi_ctxts.end() && head >= cached->second.revision &&
+        head < cached->second.valid_until ) {
+      abi_cache_hits++;
+      touch_contract_abi(cached->second);
+      if( abi_warmup_max > 0 )
+        contract_abi_usage[account]++;
+      usable = true;
+      return true;
+    }
+    auto missing = contract_abi_missing.find(account);
+    if( missing != contract_abi_missing.end() && head >= missing->second.first &&
+        head < missing->second.second ) {
+      abi_cache_negative_hits++;
+      usable = false;
+      return true;
+    }
+    return false;
+  }
+
+
+  // the state database must be locked by the caller. ABI bytes are copied,
+  // so that they can be parsed after the lock is released.
+  contract_abi_lookup lookup_contract_abi(uint64_t account, uint32_t block_num) {
+    contract_abi_lookup result{account, false, 0, std::numeric_limits<uint32_t>::max(), {}};
     if (interactive_mode) {
-      dlog("ABI requested for ${a} and block ${h}", ("a",(std::string)account)("h",head));
-      if (lock)
-        dblock->mutex.lock();
       const auto& idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_name_and_block_rev>();
-      auto itr = idx.lower_bound(boost::make_tuple(account.value, head));
-      if (lock)
-        dblock->mutex.unlock();
-      if( itr != idx.end() ) {
-        dlog("Found in history: ABI for ${a}, block ${b}", ("a",(std::string)account)("b",itr->block_index));
-        abieos_set_abi_bin(contract_abi_ctxt, account.value, itr->abi.data(), itr->abi.size());
-        contract_abi_imported.insert(account.value);
-        return true;
+      auto itr = idx.lower_bound(boost::make_tuple(account, block_num));
+      if( itr != idx.end() && itr->account == account ) {
+        result.found = true;
+        result.revision = itr->block_index;
+        result.data.assign(itr->abi.begin(), itr->abi.end());
       }
+
+      // blocks above irreversible may still get a new revision
+      const auto& st_idx = db->get_index<chronicle::state_index, chronicle::by_id>();
+      if( st_idx.begin() != st_idx.end() )
+        result.valid_until = st_idx.begin()->irreversible + 1;
+      const auto& next_idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_name_and_block>();
+      auto next = next_idx.upper_bound(boost::make_tuple(account, block_num));
+      if( next != next_idx.end() && next->account == account )
+        result.valid_until = std::min(result.valid_until, next->block_index);
     }
     else {
-      if (lock)
-        dblock->mutex.lock();
+      // valid until the next setabi of the contract
       const auto& idx = db->get_index<chronicle::contract_abi_index, chronicle::by_name>();
-      auto itr = idx.find(account.value);
-      if (lock)
-        dblock->mutex.unlock();
+      auto itr = idx.find(account);
       if( itr != idx.end() ) {
-        // dlog("Found in DB: ABI for ${a}", ("a",(std::string)account));
-        abieos_set_abi_bin(contract_abi_ctxt, account.value, itr->abi.data(), itr->abi.size());
-        contract_abi_imported.insert(account.value);
-        return true;
+        result.found = true;
+        result.data.assign(itr->abi.begin(), itr->abi.end());
       }
     }
+    return result;
+  }
+
+
+  // irreversible history is looked up in the ABI log without locking the state database
+  bool lookup_contract_abi_log(uint64_t account, uint32_t block_num, contract_abi_lookup& result) {
+    if( !interactive_mode || !abi_log )
+      return false;
+    uint32_t last_block = abi_log->last_block();
+    if( block_num > last_block )
+      return false;
+    chronicle::abi_log::lookup_result found;
+    result = contract_abi_lookup{account, false, 0, last_block + 1, {}};
+    if( abi_log->lookup(account, block_num, found) ) {
+      result.found = true;
+      result.revision = found.revision;
+      result.valid_until = std::min(result.valid_until, found.next_revision);
+      result.data = std::move(found.data);
+    }
+    abi_log_lookups++;
+    return true;
+  }
+
+
+  bool apply_contract_abi(const contract_abi_lookup& lookup) {
+    if( lookup.found ) {
+      if (interactive_mode)
+        dlog("Found in history: ABI for ${a}, block ${b}", ("a",(std::string)name{lookup.account})("b",lookup.revision));
+      return load_contract_abi(lookup.account, lookup.revision, lookup.valid_until,
+                               lookup.data.data(), lookup.data.size());
+    }
+    drop_contract_abi(lookup.account);
+    contract_abi_missing[lookup.account] = std::make_pair(lookup.revision, lookup.valid_until);
     return false;
   }
 
 
-  void receive_traces(input_buffer bin, const shared_ptr<flat_buffer>& p) {
-    if (_transaction_traces_chan.has_subscribers()) {
+  bool get_contract_abi_ready(name account, bool lock) {
+    bool usable;
+    if( contract_abi_cached(account.value, usable) )
+      return usable;
+    if (interactive_mode)
+      dlog("ABI requested for ${a} and block ${h}", ("a",(std::string)account)("h",head));
+    contract_abi_lookup lookup;
+    if( !lookup_contract_abi_log(account.value, head, lookup) ) {
+      if (lock)
+        lock_db();
+      lookup = lookup_contract_abi(account.value, head);
+      if (lock)
+        unlock_db();
+    }
+    return apply_contract_abi(lookup);
+  }
+
+
+  // reads the usage statistics saved by previous run, most used contracts first
+  std::vector<uint64_t> load_abi_usage() {
+    std::vector<uint64_t> accounts;
+    std::ifstream ifs(abi_usage_file);
+    string account;
+    uint64_t count;
+    while( ifs >> account >> count ) {
+      uint64_t value = abieos::name(account).value;
+      contract_abi_usage[value] = count;
+      if( accounts.size() < abi_warmup_max )
+        accounts.push_back(value);
+    }
+    return accounts;
+  }
+
+
+  // Several interactive processes may save the file at the same time, so each of them
+  // writes its own temporary file. The statistics in memory are trimmed to twice the
+  // saved number of contracts and halved, so that they stay small and old usage fades.
+  void save_abi_usage() {
+    if( abi_warmup_max == 0 )
+      return;
+    std::vector<std::pair<uint64_t, uint64_t>> usage(contract_abi_usage.begin(), contract_abi_usage.end());
+    std::sort(usage.begin(), usage.end(), [](auto& a, auto& b) { return a.second > b.second; });
+
+    contract_abi_usage.clear();
+    for( size_t i = 0; i < usage.size() && i < 2 * (size_t)abi_warmup_max; i++ ) {
+      if( usage[i].second > 1 )
+        contract_abi_usage[usage[i].first] = usage[i].second / 2;
+    }
+
+    if( usage.size() > abi_warmup_max )
+      usage.resize(abi_warmup_max);
+    string tmpfile = abi_usage_file + "." + std::to_string(getpid()) + ".tmp";
+    {
+      std::ofstream ofs(tmpfile, std::ofstream::trunc);
+      for( auto& u : usage )
+        ofs << (std::string)name{u.first} << ' ' << u.second << '\n';
+      if( !ofs ) {
+        wlog("Cannot write ${f}", ("f",tmpfile));
+        boost::system::error_code ec;
+        boost::filesystem::remove(tmpfile, ec);
+        return;
+      }
+    }
+    boost::filesystem::rename(tmpfile, abi_usage_file);
+  }
+
+
+  // ABI of the most used contracts are parsed in a separate thread while the receiver connects to nodeos
+  void start_abi_warmup() {
+    if( abi_warmup_max == 0 )
+      return;
+    std::vector<uint64_t> accounts = load_abi_usage();
+    if( accounts.empty() )
+      return;
+
+    std::vector<contract_abi_lookup> lookups;
+    {
+      db_lock_guard lock(*this);
+      uint32_t block_num = head;
+      if( interactive_mode ) {
+        // interactive requests are most likely to ask for recent blocks
+        const auto& idx = db->get_index<chronicle::state_index, chronicle::by_id>();
+        if( idx.begin() != idx.end() )
+          block_num = idx.begin()->irreversible;
+      }
+      for( uint64_t account : accounts ) {
+        lookups.emplace_back();
+        if( !lookup_contract_abi_log(account, block_num, lookups.back()) )
+          lookups.back() = lookup_contract_abi(account, block_num);
+      }
+    }
+
+    ilog("Pre-parsing ABI of ${n} most used contracts", ("n",lookups.size()));
+    // the contracts are parsed in parallel, and every task fills its own
+    // result, so that they are added to the cache in the order of usage
+    abi_warmup_results.resize(lookups.size());
+    abi_warmup_tasks = std::make_unique<chronicle::worker_group>(chronicle::shared_workers(), false);
+    for( size_t i = 0; i < lookups.size(); i++ ) {
+      if( !lookups[i].found || lookups[i].data.size() == 0 )
+        continue;
+      abi_warmup_results[i].first = std::move(lookups[i]);
+      abi_warmup_tasks->post([this, i]() {
+          auto& lookup = abi_warmup_results[i].first;
+          auto ctxt = create_abi_ctxt();
+          if( abieos_set_abi_bin(ctxt.get(), lookup.account, lookup.data.data(), lookup.data.size()) )
+            abi_warmup_results[i].second = ctxt;
+        });
+    }
+  }
+
+
+  // waits for the worker threads and moves their results into the cache
+  void finish_abi_warmup() {
+    if( !abi_warmup_tasks )
+      return;
+    abi_warmup_tasks.reset();
+    uint32_t count = 0;
+    for( auto& result : abi_warmup_results ) {
+      auto& lookup = result.first;
+      if( !result.second )
+        continue;
+      if( contract_abi_ctxts.count(lookup.account) > 0 || contract_abi_missing.count(lookup.account) > 0 )
+        continue;
+      add_contract_abi(lookup.account, result.second, lookup.revision, lookup.valid_until,
+                       lookup.data.data(), lookup.data.size());
+      count++;
+    }
+    abi_warmup_results.clear();
+    ilog("Pre-parsed ABI of ${n} contracts", ("n",count));
+  }
+
+
+  // resolves ABI of all contracts that the events of a block refer to, with one lookup in the state database
+  std::shared_ptr<chronicle::channels::block_abis> resolve_block_abis(const std::set<uint64_t>& contracts,
+                                                                      bool lock) {
+    auto abis = std::make_shared<chronicle::channels::block_abis>();
+    std::vector<uint64_t> unknown;
+    for( uint64_t account : contracts ) {
+      bool usable;
+      if( contract_abi_cached(account, usable) ) {
+        // contexts are taken immediately, so that eviction does not affect this block
+        if( usable )
+          abis->contracts.emplace(account, contract_abi_ctxts.at(account).abi);
+      }
+      else {
+        unknown.push_back(account);
+      }
+    }
+
+    if( !unknown.empty() ) {
+      std::vector<contract_abi_lookup> lookups;
+      std::vector<uint64_t> locked;
+      for( uint64_t account : unknown ) {
+        lookups.emplace_back();
+        if( !lookup_contract_abi_log(account, head, lookups.back()) ) {
+          lookups.pop_back();
+          locked.push_back(account);
+        }
+      }
+      if( !locked.empty() ) {
+        if (lock)
+          lock_db();
+        for( uint64_t account : locked )
+          lookups.emplace_back(lookup_contract_abi(account, head));
+        if (lock)
+          unlock_db();
+      }
+      for( auto& lookup : lookups ) {
+        if( apply_contract_abi(lookup) )
+          abis->contracts.emplace(lookup.account, contract_abi_ctxts.at(lookup.account).abi);
+      }
+    }
+    return abis;
+  }
+
+
+  // traces are published after the state changes of the block are saved
+  std::vector<std::shared_ptr<chronicle::channels::transaction_trace>>
+  receive_traces(input_buffer bin, const shared_ptr<flat_buffer>& p) {
+    std::vector<std::shared_ptr<chronicle::channels::transaction_trace>> traces;
+    bool export_traces = !noexport_mode && !skip_traces && _transaction_traces_chan.has_subscribers();
+    bool index_traces = !interactive_mode && trx_idx;
+    bool index_accounts = !interactive_mode && account_index;
+    if (export_traces || index_traces || index_accounts) {
       uint32_t num;
       string       error;
       if( !read_varuint32(bin, error, num) )
@@ -1137,12 +2818,321 @@ public:
           }
         }
         if( !blacklisted ) {
-          tr->block_num = head;
-          tr->block_timestamp = block_timestamp;
-          _transaction_traces_chan.publish(channel_priority, tr);
+          if( index_traces )
+            trx_idx->add(head, trace.id.value.data());
+          if( index_accounts ) {
+            for( auto& atrace : trace.action_traces )
+              block_accounts.insert(std::get<state_history::action_trace_v0>(atrace).receiver.value);
+          }
+          if( export_traces && interactive_mode && !current_req->accounts.empty() ) {
+            bool matched = false;
+            for( auto& atrace : trace.action_traces ) {
+              auto& at = std::get<state_history::action_trace_v0>(atrace);
+              if( is_exported_account(at.receiver) || is_exported_account(at.act.account) ) {
+                matched = true;
+                break;
+              }
+            }
+            if( !matched )
+              continue;
+          }
+          if( export_traces ) {
+            tr->block_num = head;
+            tr->block_timestamp = block_timestamp;
+            traces.push_back(tr);
+          }
         }
       }
     }
+    return traces;
+  }
+
+
+  void save_account_activity() {
+    for( uint64_t account : block_accounts ) {
+      add_account_activity(account, head);
+      if( repl_server )
+        repl_server->add(head, chronicle::replication::encode_account_activity(account, head));
+    }
+  }
+
+
+  void add_account_activity(uint64_t account, uint32_t block_num) {
+    const auto& idx = db->get_index<chronicle::account_activity_index, chronicle::by_name_and_chunk>();
+    uint32_t chunk = chronicle::activity_bitmap::chunk_of(block_num);
+    auto itr = idx.find(boost::make_tuple(account, chunk));
+    if( itr != idx.end() ) {
+      std::string data(itr->blocks.data(), itr->blocks.size());
+      if( chronicle::activity_bitmap::add(data, block_num) ) {
+        db->modify( *itr, [&]( chronicle::account_activity_object& o ) {
+            o.set_blocks(data);
+          });
+      }
+    }
+    else {
+      std::string data;
+      chronicle::activity_bitmap::add(data, block_num);
+      db->create<chronicle::account_activity_object>( [&]( chronicle::account_activity_object& o ) {
+          o.account = account;
+          o.chunk = chunk;
+          o.set_blocks(data);
+        });
+    }
+    add_checkpoint_activity_change(account, chunk);
+  }
+
+
+  // position of a replica catch-up in the state database
+  struct repl_catchup_cursor {
+    enum stage_type { find_revisions, send_revisions, send_activity };
+    uint32_t                              after_block;
+    uint32_t                              up_to_block;
+    stage_type                            stage = find_revisions;
+    chronicle::contract_abi_history::id_type next_id = 0;
+    std::vector<std::pair<uint32_t, chronicle::contract_abi_history::id_type>> revisions; // (block, id)
+    size_t                                next_revision = 0;
+    uint64_t                              next_account = 0;
+    uint32_t                              next_chunk = 0;
+    uint64_t                              chunks = 0;
+  };
+
+  // index entries examined and bytes encoded in one batch of a replica catch-up
+  static constexpr size_t repl_catchup_scan_rows = 10000;
+  static constexpr size_t repl_catchup_batch_bytes = 4*1024*1024;
+
+  // Data of irreversible blocks for a replica that has connected, produced
+  // in batches. The replica derives current ABI from the revisions, so they
+  // go in the order of (block, id): the first batches only find the
+  // revisions in the range, and the following ones encode them.
+  chronicle::replication_server::catchup_batch_fn replication_catchup(uint32_t after_block, uint32_t up_to_block) {
+    auto cursor = std::make_shared<repl_catchup_cursor>();
+    cursor->after_block = after_block;
+    cursor->up_to_block = up_to_block;
+    return [this, cursor](std::vector<string>& messages) {
+      return replication_catchup_batch(*cursor, messages);
+    };
+  }
+
+
+  // the state database is locked only while one batch is collected. Returns false after the last batch.
+  bool replication_catchup_batch(repl_catchup_cursor& c, std::vector<string>& messages) {
+    db_lock_guard lock(*this);
+    size_t scanned = 0;
+    size_t bytes = 0;
+
+    if( c.stage == repl_catchup_cursor::find_revisions ) {
+      const auto& hist_idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_id>();
+      for( auto itr = hist_idx.lower_bound(c.next_id); itr != hist_idx.end(); ++itr ) {
+        if( scanned++ == repl_catchup_scan_rows ) {
+          c.next_id = itr->id;
+          return true;
+        }
+        if( itr->block_index > c.after_block && itr->block_index <= c.up_to_block )
+          c.revisions.emplace_back(itr->block_index, itr->id);
+      }
+      std::sort(c.revisions.begin(), c.revisions.end());
+      c.stage = repl_catchup_cursor::send_revisions;
+      return true;
+    }
+
+    if( c.stage == repl_catchup_cursor::send_revisions ) {
+      while( c.next_revision < c.revisions.size() && bytes < repl_catchup_batch_bytes ) {
+        // revisions of irreversible blocks are never removed
+        const auto* o = db->find<chronicle::contract_abi_history>(c.revisions[c.next_revision++].second);
+        if( o == nullptr )
+          continue;
+        messages.push_back(chronicle::replication::encode_abi_history(o->account, o->block_index,
+                                                                      o->abi.data(), o->abi.size()));
+        bytes += messages.back().size();
+      }
+      if( c.next_revision == c.revisions.size() )
+        c.stage = repl_catchup_cursor::send_activity;
+      return true;
+    }
+
+    uint32_t first_chunk = chronicle::activity_bitmap::chunk_of(c.after_block + 1);
+    uint32_t last_chunk = chronicle::activity_bitmap::chunk_of(c.up_to_block);
+    const auto& act_idx = db->get_index<chronicle::account_activity_index, chronicle::by_name_and_chunk>();
+    auto itr = act_idx.lower_bound(boost::make_tuple(c.next_account, c.next_chunk));
+    while( itr != act_idx.end() ) {
+      if( scanned++ == repl_catchup_scan_rows || bytes >= repl_catchup_batch_bytes ) {
+        c.next_account = itr->account;
+        c.next_chunk = itr->chunk;
+        return true;
+      }
+      // chunks of each account outside of the range are skipped with one lookup
+      if( itr->chunk < first_chunk ) {
+        itr = act_idx.lower_bound(boost::make_tuple(itr->account, first_chunk));
+        continue;
+      }
+      if( itr->chunk > last_chunk ) {
+        itr = act_idx.upper_bound(boost::make_tuple(itr->account));
+        continue;
+      }
+      std::vector<uint32_t> blocks;
+      chronicle::activity_bitmap::get_blocks(itr->blocks, itr->chunk, c.after_block + 1, c.up_to_block + 1, blocks);
+      if( !blocks.empty() ) {
+        std::string container;
+        for( uint32_t b : blocks )
+          chronicle::activity_bitmap::add(container, b);
+        messages.push_back(chronicle::replication::encode_activity_chunk(itr->account, itr->chunk,
+                                                                         container.data(), container.size()));
+        bytes += messages.back().size();
+        c.chunks++;
+      }
+      ++itr;
+    }
+    ilog("Replica catch-up: ${r} ABI revisions and ${c} account activity chunks",
+         ("r",c.revisions.size())("c",c.chunks));
+    return false;
+  }
+
+
+  // replica mode: the state is received from a scanner instead of nodeos
+  void start_replica() {
+    {
+      db_lock_guard lock(*this);
+      if( db->get_index<chronicle::state_index>().stack().size() > 0 )
+        throw runtime_error("State database has uncommitted revisions, it cannot be used by a replica");
+      const auto& idx = db->get_index<chronicle::state_index, chronicle::by_id>();
+      auto itr = idx.begin();
+      if( itr != idx.end() ) {
+        head = itr->head;
+        head_id = itr->head_id;
+        irreversible = itr->irreversible;
+        irreversible_id = itr->irreversible_id;
+        publish_head();
+      }
+    }
+    sync_abi_log();
+    repl_client = std::make_unique<chronicle::replication_client>
+      (app().get_io_service(), stream_priority,
+       [this](std::vector<chronicle::replication_message>& messages) { apply_replication(messages); },
+       [this](const string& error) {
+         elog("Replication stopped: ${e}", ("e",error));
+         abort_receiver();
+       });
+    repl_client->connect(repl_source_host, repl_source_port, irreversible);
+  }
+
+
+  void apply_replication(std::vector<chronicle::replication_message>& messages) {
+    uint32_t previous = irreversible;
+    {
+      db_lock_guard lock(*this);
+      for( auto& msg : messages ) {
+        switch( msg.type ) {
+        case chronicle::repl_abi_history:
+          // blocks up to the irreversible one are sent again after reconnecting
+          if( msg.block_num > irreversible )
+            apply_replicated_abi(msg);
+          break;
+        case chronicle::repl_account_activity:
+          if( msg.block_num > irreversible )
+            add_account_activity(msg.account, msg.block_num);
+          break;
+        case chronicle::repl_activity_chunk:
+          {
+            std::vector<uint32_t> blocks;
+            chronicle::activity_bitmap::get_blocks(msg.data, msg.block_num, irreversible + 1,
+                                                   std::numeric_limits<uint32_t>::max(), blocks);
+            for( uint32_t b : blocks )
+              add_account_activity(msg.account, b);
+          }
+          break;
+        case chronicle::repl_irreversible:
+          if( msg.block_num > irreversible ) {
+            head = irreversible = msg.block_num;
+            std::copy(msg.data.begin(), msg.data.end(), irreversible_id.value.begin());
+            head_id = irreversible_id;
+            save_state();
+            save_replicated_block();
+            if( abi_log )
+              abi_log->flush(irreversible);
+          }
+          break;
+        }
+        repl_applied++;
+      }
+
+      if( irreversible > previous ) {
+        db->set_revision(irreversible);
+        publish_head();
+        if( checkpoints ) {
+          recent_block_ids[irreversible] = irreversible_id;
+          checkpoint_if_due();
+        }
+      }
+    }
+
+    if( report_every > 0 && irreversible / report_every > previous / report_every ) {
+      uint64_t free_bytes = db->get_segment_manager()->get_free_memory();
+      uint64_t size = db->get_segment_manager()->get_size();
+      ilog("block=${h}; dbmem_free=${m}; replicated_messages=${a}; received_MB=${r}",
+           ("h",irreversible)("m", free_bytes*100/size)("a",repl_applied)
+           ("r",repl_client->bytes_received()/(1024*1024)));
+      report_db_lock();
+    }
+  }
+
+
+  // the same as save_contract_abi() and clear_contract_abi() in the scanner, without events
+  void apply_replicated_abi(const chronicle::replication_message& msg) {
+    std::vector<char> data(msg.data.begin(), msg.data.end());
+    const auto& hist_idx = db->get_index<chronicle::contract_abi_hist_index, chronicle::by_name_and_block>();
+    auto hist = hist_idx.find(boost::make_tuple(msg.account, msg.block_num));
+    if( hist != hist_idx.end() ) {
+      db->modify( *hist, [&]( chronicle::contract_abi_history& o ) {
+          o.set_abi(data);
+        });
+    }
+    else {
+      db->create<chronicle::contract_abi_history>( [&]( chronicle::contract_abi_history& o ) {
+          o.account = msg.account;
+          o.block_index = msg.block_num;
+          o.set_abi(data);
+        });
+    }
+    add_checkpoint_abi_change(msg.account, msg.block_num);
+
+    const auto& abi_idx = db->get_index<chronicle::contract_abi_index, chronicle::by_name>();
+    auto cur = abi_idx.find(msg.account);
+    if( data.empty() ) {
+      if( cur != abi_idx.end() )
+        db->remove(*cur);
+    }
+    else {
+      // an invalid ABI leaves the previous one in use
+      auto ctxt = create_abi_ctxt();
+      if( abieos_set_abi_bin(ctxt.get(), msg.account, data.data(), data.size()) ) {
+        if( cur != abi_idx.end() ) {
+          db->modify( *cur, [&]( chronicle::contract_abi_object& o ) {
+              o.set_abi(data);
+            });
+        }
+        else {
+          db->create<chronicle::contract_abi_object>( [&]( chronicle::contract_abi_object& o ) {
+              o.account = msg.account;
+              o.set_abi(data);
+            });
+        }
+      }
+    }
+
+    if( abi_log )
+      abi_log->add(msg.account, msg.block_num, data.data(), data.size());
+  }
+
+
+  // only the last block is kept, so that the database could be used by a scanner later
+  void save_replicated_block() {
+    const auto& idx = db->get_index<chronicle::received_block_index, chronicle::by_blocknum>();
+    while( idx.begin() != idx.end() )
+      db->remove(*idx.begin());
+    db->create<chronicle::received_block_object>( [&]( chronicle::received_block_object& o ) {
+        o.block_index = irreversible;
+        o.block_id = irreversible_id;
+      });
   }
 
 
@@ -1230,16 +3220,61 @@ public:
     if( stream.use_count() > 0 && stream->is_open() ) {
       stream->next_layer().close();
     }
+    if( repl_client )
+      repl_client->close();
+    if( relay )
+      relay->close();
     aborting = true;
   }
 };
 
 
 
+#include <boost/asio/yield.hpp>
+
+void receiver_plugin_impl::receive_loop::step() {
+  reenter (this) {
+    what = "resolve";
+    yield impl->resolver->async_resolve(impl->host, impl->port, resume());
+
+    what = "connect";
+    yield asio::async_connect(impl->stream->next_layer(), endpoints, resume());
+
+    what = "handshake";
+    yield impl->stream->async_handshake(impl->host, "/", resume());
+    impl->start_stale_check();
+
+    // the first message is the ABI of the state history
+    what = "async_read";
+    in_buffer = make_shared<flat_buffer>();
+    yield impl->stream->async_read(*in_buffer, resume());
+    impl->on_connected(in_buffer);
+
+    for (;;) {
+      while (!impl->check_pause()) {
+        if (impl->aborting)
+          return;
+        what = "async_wait";
+        impl->pause_timer.expires_from_now(boost::posix_time::milliseconds(impl->pause_time_msec));
+        yield impl->pause_timer.async_wait(resume());
+      }
+      impl->pause_time_msec = 0;
+
+      what = "async_read";
+      in_buffer = impl->next_read_buffer(std::move(in_buffer));
+      yield impl->stream->async_read(*in_buffer, resume());
+      if (!impl->process_result(in_buffer))
+        return;
+    }
+  }
+}
+
+#include <boost/asio/unyield.hpp>
+
+
 receiver_plugin::receiver_plugin() : my(new receiver_plugin_impl)
 {
-  assert(receiver_plug == nullptr);
-  receiver_plug = this;
+  chronicle::default_chain().set_receiver(this);
 };
 
 receiver_plugin::~receiver_plugin(){
@@ -1251,10 +3286,25 @@ void receiver_plugin::set_program_options( options_description& cli, options_des
     (RCV_HOST_OPT, bpo::value<string>()->default_value("localhost"), "Host to connect to (nodeos)")
     (RCV_PORT_OPT, bpo::value<string>()->default_value("8080"), "Port to connect to (nodeos state-history plugin)")
     (RCV_DBSIZE_OPT, bpo::value<uint32_t>()->default_value(1024), "database size in MB")
+    (RCV_DB_HUGETLBFS_OPT, bpo::value<string>(),
+     "Directory on a hugetlbfs mount where the state database file is placed")
+    (RCV_DB_HUGE_PAGES_OPT, bpo::value<bool>()->default_value(false),
+     "Request transparent huge pages for the state database mapping")
+    (RCV_DB_PREFAULT_OPT, bpo::value<bool>()->default_value(false),
+     "Fault in all pages of the state database at startup")
+    (RCV_DB_MLOCK_OPT, bpo::value<bool>()->default_value(false),
+     "Lock the state database mapping in memory")
     (RCV_MODE_OPT, bpo::value<string>(), "Receiver mode. Values:\n"
      " scan:          \tread blocks sequentially and export\n"
      " scan-noexport: \tread blocks sequentially without export\n"
-     " interactive:   \trandom access\n")
+     " interactive:   \trandom access\n"
+     " replica:       \tapply the state replicated from a scanner\n")
+    (RCV_CPU_AFFINITY_OPT, bpo::value<string>(),
+     "Pin the receiver, decoder and exporter to a list of CPUs, like 2-5,8")
+    (RCV_NUMA_NODE_OPT, bpo::value<uint32_t>(),
+     "Allocate memory on this NUMA node, and run on its CPUs unless cpu-affinity is set")
+    (RCV_WORKER_THREADS_OPT, bpo::value<uint32_t>()->default_value(2),
+     "Number of threads for background work: ABI warm-up and checkpoints")
     (RCV_EVERY_OPT, bpo::value<uint32_t>()->default_value(10000), "Report current state every N blocks")
     (RCV_MAX_QUEUE_OPT, bpo::value<uint32_t>()->default_value(10000), "Maximum size of appbase priority queue")
     (RCV_SKIP_BLOCK_EVT_OPT, bpo::value<bool>()->default_value(false), "Do not produce BLOCK events")
@@ -1266,23 +3316,80 @@ void receiver_plugin::set_program_options( options_description& cli, options_des
     (RCV_END_BLOCK_OPT, bpo::value<uint32_t>()->default_value(std::numeric_limits<uint32_t>::max()),
      "Stop receiver before this block number")
     (RCV_STALE_DEADLINE_OPT, bpo::value<uint32_t>()->default_value(10000), "Stale socket deadline, msec")
+    (RCV_TRX_INDEX_SIZE_OPT, bpo::value<uint32_t>()->default_value(0),
+     "Transaction ID index size in MB, 0 disables the index")
+    (RCV_ACCOUNT_INDEX_OPT, bpo::value<bool>()->default_value(false),
+     "Maintain the index of blocks where each account was active")
+    (RCV_TIME_INDEX_EVERY_OPT, bpo::value<uint32_t>()->default_value(0),
+     "Record block timestamp in the index every N blocks, 0 disables the index")
+    (RCV_SORT_INTERACTIVE_OPT, bpo::value<bool>()->default_value(false),
+     "Serve interactive requests of equal priority in the order of block numbers")
+    (RCV_PREFETCH_OPT, bpo::value<uint32_t>()->default_value(0),
+     "Fetch up to N blocks ahead of a client reading sequentially in interactive mode, 0 disables prefetch")
+    (RCV_LIVE_RING_BLOCKS_OPT, bpo::value<uint32_t>()->default_value(0),
+     "Share results of last N irreversible blocks with interactive instances, 0 disables the ring")
+    (RCV_LIVE_RING_SIZE_OPT, bpo::value<uint32_t>()->default_value(1024),
+     "Live ring data size in MB")
+    (RCV_ABI_CACHE_OPT, bpo::value<uint32_t>()->default_value(0),
+     "Maximum number of parsed contract ABI kept in memory, 0 for unlimited")
+    (RCV_ABI_WARMUP_OPT, bpo::value<uint32_t>()->default_value(0),
+     "Parse ABI of N most used contracts at startup, 0 disables")
+    (RCV_ABI_LOG_SIZE_OPT, bpo::value<uint32_t>()->default_value(0),
+     "ABI history log size in MB, 0 disables the log")
+    (RCV_CHECKPOINT_EVERY_OPT, bpo::value<uint32_t>()->default_value(0),
+     "Save a checkpoint of the state every N committed blocks, 0 disables checkpoints")
+    (RCV_REPL_LISTEN_OPT, bpo::value<string>(),
+     "Scanning mode: accept replicas on host:port and send them the state of irreversible blocks")
+    (RCV_REPL_MAX_QUEUE_OPT, bpo::value<uint32_t>()->default_value(256),
+     "Maximum size in MB of data waiting to be sent to a replica before it's disconnected")
+    (RCV_REPL_SOURCE_OPT, bpo::value<string>(),
+     "Replica mode: host:port of the scanner that sends the state")
+    (RCV_RELAY_LISTEN_OPT, bpo::value<string>(),
+     "Scanning mode: serve the state history protocol to clients on host:port")
+    (RCV_RELAY_CACHE_OPT, bpo::value<uint32_t>()->default_value(1000),
+     "Number of latest blocks that the relay keeps in memory")
+    ;
+  cli.add_options()
+    (RCV_EXPORT_STATE_OPT, bpo::value<string>(),
+     "Export the state at the last irreversible block into a compressed file and exit")
+    (RCV_IMPORT_STATE_OPT, bpo::value<string>(),
+     "Import the state from an exported file into an empty state database and exit")
     ;
 }
 
 
+static void parse_host_port(const variables_map& options, const char* optname, string& host, string& port) {
+  string value = options.at(optname).as<string>();
+  auto pos = value.rfind(':');
+  if( pos == string::npos || pos == 0 || pos == value.size() - 1 )
+    throw std::runtime_error(string(optname) + " must be specified as host:port");
+  host = value.substr(0, pos);
+  port = value.substr(pos + 1);
+}
+
+
 void receiver_plugin::plugin_initialize( const variables_map& options ) {
   try {
     if( !options.count("data-dir") ) {
       throw std::runtime_error("--data-dir option is required");
     }
 
-    if( !options.count(RCV_MODE_OPT) ) {
+    bool export_state = options.count(RCV_EXPORT_STATE_OPT) > 0;
+    bool import_state = options.count(RCV_IMPORT_STATE_OPT) > 0;
+    if( export_state && import_state ) {
+      throw std::runtime_error("export-state and import-state cannot be used together");
+    }
+
+    if( !options.count(RCV_MODE_OPT) && !export_state && !import_state ) {
       throw std::runtime_error("mode option is required");
     }
 
     my->irreversible_only = options.at(RCV_IRREV_ONLY_OPT).as<bool>();
+    string state_operation_result;
 
-    string receiver_mode = options.at(RCV_MODE_OPT).as<string>();
+    // export reads the database like an interactive instance, and import writes it like a scanner
+    string receiver_mode = export_state ? RCV_MODE_INTERACTIVE :
+      import_state ? RCV_MODE_SCAN_NOEXP : options.at(RCV_MODE_OPT).as<string>();
     if (receiver_mode == RCV_MODE_SCAN) {
       my->noexport_mode = false;
       my->interactive_mode = false;
@@ -1296,14 +3403,59 @@ void receiver_plugin::plugin_initialize( const variables_map& options ) {
       my->interactive_mode = true;
       my->irreversible_only = true;
     }
+    else if (receiver_mode == RCV_MODE_REPLICA) {
+      my->noexport_mode = true;
+      my->interactive_mode = false;
+      my->replica_mode = true;
+    }
+    else {
+      throw std::runtime_error("Unknown receiver mode: " + receiver_mode);
+    }
 
-    ilog("Starting in ${m} mode", ("m", receiver_mode));
+    ilog("Starting in ${m} mode, socket I/O backend: ${b}", ("m", receiver_mode)("b", chronicle::socket_backend()));
+
+    // placed before any large allocation, so that the state database,
+    // buffers and caches are local to the pipeline thread
+    bool numa_placement = false;
+    if( options.count(RCV_NUMA_NODE_OPT) ) {
+      int node = options.at(RCV_NUMA_NODE_OPT).as<uint32_t>();
+      int nodes = chronicle::cpu_placement::numa_nodes();
+      if( node >= nodes )
+        throw std::runtime_error("NUMA node " + std::to_string(node) + " does not exist, the host has " +
+                                 std::to_string(nodes));
+      if( !options.count(RCV_CPU_AFFINITY_OPT) )
+        chronicle::cpu_placement::pin_thread(chronicle::cpu_placement::node_cpus(node));
+      string res = chronicle::cpu_placement::prefer_node(node);
+      if( res != "applied" )
+        wlog("Cannot prefer NUMA node ${n}: ${e}", ("n", node)("e", res));
+      numa_placement = true;
+    }
+    if( options.count(RCV_CPU_AFFINITY_OPT) ) {
+      auto cpus = chronicle::cpu_placement::parse_cpu_list(options.at(RCV_CPU_AFFINITY_OPT).as<string>());
+      if( cpus.empty() )
+        throw std::runtime_error("Empty CPU list in " + string(RCV_CPU_AFFINITY_OPT));
+      chronicle::cpu_placement::pin_thread(cpus);
+    }
+    ilog("Pipeline thread placement: ${p}", ("p", chronicle::cpu_placement::describe()));
+
+    // the worker threads are started later and inherit the placement
+    uint32_t worker_threads = options.at(RCV_WORKER_THREADS_OPT).as<uint32_t>();
+    if( worker_threads == 0 )
+      throw std::runtime_error(string(RCV_WORKER_THREADS_OPT) + " must be a positive integer");
+    chronicle::set_shared_worker_threads(worker_threads);
 
     string dbdir = app().data_dir().native() + "/receiver-state";
     bfs::create_directories(dbdir);
 
     bool new_lock = false;
     string dblock_shm_file = dbdir + "/lock.bin";
+    // an older version may still have the file mapped, and two different
+    // mutexes on the same database would corrupt it
+    if(bfs::exists(dblock_shm_file) && bfs::file_size(dblock_shm_file) != sizeof(chronicle::shmem_lock)) {
+      elog("Lock file ${f} has the layout of an older version. Stop all Chronicle processes "
+           "that use this data directory, delete the file, and start them again", ("f", dblock_shm_file));
+      throw std::runtime_error("Incompatible lock file " + dblock_shm_file);
+    }
     if(!bfs::exists(dblock_shm_file)) {
       std::ofstream ofs(dblock_shm_file, std::ofstream::trunc);
       ofs.close();
@@ -1325,26 +3477,228 @@ void receiver_plugin::plugin_initialize( const variables_map& options ) {
       my->dblock = static_cast<chronicle::shmem_lock*>(dblock_addr);
     }
 
+    chronicle::mapped_memory::options mapopts;
+    mapopts.huge_pages = options.at(RCV_DB_HUGE_PAGES_OPT).as<bool>();
+    mapopts.prefault = options.at(RCV_DB_PREFAULT_OPT).as<bool>();
+    mapopts.lock = options.at(RCV_DB_MLOCK_OPT).as<bool>();
+    mapopts.numa = numa_placement;
+    if( mapopts.prefault || mapopts.lock ) {
+      // the lock is touched on every block, so it gets the same treatment, except huge pages
+      chronicle::mapped_memory::options lockopts = mapopts;
+      lockopts.huge_pages = false;
+      auto res = chronicle::mapped_memory::apply(dblock_addr, sizeof(chronicle::shmem_lock), lockopts);
+      ilog("Lock mapping: ${r}", ("r", res.to_string()));
+    }
+
+    uint64_t db_size = options.at(RCV_DBSIZE_OPT).as<uint32_t>() * 1024ull*1024ull;
+    string db_file = dbdir + "/shared_memory.bin";
+    string db_target = db_file; // the file that is deleted when the database is recovered
+    bool hugetlbfs_lost = false;
+    if( options.count(RCV_DB_HUGETLBFS_OPT) && !my->interactive_mode ) {
+      // the database file is a symlink to hugetlbfs, so interactive readers find it at the usual place
+      string hugedir = options.at(RCV_DB_HUGETLBFS_OPT).as<string>();
+      uint64_t huge_page = chronicle::mapped_memory::hugetlbfs_page_size(hugedir);
+      if( huge_page == 0 )
+        throw std::runtime_error(hugedir + " is not on a hugetlbfs mount");
+      db_target = hugedir + "/shared_memory.bin";
+      if( bfs::is_symlink(db_file) ) {
+        if( bfs::read_symlink(db_file).string() != db_target )
+          throw std::runtime_error(db_file + " points to " + bfs::read_symlink(db_file).string() +
+                                   ", not to " + db_target);
+      }
+      else if( bfs::exists(db_file) ) {
+        throw std::runtime_error("State database is a regular file. It can be moved to hugetlbfs "
+                                 "by exporting it and importing into a new data directory");
+      }
+      else {
+        bfs::create_symlink(db_target, db_file);
+      }
+      if( db_size % huge_page != 0 ) {
+        db_size = (db_size / huge_page + 1) * huge_page;
+        ilog("State database size is rounded up to ${s} MB for huge pages", ("s", db_size/(1024*1024)));
+      }
+      hugetlbfs_lost = !bfs::exists(db_target);
+      ilog("State database is placed on hugetlbfs at ${f}, page size ${p} kB", ("f",db_target)("p",huge_page/1024));
+    }
+
     {
-      bip::scoped_lock<bip::interprocess_mutex> lock(my->dblock->mutex);
+      bip::scoped_lock<bip::interprocess_sharable_mutex> lock(my->dblock->mutex);
       if (my->interactive_mode) {
         my->db = std::make_shared<chainbase::database>(dbdir, chainbase::database::read_only, 0, true);
       }
       else {
-        my->db = std::make_shared<chainbase::database>
-          (dbdir, chainbase::database::read_write,
-           options.at(RCV_DBSIZE_OPT).as<uint32_t>() * 1024*1024);
+        my->checkpoint_file = dbdir + "/checkpoint.bin";
+        my->checkpoint_delta_file = dbdir + "/checkpoint-delta.bin";
+        try {
+          my->db = std::make_shared<chainbase::database>(dbdir, chainbase::database::read_write, db_size);
+          // hugetlbfs content does not survive a reboot
+          if( hugetlbfs_lost && chronicle::state_file_exists(my->checkpoint_file) ) {
+            wlog("State database is missing on hugetlbfs, recovering it from ${f}", ("f", my->checkpoint_file));
+            my->restored_from_checkpoint = true;
+          }
+        }
+        catch( const std::exception& e ) {
+          if( string(e.what()).find("dirty") == string::npos || !chronicle::state_file_exists(my->checkpoint_file) )
+            throw;
+          wlog("State database is dirty, recovering it from ${f}", ("f", my->checkpoint_file));
+          bfs::remove(db_target);
+          bfs::remove(dbdir + "/shared_memory.meta");
+          my->db = std::make_shared<chainbase::database>(dbdir, chainbase::database::read_write, db_size);
+          my->restored_from_checkpoint = true;
+        }
       }
 
       my->db->add_index<chronicle::state_index>();
       my->db->add_index<chronicle::received_block_index>();
       my->db->add_index<chronicle::contract_abi_index>();
       my->db->add_index<chronicle::contract_abi_hist_index>();
+      my->db->add_index<chronicle::account_activity_index>();
+
+      if( my->restored_from_checkpoint ) {
+        chronicle::state_file_reader reader(my->checkpoint_file);
+        my->last_checkpoint = my->read_receiver_state(reader);
+        try {
+          chronicle::checkpoint_delta delta;
+          if( chronicle::read_checkpoint_delta(my->checkpoint_delta_file, my->last_checkpoint, delta) )
+            my->last_checkpoint = my->apply_checkpoint_delta(delta);
+        }
+        catch( const std::exception& e ) {
+          wlog("Cannot use ${f}, continuing from the full checkpoint: ${e}",
+               ("f", my->checkpoint_delta_file)("e", e.what()));
+        }
+      }
+
+      if( import_state ) {
+        string file = options.at(RCV_IMPORT_STATE_OPT).as<string>();
+        ilog("Importing state from ${f}", ("f", file));
+        // checkpoints of a previous database must not be combined with the imported state
+        bfs::remove(my->checkpoint_file);
+        bfs::remove(my->checkpoint_delta_file);
+        chronicle::state_file_reader reader(file);
+        uint32_t block_num = my->read_receiver_state(reader);
+        state_operation_result = "Imported state at block " + to_string(block_num) +
+          ", scanning will continue from block " + to_string(block_num + 1);
+      }
+    }
+
+    if( export_state ) {
+      string file = options.at(RCV_EXPORT_STATE_OPT).as<string>();
+      state_operation_result = my->export_receiver_state(file);
+    }
+
+    if( !state_operation_result.empty() ) {
+      my->db.reset();
+      throw chronicle::state_operation_finished(state_operation_result);
+    }
+
+    {
+      // prefaulting may take a while, so it's done without holding the lock
+      auto segment = my->db->get_segment_manager();
+      auto res = chronicle::mapped_memory::apply(segment, segment->get_size(), mapopts);
+      ilog("State database mapping: ${r}", ("r", res.to_string()));
+    }
+
+    my->checkpoint_every = options.at(RCV_CHECKPOINT_EVERY_OPT).as<uint32_t>();
+    if( my->checkpoint_every > 0 && !my->interactive_mode ) {
+      ilog("Saving a state checkpoint every ${n} blocks", ("n",my->checkpoint_every));
+      my->start_checkpoints();
+    }
+
+    if( my->replica_mode ) {
+      if( !options.count(RCV_REPL_SOURCE_OPT) )
+        throw std::runtime_error("replication-source is required in replica mode");
+      parse_host_port(options, RCV_REPL_SOURCE_OPT, my->repl_source_host, my->repl_source_port);
+      ilog("Replicating the state from ${h}:${p}", ("h",my->repl_source_host)("p",my->repl_source_port));
+    }
+    if( options.count(RCV_REPL_LISTEN_OPT) ) {
+      if( my->interactive_mode || my->replica_mode )
+        throw std::runtime_error("replication-listen can only be used in scanning modes");
+      parse_host_port(options, RCV_REPL_LISTEN_OPT, my->repl_listen_host, my->repl_listen_port);
+      uint64_t max_queue = options.at(RCV_REPL_MAX_QUEUE_OPT).as<uint32_t>() * 1024ull*1024ull;
+      my->repl_server = std::make_unique<chronicle::replication_server>
+        (app().get_io_service(), my->stream_priority, max_queue,
+         [impl=my.get()](uint32_t after_block, uint32_t up_to_block) {
+          return impl->replication_catchup(after_block, up_to_block);
+        });
+    }
+
+    if( options.count(RCV_RELAY_LISTEN_OPT) ) {
+      if( my->interactive_mode || my->replica_mode )
+        throw std::runtime_error("relay-listen can only be used in scanning modes");
+      parse_host_port(options, RCV_RELAY_LISTEN_OPT, my->relay_listen_host, my->relay_listen_port);
+      uint32_t cache_blocks = options.at(RCV_RELAY_CACHE_OPT).as<uint32_t>();
+      if( cache_blocks == 0 )
+        throw std::runtime_error("relay-cache-blocks cannot be zero");
+      // older blocks are served from the live ring, if it's enabled
+      my->relay = std::make_unique<chronicle::ship_relay>
+        (app().get_io_service(), my->stream_priority, cache_blocks,
+         [impl=my.get()](uint32_t block_num, string& out) {
+          return impl->live_ring && impl->live_ring->get(block_num, out);
+        },
+         [impl=my.get()]() {
+          return impl->live_ring ? impl->live_ring->first_block() : 0;
+        });
+    }
+
+    string trx_index_file = dbdir + "/trx-index.bin";
+    uint32_t trx_index_size = options.at(RCV_TRX_INDEX_SIZE_OPT).as<uint32_t>();
+    if (my->interactive_mode) {
+      if( chronicle::trx_index::exists(trx_index_file) )
+        my->trx_idx = std::make_unique<chronicle::trx_index>(trx_index_file, false, 0);
+    }
+    else if( trx_index_size > 0 && !my->replica_mode ) {
+      my->trx_idx = std::make_unique<chronicle::trx_index>(trx_index_file, true, trx_index_size);
+    }
+
+    string time_index_file = dbdir + "/time-index.bin";
+    my->time_index_every = options.at(RCV_TIME_INDEX_EVERY_OPT).as<uint32_t>();
+    if (my->interactive_mode) {
+      if( chronicle::time_index::exists(time_index_file) )
+        my->time_idx = std::make_unique<chronicle::time_index>(time_index_file, false);
+    }
+    else if( my->time_index_every > 0 && !my->replica_mode ) {
+      my->time_idx = std::make_unique<chronicle::time_index>(time_index_file, true);
+      ilog("Recording block timestamps every ${n} blocks", ("n",my->time_index_every));
+    }
+
+    string live_ring_file = dbdir + "/live-ring.bin";
+    uint32_t live_ring_blocks = options.at(RCV_LIVE_RING_BLOCKS_OPT).as<uint32_t>();
+    if (my->interactive_mode) {
+      if( chronicle::live_ring::exists(live_ring_file) )
+        my->live_ring = std::make_unique<chronicle::live_ring>(live_ring_file, false);
+    }
+    else if( live_ring_blocks > 0 && !my->replica_mode ) {
+      uint64_t live_ring_size = options.at(RCV_LIVE_RING_SIZE_OPT).as<uint32_t>() * 1024ull*1024ull;
+      my->live_ring = std::make_unique<chronicle::live_ring>(live_ring_file, true, live_ring_blocks, live_ring_size);
+    }
+
+    string abi_log_file = dbdir + "/abi-history.log";
+    uint32_t abi_log_size = options.at(RCV_ABI_LOG_SIZE_OPT).as<uint32_t>();
+    if (my->interactive_mode) {
+      if( chronicle::abi_log::exists(abi_log_file) )
+        my->abi_log = std::make_unique<chronicle::abi_log>(abi_log_file, false, 0);
     }
+    else if( abi_log_size > 0 ) {
+      my->abi_log = std::make_unique<chronicle::abi_log>(abi_log_file, true, abi_log_size);
+    }
+
+    my->abi_cache_max = options.at(RCV_ABI_CACHE_OPT).as<uint32_t>();
+    if( my->abi_cache_max > 0 )
+      ilog("Keeping up to ${n} parsed contract ABI in memory", ("n",my->abi_cache_max));
+
+    my->abi_warmup_max = options.at(RCV_ABI_WARMUP_OPT).as<uint32_t>();
+    my->abi_usage_file = dbdir + (my->interactive_mode ? "/abi-usage-interactive.txt" : "/abi-usage.txt");
+
+    my->sort_interactive_ranges = options.at(RCV_SORT_INTERACTIVE_OPT).as<bool>();
+    my->prefetch_blocks = options.at(RCV_PREFETCH_OPT).as<uint32_t>();
+
+    my->account_index = options.at(RCV_ACCOUNT_INDEX_OPT).as<bool>();
+    if( my->account_index && !my->interactive_mode )
+      ilog("Maintaining account activity index");
 
     my->resolver = std::make_shared<tcp::resolver>(std::ref(app().get_io_service()));
 
-    my->stream = std::make_shared<websocket::stream<tcp::socket>>(std::ref(app().get_io_service()));
+    my->stream = std::make_shared<websocket::stream<chronicle::counted_socket>>(std::ref(app().get_io_service()));
     my->stream->binary(true);
     my->stream->read_message_max(10ull * 1ull<<30);
 
@@ -1386,6 +3740,9 @@ void receiver_plugin::plugin_initialize( const variables_map& options ) {
     my->init();
     ilog("Initialized receiver_plugin");
   }
+  catch( const chronicle::state_operation_finished& ) {
+    throw;
+  }
   FC_LOG_AND_RETHROW();
 }
 
@@ -1423,6 +3780,12 @@ void receiver_plugin::plugin_startup(){
 
 
 void receiver_plugin::plugin_shutdown() {
+  if( my ) {
+    my->abi_warmup_tasks.reset();
+    if( my->checkpoints )
+      my->checkpoints->stop();
+    my->save_abi_usage();
+  }
   ilog("receiver_plugin stopped");
 }
 
@@ -1468,7 +3831,7 @@ void receiver_plugin::slowdown(bool pause) {
 
 abieos_context* receiver_plugin::get_contract_abi_ctxt(abieos::name account) {
   my->get_contract_abi_ready(account, true);
-  return my->contract_abi_ctxt;
+  return my->get_contract_abi_ctxt(account.value);
 }
 
 
@@ -1484,36 +3847,56 @@ void receiver_plugin::abort_receiver() {
 }
 
 
+// state export and import are standalone operations that do not need a mode
+static bool is_state_operation_opt(const variables_map& options)
+{
+  return options.count(RCV_EXPORT_STATE_OPT) > 0 || options.count(RCV_IMPORT_STATE_OPT) > 0;
+}
+
+
 bool is_noexport_opt(const variables_map& options)
 {
+  if( is_state_operation_opt(options) )
+    return true;
   if( !options.count(RCV_MODE_OPT) ) {
     throw std::runtime_error("mode option is required");
   }
-  return (options.at(RCV_MODE_OPT).as<string>() == RCV_MODE_SCAN_NOEXP);
+  string mode = options.at(RCV_MODE_OPT).as<string>();
+  return (mode == RCV_MODE_SCAN_NOEXP || mode == RCV_MODE_REPLICA);
 }
 
 
-static bool have_exporter = false;
+bool is_interactive_opt(const variables_map& options)
+{
+  if( is_state_operation_opt(options) )
+    return false;
+  if( !options.count(RCV_MODE_OPT) ) {
+    throw std::runtime_error("mode option is required");
+  }
+  return (options.at(RCV_MODE_OPT).as<string>() == RCV_MODE_INTERACTIVE);
+}
 
-void exporter_initialized() {
-  if( have_exporter )
-    throw runtime_error("Only one exporter plugin is allowed");
-  have_exporter = true;
+
+chronicle::chain_instance& chronicle::default_chain() {
+  static chain_instance chain;
+  return chain;
 }
 
-receiver_plugin* receiver_plug = nullptr;
+void exporter_initialized() {
+  chronicle::default_chain().add_exporter();
+}
 
 void exporter_will_ack_blocks(uint32_t max_unconfirmed)
 {
-  receiver_plug->exporter_will_ack_blocks(max_unconfirmed);
+  chronicle::default_chain().receiver()->exporter_will_ack_blocks(max_unconfirmed);
 }
 
 // receiver should not start collecting data before all dependent plugins are ready
 void donot_start_receiver_before(appbase::abstract_plugin* plug, string plugname) {
-  receiver_plug->add_dependency(plug, plugname);
+  chronicle::default_chain().receiver()->add_dependency(plug, plugname);
 }
 
 void abort_receiver() {
-  receiver_plug->abort_receiver();
+  chronicle::default_chain().receiver()->abort_receiver();
   app().quit();
 }
@@ -1,14 +1,21 @@
 #include <appbase/application.hpp>
 #include "chain_state_types.hpp"
+#include "chain_instance.hpp"
 #include "state_history.hpp"
 #include <abieos.h>
 #include <boost/beast/core/flat_buffer.hpp>
+#include <map>
+#include <memory>
 
 using namespace appbase;
 using boost::beast::flat_buffer;
 
 namespace chronicle {
 
+  namespace specialized_decoders {
+    struct decoder_set;
+  }
+
   // Channels published by receiver_plugin
 
   namespace channels {
@@ -82,11 +89,29 @@ namespace chronicle {
     using block_table_deltas  =
       channel_decl<struct block_table_deltas_tag, std::shared_ptr<block_table_delta>>;
 
+    struct contract_abi {
+      std::shared_ptr<abieos_context>                            ctxt;
+      std::shared_ptr<const specialized_decoders::decoder_set>  specialized; // may be empty
+    };
+
+    // Parsed ABI of contracts referenced by a block, resolved by the
+    // receiver at once, so that decoding does not need the state database
+    struct block_abis {
+      std::map<uint64_t, contract_abi>  contracts;
+
+      // returns nullptr if the contract had no usable ABI
+      const contract_abi* get(abieos::name account) const {
+        auto itr = contracts.find(account.value);
+        return (itr != contracts.end()) ? &itr->second : nullptr;
+      }
+    };
+
     struct transaction_trace {
       uint32_t                                 block_num;
       abieos::block_timestamp                  block_timestamp;
       state_history::transaction_trace         trace;
       std::shared_ptr<flat_buffer>             buffer;
+      std::shared_ptr<block_abis>              abis;
     };
 
     template <typename F>
@@ -155,6 +180,7 @@ namespace chronicle {
       bool                                     added; // false==removed
       chain_state::key_value_object            kvo;
       std::shared_ptr<flat_buffer>             buffer;
+      std::shared_ptr<block_abis>              abis;
     };
 
     template <typename F>
@@ -253,13 +279,71 @@ namespace chronicle {
 
     using block_completed = channel_decl<struct block_completed_tag, std::shared_ptr<block_finished>>;
 
+    struct interactive_range {
+      uint32_t                        block_num_start = 0;
+      uint32_t                        block_num_end = 0;
+      std::optional<abieos::checksum256>  trx_id; // if set, the block is looked up in transaction index
+      std::optional<abieos::name>         account; // if set, only blocks where the account was active
+      std::optional<abieos::block_timestamp> time_start; // if set, the block range is looked up in timestamp index
+      std::optional<abieos::block_timestamp> time_end;
+    };
+
     struct interactive_request {
-      uint32_t                        block_num_start;
-      uint32_t                        block_num_end;
+      uint32_t                        client_id = 0; // exporter connection that sent the request
+      uint32_t                        req_id = 0; // if non-zero, the output is tagged with request ID
+      std::vector<interactive_range>  ranges;
+      bool                            fetch_block = true;
+      bool                            fetch_traces = true;
+      bool                            fetch_deltas = true;
+      std::set<uint64_t>              accounts; // if not empty, only export data related to these accounts
+      uint32_t                        priority = 0; // requests with higher priority are served first
+      bool                            cancel = false; // cancel a previous request with the same ID, or all
+                                                      // requests of the client if req_id is zero
     };
 
     using interactive_requests = channel_decl<struct interactive_requests_tag, std::shared_ptr<interactive_request>>;
+
+    enum class interactive_status_val : uint8_t {
+      started   = 1, // output of the request follows
+      finished  = 2, // all ranges of the request are exported
+      cancelled = 3, // request is cancelled by the client
+      failed    = 4, // request cannot be served
+      suspended = 5, // output is interrupted until the request is started again
+    };
+
+    inline string to_string(interactive_status_val status) {
+      switch (status) {
+      case interactive_status_val::started:   return "started";
+      case interactive_status_val::finished:  return "finished";
+      case interactive_status_val::cancelled: return "cancelled";
+      case interactive_status_val::failed:    return "failed";
+      case interactive_status_val::suspended: return "suspended";
+      }
+      return "unknown";
+    }
+
+    struct interactive_status {
+      uint32_t                        client_id;
+      uint32_t                        req_id;
+      interactive_status_val          status;
+      string                          error;
+    };
+
+    template <typename F>
+    constexpr void for_each_field(interactive_status*, F f) {
+      f("req_id", member_ptr<&interactive_status::req_id>{});
+      f("status", member_ptr<&interactive_status::status>{});
+      f("error", member_ptr<&interactive_status::error>{});
+    }
+
+    using interactive_statuses = channel_decl<struct interactive_statuses_tag, std::shared_ptr<interactive_status>>;
   }
+
+  // thrown by plugin_initialize after a state export or import is finished,
+  // so that the program exits without starting the plugins
+  struct state_operation_finished : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
 }
 
 
@@ -294,34 +378,34 @@ private:
 // Global functions
 
 bool is_noexport_opt(const variables_map& options);
-
-extern receiver_plugin* receiver_plug;
+bool is_interactive_opt(const variables_map& options);
 
 void exporter_initialized();
 
 inline bool is_interactive_mode() {
-  return receiver_plug->is_interactive();
+  return chronicle::default_chain().receiver()->is_interactive();
 }
 
 inline bool is_noexport_mode() {
-  return receiver_plug->is_noexport();
+  return chronicle::default_chain().receiver()->is_noexport();
 }
 
 
 void exporter_will_ack_blocks(uint32_t max_unconfirmed);
 
 inline void ack_block(uint32_t block_num) {
-  receiver_plug->ack_block(block_num);
+  chronicle::default_chain().receiver()->ack_block(block_num);
 }
 
 inline void slowdown_receiver(bool pause) {
-  receiver_plug->slowdown(pause);
+  chronicle::default_chain().receiver()->slowdown(pause);
 }
 
 
 void donot_start_receiver_before(appbase::abstract_plugin* plug, string plugname);
 void abort_receiver();
 
+// returns nullptr if the contract has no usable ABI at the current block
 inline abieos_context* get_contract_abi_ctxt(abieos::name account) {
-  return receiver_plug->get_contract_abi_ctxt(account);
+  return chronicle::default_chain().receiver()->get_contract_abi_ctxt(account);
 }
@@ -0,0 +1,406 @@
+// copyright defined in LICENSE.txt
+
+#include "replication.hpp"
+
+#include <appbase/application.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <cstring>
+#include <stdexcept>
+#include <fc/log/logger.hpp>
+
+using boost::system::error_code;
+using boost::asio::ip::tcp;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "replication messages are sent in little-endian order");
+
+namespace chronicle {
+
+  static const uint64_t REPLICATION_MAGIC = 0x314c504552524843ull; // "CHRREPL1"
+
+  // larger messages are considered a protocol error
+  static const uint32_t REPLICATION_MAX_MSG = 256*1024*1024;
+
+  static const size_t REPLICATION_READ_SIZE = 1024*1024;
+
+
+  namespace replication {
+
+    static void put_u8(std::string& out, uint8_t v) {
+      out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    static void put_u32(std::string& out, uint32_t v) {
+      out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    static void put_u64(std::string& out, uint64_t v) {
+      out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    static std::string frame(uint8_t type, uint64_t account, uint32_t block_num, const char* data, size_t size) {
+      std::string out;
+      out.reserve(4 + 13 + size);
+      put_u32(out, 13 + size);
+      put_u8(out, type);
+      put_u64(out, account);
+      put_u32(out, block_num);
+      out.append(data, size);
+      return out;
+    }
+
+    std::string encode_abi_history(uint64_t account, uint32_t block_num, const char* data, size_t size) {
+      return frame(repl_abi_history, account, block_num, data, size);
+    }
+
+    std::string encode_account_activity(uint64_t account, uint32_t block_num) {
+      return frame(repl_account_activity, account, block_num, nullptr, 0);
+    }
+
+    std::string encode_activity_chunk(uint64_t account, uint32_t chunk, const char* data, size_t size) {
+      return frame(repl_activity_chunk, account, chunk, data, size);
+    }
+
+    std::string encode_irreversible(uint32_t block_num, const char* block_id) {
+      return frame(repl_irreversible, 0, block_num, block_id, 32);
+    }
+
+    void decode(const char* data, size_t size, replication_message& msg) {
+      if( size < 13 )
+        throw std::runtime_error("Replication message is too short");
+      uint8_t type = data[0];
+      if( type < repl_abi_history || type > repl_irreversible )
+        throw std::runtime_error("Unknown replication message type " + std::to_string(type));
+      msg.type = static_cast<replication_msg_type>(type);
+      memcpy(&msg.account, data + 1, sizeof(msg.account));
+      memcpy(&msg.block_num, data + 9, sizeof(msg.block_num));
+      msg.data.assign(data + 13, size - 13);
+      if( msg.type == repl_irreversible && msg.data.size() != 32 )
+        throw std::runtime_error("Invalid irreversible block marker");
+    }
+  }
+
+
+  replication_server::replication_server(boost::asio::io_service& ios, int priority, uint64_t max_queue_bytes,
+                                         catchup_fn catchup) :
+    _ios(ios),
+    _priority(priority),
+    _max_queue_bytes(max_queue_bytes),
+    _catchup(catchup)
+  {}
+
+
+  void replication_server::listen(const std::string& host, const std::string& port,
+                                  uint32_t flushed_block, const char* flushed_id) {
+    _flushed_block = flushed_block;
+    _flushed_id.assign(flushed_id, 32);
+    auto address = boost::asio::ip::make_address(host);
+    tcp::endpoint endpoint(address, std::stoul(port));
+    _acceptor = std::make_shared<tcp::acceptor>(_ios);
+    _acceptor->open(endpoint.protocol());
+    _acceptor->set_option(boost::asio::socket_base::reuse_address(true));
+    _acceptor->bind(endpoint);
+    _acceptor->listen();
+    ilog("Listening for replicas on ${h}:${p}", ("h",host)("p",port));
+    async_accept();
+  }
+
+
+  void replication_server::async_accept() {
+    auto s = std::make_shared<session>(_ios);
+    _acceptor->async_accept
+      (s->socket,
+       appbase::app().get_priority_queue().wrap(_priority, [this, s](error_code ec) {
+           if( ec ) {
+             if( ec != boost::asio::error::operation_aborted )
+               elog("Error accepting replica: ${e}", ("e",ec.message()));
+             return;
+           }
+           s->id = _next_session_id++;
+           s->socket.set_option(tcp::no_delay(true));
+           read_handshake(s);
+           async_accept();
+         }));
+  }
+
+
+  void replication_server::read_handshake(std::shared_ptr<session> s) {
+    boost::asio::async_read
+      (s->socket, boost::asio::buffer(s->handshake, sizeof(s->handshake)),
+       appbase::app().get_priority_queue().wrap(_priority, [this, s](error_code ec, size_t) {
+           uint64_t magic;
+           uint32_t last_block;
+           memcpy(&magic, s->handshake, sizeof(magic));
+           memcpy(&last_block, s->handshake + sizeof(magic), sizeof(last_block));
+           if( ec || magic != REPLICATION_MAGIC ) {
+             elog("Replica ${c} failed the handshake", ("c",s->id));
+             error_code cec;
+             s->socket.close(cec);
+             return;
+           }
+
+           error_code epec;
+           auto endpoint = s->socket.remote_endpoint(epec);
+           ilog("Replica ${c} connected from ${a} at block ${b}, sending blocks up to ${f}",
+                ("c",s->id)("a",endpoint.address().to_string())("b",last_block)("f",_flushed_block));
+
+           // the marker goes after the last batch, and live messages are queued from now on
+           auto marker = std::make_shared<const std::string>
+             (replication::encode_irreversible(_flushed_block, _flushed_id.data()));
+           if( last_block < _flushed_block ) {
+             s->catchup = _catchup(last_block, _flushed_block);
+             s->catchup_marker = marker;
+           }
+           else {
+             s->catchup_queue.push_back(marker);
+           }
+           _sessions[s->id] = s;
+           write(s);
+         }));
+  }
+
+
+  void replication_server::add(uint32_t block_num, std::string&& msg) {
+    // the block was replayed after a restart
+    if( block_num <= _flushed_block )
+      return;
+    _pending.push_back(pending_msg{block_num, std::make_shared<const std::string>(std::move(msg))});
+  }
+
+
+  void replication_server::rollback(uint32_t block_num) {
+    while( !_pending.empty() && _pending.back().block_num >= block_num )
+      _pending.pop_back();
+  }
+
+
+  void replication_server::flush(uint32_t irreversible, const char* irreversible_id) {
+    if( irreversible <= _flushed_block )
+      return;
+    while( !_pending.empty() && _pending.front().block_num <= irreversible ) {
+      broadcast(_pending.front().msg);
+      _pending.pop_front();
+    }
+    _flushed_block = irreversible;
+    _flushed_id.assign(irreversible_id, 32);
+    broadcast(std::make_shared<const std::string>(replication::encode_irreversible(irreversible, irreversible_id)));
+  }
+
+
+  void replication_server::enqueue(std::shared_ptr<session> s, msgptr msg) {
+    s->queue_bytes += msg->size();
+    s->queue.push_back(msg);
+  }
+
+
+  void replication_server::broadcast(msgptr msg) {
+    if( _sessions.empty() )
+      return;
+    auto all_sessions = _sessions;
+    for( auto& item : all_sessions ) {
+      auto& s = item.second;
+      enqueue(s, msg);
+      // the catch-up data is not counted against the limit
+      if( s->queue_bytes > _max_queue_bytes ) {
+        // the replica will reconnect and catch up from the state database
+        wlog("Replica ${c} is too slow, ${b} bytes in queue. Disconnecting", ("c",s->id)("b",s->queue_bytes));
+        _dropped++;
+        close(s);
+        continue;
+      }
+      write(s);
+    }
+  }
+
+
+  // The next batch is requested only after the previous one is written, so
+  // the state database is read at the pace of the replica. Returns false if
+  // there is nothing to write yet.
+  bool replication_server::next_catchup_batch(std::shared_ptr<session> s) {
+    std::vector<std::string> messages;
+    bool more;
+    try {
+      more = s->catchup(messages);
+    }
+    catch( const std::exception& e ) {
+      elog("Cannot read catch-up data for replica ${c}: ${e}", ("c",s->id)("e",e.what()));
+      close(s);
+      return false;
+    }
+    for( auto& m : messages )
+      s->catchup_queue.push_back(std::make_shared<const std::string>(std::move(m)));
+    if( !more ) {
+      s->catchup = nullptr;
+      s->catchup_queue.push_back(s->catchup_marker);
+      s->catchup_marker.reset();
+    }
+
+    if( s->catchup_queue.empty() ) {
+      // the batch had nothing to send, so other handlers get their turn before the next one
+      boost::asio::post(_ios, appbase::app().get_priority_queue().wrap(_priority, [this, s]() {
+            write(s);
+          }));
+      return false;
+    }
+    return true;
+  }
+
+
+  void replication_server::write(std::shared_ptr<session> s) {
+    if( s->writing || s->closed )
+      return;
+    if( s->catchup_queue.empty() && s->catchup && !next_catchup_batch(s) )
+      return;
+
+    // catch-up batches go before the live messages
+    bool catchup = !s->catchup_queue.empty();
+    auto& source = catchup ? s->catchup_queue : s->queue;
+    if( source.empty() )
+      return;
+    s->writing = true;
+    // everything in the queue goes out in one write
+    std::vector<boost::asio::const_buffer> buffers;
+    s->in_flight.assign(source.begin(), source.end());
+    source.clear();
+    for( auto& m : s->in_flight )
+      buffers.emplace_back(m->data(), m->size());
+    boost::asio::async_write
+      (s->socket, buffers,
+       appbase::app().get_priority_queue().wrap(_priority, [this, s, catchup](error_code ec, size_t written) {
+           s->writing = false;
+           s->in_flight.clear();
+           if( ec ) {
+             if( !s->closed )
+               elog("Error writing to replica ${c}: ${e}", ("c",s->id)("e",ec.message()));
+             close(s);
+             return;
+           }
+           if( !catchup )
+             s->queue_bytes -= written;
+           _bytes_sent += written;
+           write(s);
+         }));
+  }
+
+
+  void replication_server::close(std::shared_ptr<session> s) {
+    if( s->closed )
+      return;
+    s->closed = true;
+    s->queue.clear();
+    s->catchup = nullptr;
+    s->catchup_queue.clear();
+    s->catchup_marker.reset();
+    _sessions.erase(s->id);
+    ilog("Replica ${c} disconnected", ("c",s->id));
+    error_code ec;
+    s->socket.close(ec);
+  }
+
+
+  replication_client::replication_client(boost::asio::io_service& ios, int priority,
+                                         messages_fn on_messages, error_fn on_error) :
+    _ios(ios),
+    _priority(priority),
+    _on_messages(on_messages),
+    _on_error(on_error),
+    _buffer(REPLICATION_READ_SIZE)
+  {}
+
+
+  void replication_client::connect(const std::string& host, const std::string& port, uint32_t last_block) {
+    _resolver = std::make_shared<tcp::resolver>(_ios);
+    _socket = std::make_shared<tcp::socket>(_ios);
+    _resolver->async_resolve
+      (host, port,
+       appbase::app().get_priority_queue().wrap(_priority, [this, host, port, last_block]
+                                                (error_code ec, tcp::resolver::results_type results) {
+           if( ec )
+             return fail("resolve", ec.message());
+           boost::asio::async_connect
+             (*_socket, results.begin(), results.end(),
+              appbase::app().get_priority_queue().wrap(_priority, [this, host, port, last_block]
+                                                       (error_code ec, auto&) {
+                  if( ec )
+                    return fail("connect", ec.message());
+                  _socket->set_option(tcp::no_delay(true));
+                  ilog("Connected to replication source ${h}:${p}, requesting blocks after ${b}",
+                       ("h",host)("p",port)("b",last_block));
+                  auto handshake = std::make_shared<std::string>();
+                  handshake->append(reinterpret_cast<const char*>(&REPLICATION_MAGIC), sizeof(REPLICATION_MAGIC));
+                  handshake->append(reinterpret_cast<const char*>(&last_block), sizeof(last_block));
+                  boost::asio::async_write
+                    (*_socket, boost::asio::buffer(*handshake),
+                     appbase::app().get_priority_queue().wrap(_priority, [this, handshake](error_code ec, size_t) {
+                         if( ec )
+                           return fail("handshake", ec.message());
+                         read();
+                       }));
+                }));
+         }));
+  }
+
+
+  void replication_client::read() {
+    if( _buffer.size() - _buffered < REPLICATION_READ_SIZE )
+      _buffer.resize(_buffered + REPLICATION_READ_SIZE);
+    _socket->async_read_some
+      (boost::asio::buffer(_buffer.data() + _buffered, _buffer.size() - _buffered),
+       appbase::app().get_priority_queue().wrap(_priority, [this](error_code ec, size_t size) {
+           if( ec )
+             return fail("read", ec.message());
+           _buffered += size;
+           _bytes_received += size;
+
+           // all complete messages in the buffer are handled together
+           std::vector<replication_message> messages;
+           size_t pos = 0;
+           try {
+             while( _buffered - pos >= sizeof(uint32_t) ) {
+               uint32_t msg_size;
+               memcpy(&msg_size, _buffer.data() + pos, sizeof(msg_size));
+               if( msg_size > REPLICATION_MAX_MSG )
+                 throw std::runtime_error("Replication message is too large: " + std::to_string(msg_size));
+               if( _buffered - pos - sizeof(uint32_t) < msg_size )
+                 break;
+               messages.emplace_back();
+               replication::decode(_buffer.data() + pos + sizeof(uint32_t), msg_size, messages.back());
+               pos += sizeof(uint32_t) + msg_size;
+             }
+             if( !messages.empty() )
+               _on_messages(messages);
+           }
+           catch( const std::exception& e ) {
+             return fail("apply", e.what());
+           }
+
+           if( _closed )
+             return;
+           memmove(_buffer.data(), _buffer.data() + pos, _buffered - pos);
+           _buffered -= pos;
+           // a large message stays in a larger buffer only until it is handled
+           if( _buffered < REPLICATION_READ_SIZE && _buffer.size() > 2 * REPLICATION_READ_SIZE )
+             _buffer.resize(2 * REPLICATION_READ_SIZE);
+           read();
+         }));
+  }
+
+
+  void replication_client::close() {
+    _closed = true;
+    if( _socket && _socket->is_open() ) {
+      error_code ec;
+      _socket->close(ec);
+    }
+  }
+
+
+  void replication_client::fail(const std::string& what, const std::string& error) {
+    if( _closed )
+      return;
+    close();
+    _on_error(what + ": " + error);
+  }
+}
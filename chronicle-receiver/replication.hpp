@@ -0,0 +1,155 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace chronicle {
+
+  // Replication of the receiver state from a scanner to replicas on other
+  // hosts. Only the data of irreversible blocks is sent, so a replica never
+  // needs to roll back: the scanner keeps the messages of each block until
+  // it becomes irreversible, and then sends them to all replicas followed
+  // by an irreversible block marker. A replica connects with the last
+  // irreversible block that it has, and the scanner first sends everything
+  // above it from the state database, one batch at a time. Live messages
+  // are queued until the catch-up is finished.
+  //
+  // Every message is prefixed with its 32-bit length, and integers are
+  // stored in little-endian order.
+
+  enum replication_msg_type : uint8_t {
+    repl_abi_history = 1,      // account, block, ABI (empty if removed)
+    repl_account_activity = 2, // account, block
+    repl_activity_chunk = 3,   // account, chunk, activity_bitmap container
+    repl_irreversible = 4      // block, block ID: all data up to the block was sent
+  };
+
+  struct replication_message {
+    replication_msg_type  type;
+    uint64_t              account = 0;
+    uint32_t              block_num = 0; // chunk number for repl_activity_chunk
+    std::string           data;
+  };
+
+  namespace replication {
+    std::string encode_abi_history(uint64_t account, uint32_t block_num, const char* data, size_t size);
+    std::string encode_account_activity(uint64_t account, uint32_t block_num);
+    std::string encode_activity_chunk(uint64_t account, uint32_t chunk, const char* data, size_t size);
+    std::string encode_irreversible(uint32_t block_num, const char* block_id); // 32 bytes of ID
+
+    // decodes one message without the length prefix
+    void decode(const char* data, size_t size, replication_message& msg);
+  }
+
+
+  class replication_server {
+  public:
+    // fills the next batch of messages, returns false if there are no more batches
+    using catchup_batch_fn = std::function<bool(std::vector<std::string>& messages)>;
+
+    // starts producing the messages of irreversible blocks in the range (after_block, up_to_block]
+    using catchup_fn = std::function<catchup_batch_fn(uint32_t after_block, uint32_t up_to_block)>;
+
+    replication_server(boost::asio::io_service& ios, int priority, uint64_t max_queue_bytes,
+                       catchup_fn catchup);
+
+    // starts accepting replicas. All data up to the given block is in the state database.
+    void listen(const std::string& host, const std::string& port,
+                uint32_t flushed_block, const char* flushed_id);
+
+    // memorize a message until its block becomes irreversible
+    void add(uint32_t block_num, std::string&& msg);
+
+    // forget pending messages at or above the fork block
+    void rollback(uint32_t block_num);
+
+    // send pending messages for blocks up to and including the given block
+    void flush(uint32_t irreversible, const char* irreversible_id);
+
+    size_t replicas() const { return _sessions.size(); }
+    uint64_t bytes_sent() const { return _bytes_sent; }
+    uint64_t replicas_dropped() const { return _dropped; }
+
+  private:
+    using msgptr = std::shared_ptr<const std::string>;
+
+    struct session {
+      uint32_t                                id;
+      boost::asio::ip::tcp::socket            socket;
+      char                                    handshake[12];
+      std::deque<msgptr>                      queue;
+      std::vector<msgptr>                     in_flight;
+      uint64_t                                queue_bytes = 0;
+      catchup_batch_fn                        catchup;       // set until the last batch is taken
+      std::deque<msgptr>                      catchup_queue; // sent before the live messages
+      msgptr                                  catchup_marker;
+      bool                                    writing = false;
+      bool                                    closed = false;
+      session(boost::asio::io_service& ios) : socket(ios) {}
+    };
+
+    struct pending_msg {
+      uint32_t                                block_num;
+      msgptr                                  msg;
+    };
+
+    boost::asio::io_service&                  _ios;
+    int                                       _priority;
+    uint64_t                                  _max_queue_bytes;
+    catchup_fn                                _catchup;
+    std::shared_ptr<boost::asio::ip::tcp::acceptor> _acceptor;
+    std::map<uint32_t, std::shared_ptr<session>> _sessions;
+    uint32_t                                  _next_session_id = 1;
+    std::deque<pending_msg>                   _pending;
+    uint32_t                                  _flushed_block = 0;
+    std::string                               _flushed_id;
+    uint64_t                                  _bytes_sent = 0;
+    uint64_t                                  _dropped = 0;
+
+    void async_accept();
+    void read_handshake(std::shared_ptr<session> s);
+    void enqueue(std::shared_ptr<session> s, msgptr msg);
+    void broadcast(msgptr msg);
+    bool next_catchup_batch(std::shared_ptr<session> s);
+    void write(std::shared_ptr<session> s);
+    void close(std::shared_ptr<session> s);
+  };
+
+
+  class replication_client {
+  public:
+    using messages_fn = std::function<void(std::vector<replication_message>& messages)>;
+    using error_fn = std::function<void(const std::string& error)>;
+
+    replication_client(boost::asio::io_service& ios, int priority, messages_fn on_messages, error_fn on_error);
+
+    // connects to the source and requests the data above the given block
+    void connect(const std::string& host, const std::string& port, uint32_t last_block);
+    void close();
+
+    uint64_t bytes_received() const { return _bytes_received; }
+
+  private:
+    boost::asio::io_service&                  _ios;
+    int                                       _priority;
+    messages_fn                               _on_messages;
+    error_fn                                  _on_error;
+    std::shared_ptr<boost::asio::ip::tcp::resolver> _resolver;
+    std::shared_ptr<boost::asio::ip::tcp::socket> _socket;
+    std::vector<char>                         _buffer;
+    size_t                                    _buffered = 0;
+    uint64_t                                  _bytes_received = 0;
+    bool                                      _closed = false;
+
+    void read();
+    void fail(const std::string& what, const std::string& error);
+  };
+}
@@ -0,0 +1,464 @@
+// copyright defined in LICENSE.txt
+
+#include "ship_relay.hpp"
+
+#include <algorithm>
+#include <appbase/application.hpp>
+#include <boost/beast/websocket.hpp>
+#include <cstring>
+#include <stdexcept>
+#include <fc/log/logger.hpp>
+
+using boost::system::error_code;
+using boost::asio::ip::tcp;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "state history messages are in little-endian order");
+
+namespace chronicle {
+
+  // variant indexes in the state history ABI
+  static const uint32_t SHIP_GET_STATUS_REQUEST = 0;
+  static const uint32_t SHIP_GET_BLOCKS_REQUEST = 1;
+  static const uint32_t SHIP_GET_BLOCKS_ACK_REQUEST = 2;
+  static const uint32_t SHIP_GET_STATUS_RESULT = 0;
+  static const uint32_t SHIP_GET_BLOCKS_RESULT = 1;
+
+  static const size_t SHIP_POSITION_SIZE = 4 + 32;
+
+
+  namespace {
+    struct reader {
+      const char* pos;
+      const char* end;
+
+      void need(size_t size) {
+        if( size > size_t(end - pos) )
+          throw std::runtime_error("state history message is truncated");
+      }
+
+      const char* skip(size_t size) {
+        need(size);
+        const char* p = pos;
+        pos += size;
+        return p;
+      }
+
+      uint8_t u8() { return *skip(1); }
+
+      uint32_t u32() {
+        uint32_t v;
+        memcpy(&v, skip(sizeof(v)), sizeof(v));
+        return v;
+      }
+
+      uint32_t varuint32() {
+        uint32_t v = 0;
+        for( int shift = 0; shift < 35; shift += 7 ) {
+          uint8_t b = u8();
+          v |= uint32_t(b & 0x7f) << shift;
+          if( !(b & 0x80) )
+            return v;
+        }
+        throw std::runtime_error("invalid varuint32 in state history message");
+      }
+
+      // skips an optional<bytes> and returns its full encoding
+      std::pair<const char*, size_t> optional_bytes() {
+        const char* start = pos;
+        if( u8() ) {
+          uint32_t size = varuint32();
+          skip(size);
+        }
+        return {start, size_t(pos - start)};
+      }
+    };
+
+    void put_u32(std::string& out, uint32_t v) {
+      out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    void put_varuint32(std::string& out, uint32_t v) {
+      do {
+        uint8_t b = v & 0x7f;
+        v >>= 7;
+        if( v )
+          b |= 0x80;
+        out.push_back(b);
+      } while( v );
+    }
+
+    // positions the reader after this_block and prev_block
+    void skip_result_header(reader& r, const char*& positions, size_t& positions_size,
+                            const char*& this_block) {
+      if( r.varuint32() != SHIP_GET_BLOCKS_RESULT )
+        throw std::runtime_error("not a get_blocks_result_v0");
+      r.skip(2 * SHIP_POSITION_SIZE);
+      positions = r.pos;
+      this_block = nullptr;
+      if( r.u8() )
+        this_block = r.skip(SHIP_POSITION_SIZE);
+      if( r.u8() )
+        r.skip(SHIP_POSITION_SIZE); // prev_block
+      positions_size = r.pos - positions;
+    }
+  }
+
+
+  bool ship_protocol::result_block(const std::string& raw, uint32_t& block_num, std::string& block_id) {
+    reader r{raw.data(), raw.data() + raw.size()};
+    const char* positions;
+    size_t positions_size;
+    const char* this_block;
+    skip_result_header(r, positions, positions_size, this_block);
+    if( !this_block )
+      return false;
+    memcpy(&block_num, this_block, sizeof(block_num));
+    block_id.assign(this_block + 4, 32);
+    return true;
+  }
+
+
+  // the result as nodeos would send it now: with the current head and
+  // irreversible block, and only the parts that the client has requested
+  std::string ship_protocol::filter_result(const std::string& raw, uint32_t head, const std::string& head_id,
+                                           uint32_t irreversible, const std::string& irreversible_id,
+                                           bool fetch_block, bool fetch_traces, bool fetch_deltas) {
+    reader r{raw.data(), raw.data() + raw.size()};
+    const char* positions;
+    size_t positions_size;
+    const char* this_block;
+    skip_result_header(r, positions, positions_size, this_block);
+    auto block = r.optional_bytes();
+    auto traces = r.optional_bytes();
+    auto deltas = r.optional_bytes();
+
+    std::string out;
+    out.reserve(raw.size());
+    put_varuint32(out, SHIP_GET_BLOCKS_RESULT);
+    put_u32(out, head);
+    out.append(head_id);
+    put_u32(out, irreversible);
+    out.append(irreversible_id);
+    out.append(positions, positions_size);
+    auto put_optional = [&](bool wanted, const std::pair<const char*, size_t>& part) {
+      if( wanted )
+        out.append(part.first, part.second);
+      else
+        out.push_back(0);
+    };
+    put_optional(fetch_block, block);
+    put_optional(fetch_traces, traces);
+    put_optional(fetch_deltas, deltas);
+    return out;
+  }
+
+
+  ship_relay::ship_relay(boost::asio::io_service& ios, int priority, uint32_t cache_blocks, fetch_fn fetch,
+                         first_fn fetch_first) :
+    _ios(ios),
+    _priority(priority),
+    _cache_blocks(cache_blocks),
+    _fetch(fetch),
+    _fetch_first(fetch_first)
+  {}
+
+
+  void ship_relay::listen(const std::string& host, const std::string& port, const std::string& abi) {
+    _abi = std::make_shared<const std::string>(abi);
+    auto address = boost::asio::ip::make_address(host);
+    tcp::endpoint endpoint(address, std::stoul(port));
+    _acceptor = std::make_shared<tcp::acceptor>(_ios);
+    _acceptor->open(endpoint.protocol());
+    _acceptor->set_option(boost::asio::socket_base::reuse_address(true));
+    _acceptor->bind(endpoint);
+    _acceptor->listen();
+    _accept_retry_timer = std::make_shared<boost::asio::deadline_timer>(_ios);
+    ilog("Relaying state history to clients on ${h}:${p}", ("h",host)("p",port));
+    async_accept();
+  }
+
+
+  void ship_relay::async_accept() {
+    auto s = std::make_shared<session>(_ios);
+    _acceptor->async_accept
+      (s->ws.next_layer(),
+       appbase::app().get_priority_queue().wrap(_priority, [this, s](error_code ec) {
+           if( ec ) {
+             if( ec == boost::asio::error::operation_aborted )
+               return;
+             // such as running out of file descriptors: try again a bit later
+             elog("Error accepting state history client: ${e}", ("e",ec.message()));
+             _accept_retry_timer->expires_from_now(boost::posix_time::seconds(1));
+             _accept_retry_timer->async_wait
+               (appbase::app().get_priority_queue().wrap(_priority, [this](error_code ec) {
+                   if( !ec && _acceptor->is_open() )
+                     async_accept();
+                 }));
+             return;
+           }
+           s->ws.auto_fragment(false);
+           s->ws.read_message_max(1024*1024);
+           s->ws.async_accept
+             (appbase::app().get_priority_queue().wrap(_priority, [this, s](error_code ec) {
+                 if( ec ) {
+                   elog("State history client handshake failed: ${e}", ("e",ec.message()));
+                   return;
+                 }
+                 s->id = _next_session_id++;
+                 _sessions[s->id] = s;
+                 error_code epec;
+                 auto endpoint = s->ws.next_layer().remote_endpoint(epec);
+                 ilog("State history client ${c} connected from ${a}",
+                      ("c",s->id)("a",endpoint.address().to_string()));
+                 write(s);
+                 read(s);
+               }));
+           async_accept();
+         }));
+  }
+
+
+  void ship_relay::read(std::shared_ptr<session> s) {
+    s->ws.async_read
+      (s->in_buffer,
+       appbase::app().get_priority_queue().wrap(_priority, [this, s](error_code ec, size_t) {
+           if( s->closed )
+             return;
+           if( ec ) {
+             close(s, ec.message());
+             return;
+           }
+           try {
+             auto data = s->in_buffer.data();
+             on_request(s, (const char*)data.data(), data.size());
+           }
+           catch (const std::exception& e) {
+             // a wrong request only disconnects its client
+             close(s, e.what());
+             return;
+           }
+           s->in_buffer.consume(s->in_buffer.size());
+           write(s);
+           read(s);
+         }));
+  }
+
+
+  void ship_relay::on_request(std::shared_ptr<session> s, const char* data, size_t size) {
+    reader r{data, data + size};
+    uint32_t type = r.varuint32();
+    switch( type ) {
+    case SHIP_GET_STATUS_REQUEST:
+      s->replies.push_back(std::make_shared<const std::string>(status_result()));
+      break;
+
+    case SHIP_GET_BLOCKS_REQUEST: {
+      uint32_t start_block = r.u32();
+      s->end_block = r.u32();
+      s->credits = r.u32();
+      uint32_t positions = r.varuint32();
+      uint32_t first = first_block();
+      for( uint32_t i = 0; i < positions; i++ ) {
+        uint32_t block_num = r.u32();
+        const char* block_id = r.skip(32);
+        // blocks older than the relay can serve cannot be verified, and
+        // they could not be sent again anyway
+        if( block_num >= start_block || first == 0 || block_num < first )
+          continue;
+        // the client has a block that is not in our chain, or one that cannot be
+        // verified, so it's sent again from that point
+        std::string id;
+        if( !this->block_id(block_num, id) || memcmp(id.data(), block_id, 32) != 0 )
+          start_block = block_num;
+      }
+      s->irreversible_only = r.u8();
+      s->fetch_block = r.u8();
+      s->fetch_traces = r.u8();
+      s->fetch_deltas = r.u8();
+      s->next_block = start_block;
+      s->streaming = true;
+      ilog("State history client ${c} requested blocks ${s} to ${e}",
+           ("c",s->id)("s",start_block)("e",s->end_block));
+      break;
+    }
+
+    case SHIP_GET_BLOCKS_ACK_REQUEST: {
+      uint32_t num_messages = r.u32();
+      s->credits = (s->credits > UINT32_MAX - num_messages) ? UINT32_MAX : s->credits + num_messages;
+      break;
+    }
+
+    default:
+      throw std::runtime_error("unsupported state history request type " + std::to_string(type));
+    }
+  }
+
+
+  void ship_relay::add(uint32_t block_num, const char* block_id, const char* data, size_t size,
+                       uint32_t head, const char* head_id, uint32_t irreversible, const char* irreversible_id) {
+    if( _last_block > 0 && block_num <= _last_block ) {
+      // fork: the clients that have seen the forked blocks get them again from the fork point
+      while( !_cache.empty() && _cache.back().block_num >= block_num )
+        _cache.pop_back();
+      for( auto& item : _sessions ) {
+        if( item.second->next_block > block_num )
+          item.second->next_block = block_num;
+      }
+    }
+    if( !_cache.empty() && _cache.back().block_num + 1 != block_num )
+      _cache.clear();
+    _cache.push_back(cached_block{block_num, std::string(block_id, 32),
+          std::make_shared<const std::string>(data, size)});
+    while( _cache.size() > _cache_blocks )
+      _cache.pop_front();
+
+    _last_block = block_num;
+    _head = head;
+    _head_id.assign(head_id, 32);
+    _irreversible = irreversible;
+    _irreversible_id.assign(irreversible_id, 32);
+
+    auto all_sessions = _sessions;
+    for( auto& item : all_sessions )
+      write(item.second);
+  }
+
+
+  void ship_relay::write(std::shared_ptr<session> s) {
+    if( s->writing || s->closed )
+      return;
+    bool text = false;
+    if( !s->abi_sent ) {
+      // nodeos sends its ABI as the first message, in text mode
+      s->msg = _abi;
+      s->abi_sent = true;
+      text = true;
+    }
+    else if( !s->replies.empty() ) {
+      s->msg = s->replies.front();
+      s->replies.pop_front();
+    }
+    else {
+      s->msg = next_result(s);
+      if( !s->msg )
+        return;
+    }
+    s->writing = true;
+    s->ws.text(text);
+    s->ws.async_write
+      (boost::asio::const_buffer(s->msg->data(), s->msg->size()),
+       appbase::app().get_priority_queue().wrap(_priority, [this, s](error_code ec, size_t size) {
+           s->writing = false;
+           if( ec ) {
+             close(s, ec.message());
+             return;
+           }
+           _bytes_sent += size;
+           write(s);
+         }));
+  }
+
+
+  ship_relay::msgptr ship_relay::next_result(std::shared_ptr<session> s) {
+    if( !s->streaming || s->credits == 0 || s->next_block >= s->end_block )
+      return nullptr;
+    if( s->next_block > (s->irreversible_only ? std::min(_irreversible, _last_block) : _last_block) )
+      return nullptr;
+
+    uint32_t block_num = s->next_block;
+    std::string fetched;
+    const std::string* raw = nullptr;
+    if( !_cache.empty() && block_num >= _cache.front().block_num && block_num <= _cache.back().block_num ) {
+      raw = _cache[block_num - _cache.front().block_num].result.get();
+    }
+    else if( _fetch && _fetch(block_num, fetched) ) {
+      raw = &fetched;
+      _fetched_blocks++;
+    }
+    else {
+      close(s, "block " + std::to_string(block_num) + " is not available in the relay");
+      return nullptr;
+    }
+
+    auto result = std::make_shared<const std::string>
+      (ship_protocol::filter_result(*raw, _head, _head_id, _irreversible, _irreversible_id,
+                                    s->fetch_block, s->fetch_traces, s->fetch_deltas));
+    s->next_block++;
+    s->credits--;
+    return result;
+  }
+
+
+  // ID of a relayed block, from the cache or through the fetch callback
+  bool ship_relay::block_id(uint32_t block_num, std::string& id) {
+    if( block_num > _last_block )
+      return false;
+    if( !_cache.empty() && block_num >= _cache.front().block_num ) {
+      id = _cache[block_num - _cache.front().block_num].block_id;
+      return true;
+    }
+    std::string raw;
+    if( !_fetch || !_fetch(block_num, raw) )
+      return false;
+    uint32_t fetched_num;
+    try {
+      return ship_protocol::result_block(raw, fetched_num, id) && fetched_num == block_num;
+    }
+    catch (const std::exception& e) {
+      wlog("Cannot read the relayed block ${b}: ${e}", ("b",block_num)("e",e.what()));
+      return false;
+    }
+  }
+
+
+  // the oldest block that the relay can send, 0 if there is none
+  uint32_t ship_relay::first_block() const {
+    uint32_t first = _cache.empty() ? 0 : _cache.front().block_num;
+    if( _fetch_first ) {
+      uint32_t fetched = _fetch_first();
+      if( fetched > 0 && (first == 0 || fetched < first) )
+        first = fetched;
+    }
+    return first;
+  }
+
+
+  std::string ship_relay::status_result() const {
+    uint32_t end_block = _last_block + 1;
+    uint32_t begin_block = _cache.empty() ? end_block : _cache.front().block_num;
+    std::string out;
+    put_varuint32(out, SHIP_GET_STATUS_RESULT);
+    put_u32(out, _head);
+    out.append(_head_id);
+    put_u32(out, _irreversible);
+    out.append(_irreversible_id);
+    put_u32(out, begin_block); // trace_begin_block
+    put_u32(out, end_block);   // trace_end_block
+    put_u32(out, begin_block); // chain_state_begin_block
+    put_u32(out, end_block);   // chain_state_end_block
+    return out;
+  }
+
+
+  void ship_relay::close(std::shared_ptr<session> s, const std::string& reason) {
+    if( s->closed )
+      return;
+    s->closed = true;
+    _sessions.erase(s->id);
+    ilog("State history client ${c} disconnected: ${r}", ("c",s->id)("r",reason));
+    error_code ec;
+    s->ws.next_layer().close(ec);
+  }
+
+
+  void ship_relay::close() {
+    if( _acceptor ) {
+      error_code ec;
+      _acceptor->close(ec);
+      _accept_retry_timer->cancel(ec);
+    }
+    auto all_sessions = _sessions;
+    for( auto& item : all_sessions )
+      close(item.second, "relay stopped");
+  }
+}
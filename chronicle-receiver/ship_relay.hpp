@@ -0,0 +1,131 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/websocket/stream.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace chronicle {
+
+  // Relay of the state history websocket protocol to downstream clients.
+  // The scanning receiver feeds it with the ABI and every block result
+  // exactly as they came from nodeos, and the relay serves
+  // get_status_request_v0, get_blocks_request_v0 and
+  // get_blocks_ack_request_v0 from them, so that nodeos has only one
+  // consumer. Recent results are kept in memory, and older ones are
+  // fetched through a callback, such as from the live ring.
+  //
+  // Each client is sent one result at a time, and the next one is taken
+  // from the cache only after the previous write has finished, so a
+  // slow client does not consume memory. A client that falls behind the
+  // available blocks is disconnected.
+
+  namespace ship_protocol {
+    // block number and ID of this_block in a raw get_blocks_result_v0,
+    // returns false if the result has no block
+    bool result_block(const std::string& raw, uint32_t& block_num, std::string& block_id);
+
+    // re-encodes a raw get_blocks_result_v0 with another head and irreversible
+    // block, keeping only the requested parts. IDs are 32 bytes.
+    std::string filter_result(const std::string& raw, uint32_t head, const std::string& head_id,
+                              uint32_t irreversible, const std::string& irreversible_id,
+                              bool fetch_block, bool fetch_traces, bool fetch_deltas);
+  }
+
+
+  class ship_relay {
+  public:
+    // copies the raw result of an older block, returns false if it's not available
+    using fetch_fn = std::function<bool(uint32_t block_num, std::string& out)>;
+
+    // the oldest block that fetch_fn can copy, 0 if there is none
+    using first_fn = std::function<uint32_t()>;
+
+    ship_relay(boost::asio::io_service& ios, int priority, uint32_t cache_blocks, fetch_fn fetch,
+               first_fn fetch_first);
+
+    // starts accepting clients, with the state history ABI received from nodeos
+    void listen(const std::string& host, const std::string& port, const std::string& abi);
+    bool listening() const { return _acceptor != nullptr; }
+
+    // a result from nodeos. A block number at or below the last relayed block means a fork.
+    void add(uint32_t block_num, const char* block_id, const char* data, size_t size,
+             uint32_t head, const char* head_id, uint32_t irreversible, const char* irreversible_id);
+
+    void close();
+
+    size_t clients() const { return _sessions.size(); }
+    uint64_t bytes_sent() const { return _bytes_sent; }
+    uint64_t fetched_blocks() const { return _fetched_blocks; }
+
+  private:
+    using msgptr = std::shared_ptr<const std::string>;
+    using wstream = boost::beast::websocket::stream<boost::asio::ip::tcp::socket>;
+
+    struct session {
+      uint32_t                                id;
+      wstream                                 ws;
+      boost::beast::flat_buffer               in_buffer;
+      std::deque<msgptr>                      replies;
+      msgptr                                  msg;  // this to prevent deallocation during async write
+      bool                                    abi_sent = false;
+      bool                                    writing = false;
+      bool                                    closed = false;
+
+      // the current get_blocks_request_v0
+      bool                                    streaming = false;
+      uint32_t                                next_block = 0;
+      uint32_t                                end_block = 0;
+      uint32_t                                credits = 0;
+      bool                                    irreversible_only = false;
+      bool                                    fetch_block = false;
+      bool                                    fetch_traces = false;
+      bool                                    fetch_deltas = false;
+
+      session(boost::asio::io_service& ios) : ws(ios) {}
+    };
+
+    struct cached_block {
+      uint32_t                                block_num;
+      std::string                             block_id;
+      msgptr                                  result;
+    };
+
+    boost::asio::io_service&                  _ios;
+    int                                       _priority;
+    uint32_t                                  _cache_blocks;
+    fetch_fn                                  _fetch;
+    first_fn                                  _fetch_first;
+    msgptr                                    _abi;
+    std::shared_ptr<boost::asio::ip::tcp::acceptor> _acceptor;
+    std::shared_ptr<boost::asio::deadline_timer> _accept_retry_timer;
+    std::map<uint32_t, std::shared_ptr<session>> _sessions;
+    uint32_t                                  _next_session_id = 1;
+    std::deque<cached_block>                  _cache;
+    uint32_t                                  _last_block = 0; // the last block received from nodeos
+    uint32_t                                  _head = 0;       // as reported by nodeos
+    std::string                               _head_id = std::string(32, '\0');
+    uint32_t                                  _irreversible = 0;
+    std::string                               _irreversible_id = std::string(32, '\0');
+    uint64_t                                  _bytes_sent = 0;
+    uint64_t                                  _fetched_blocks = 0;
+
+    void async_accept();
+    void read(std::shared_ptr<session> s);
+    void on_request(std::shared_ptr<session> s, const char* data, size_t size);
+    void write(std::shared_ptr<session> s);
+    msgptr next_result(std::shared_ptr<session> s);
+    void close(std::shared_ptr<session> s, const std::string& reason);
+    bool block_id(uint32_t block_num, std::string& id);
+    uint32_t first_block() const;
+    std::string status_result() const;
+  };
+}
@@ -0,0 +1,274 @@
+// copyright defined in LICENSE.txt
+
+#include "specialized_decoders.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace chronicle {
+  namespace specialized_decoders {
+
+    namespace {
+
+      struct reader {
+        const char* pos;
+        const char* end;
+
+        template <typename T>
+        bool read(T& v) {
+          if( end - pos < (ptrdiff_t)sizeof(T) )
+            return false;
+          memcpy(&v, pos, sizeof(T));
+          pos += sizeof(T);
+          return true;
+        }
+
+        bool read_string(std::string& v) {
+          uint32_t size = 0;
+          int shift = 0;
+          uint8_t b;
+          do {
+            if( shift >= 35 || !read(b) )
+              return false;
+            size |= uint32_t(b & 0x7f) << shift;
+            shift += 7;
+          } while( b & 0x80 );
+          if( (size_t)(end - pos) < size )
+            return false;
+          v.assign(pos, size);
+          pos += size;
+          return true;
+        }
+
+        // abieos accepts only the data that is consumed completely
+        bool done() const {
+          return pos == end;
+        }
+      };
+
+      struct asset {
+        int64_t     amount;
+        uint64_t    symbol;
+      };
+
+      bool read_asset(reader& r, asset& v) {
+        return r.read(v.amount) && r.read(v.symbol);
+      }
+
+      // same formatting as in abieos
+      std::string asset_to_string(const asset& v) {
+        std::string result;
+        uint64_t amount = (v.amount < 0) ? -(uint64_t)v.amount : v.amount;
+        uint8_t precision = v.symbol;
+        if( precision ) {
+          while( precision-- ) {
+            result += '0' + amount % 10;
+            amount /= 10;
+          }
+          result += '.';
+        }
+        do {
+          result += '0' + amount % 10;
+          amount /= 10;
+        } while( amount );
+        if( v.amount < 0 )
+          result += '-';
+        std::reverse(result.begin(), result.end());
+        result += ' ';
+        uint64_t code = v.symbol >> 8;
+        while( code > 0 ) {
+          result += char(code & 0xff);
+          code >>= 8;
+        }
+        return result;
+      }
+
+      void write_name(json_writer& writer, const char* key, uint64_t value) {
+        std::string str = std::string(abieos::name{value});
+        writer.Key(key);
+        writer.String(str.data(), str.size());
+      }
+
+      void write_asset(json_writer& writer, const char* key, const asset& value) {
+        std::string str = asset_to_string(value);
+        writer.Key(key);
+        writer.String(str.data(), str.size());
+      }
+
+
+      bool decode_transfer(const char* pos, const char* end, json_writer& writer) {
+        reader r{pos, end};
+        uint64_t from, to;
+        asset quantity;
+        std::string memo;
+        if( !r.read(from) || !r.read(to) || !read_asset(r, quantity) || !r.read_string(memo) || !r.done() )
+          return false;
+        writer.StartObject();
+        write_name(writer, "from", from);
+        write_name(writer, "to", to);
+        write_asset(writer, "quantity", quantity);
+        writer.Key("memo");
+        writer.String(memo.data(), memo.size());
+        writer.EndObject();
+        return true;
+      }
+
+
+      bool decode_buyrambytes(const char* pos, const char* end, json_writer& writer) {
+        reader r{pos, end};
+        uint64_t payer, receiver;
+        uint32_t bytes;
+        if( !r.read(payer) || !r.read(receiver) || !r.read(bytes) || !r.done() )
+          return false;
+        writer.StartObject();
+        write_name(writer, "payer", payer);
+        write_name(writer, "receiver", receiver);
+        writer.Key("bytes");
+        writer.Uint(bytes);
+        writer.EndObject();
+        return true;
+      }
+
+
+      bool decode_delegatebw(const char* pos, const char* end, json_writer& writer) {
+        reader r{pos, end};
+        uint64_t from, receiver;
+        asset stake_net_quantity, stake_cpu_quantity;
+        uint8_t transfer;
+        if( !r.read(from) || !r.read(receiver) || !read_asset(r, stake_net_quantity) ||
+            !read_asset(r, stake_cpu_quantity) || !r.read(transfer) || !r.done() )
+          return false;
+        writer.StartObject();
+        write_name(writer, "from", from);
+        write_name(writer, "receiver", receiver);
+        write_asset(writer, "stake_net_quantity", stake_net_quantity);
+        write_asset(writer, "stake_cpu_quantity", stake_cpu_quantity);
+        writer.Key("transfer");
+        writer.Bool(transfer != 0);
+        writer.EndObject();
+        return true;
+      }
+
+
+      bool decode_account(const char* pos, const char* end, json_writer& writer) {
+        reader r{pos, end};
+        asset balance;
+        if( !read_asset(r, balance) || !r.done() )
+          return false;
+        writer.StartObject();
+        write_asset(writer, "balance", balance);
+        writer.EndObject();
+        return true;
+      }
+
+
+      bool decode_currency_stats(const char* pos, const char* end, json_writer& writer) {
+        reader r{pos, end};
+        asset supply, max_supply;
+        uint64_t issuer;
+        if( !read_asset(r, supply) || !read_asset(r, max_supply) || !r.read(issuer) || !r.done() )
+          return false;
+        writer.StartObject();
+        write_asset(writer, "supply", supply);
+        write_asset(writer, "max_supply", max_supply);
+        write_name(writer, "issuer", issuer);
+        writer.EndObject();
+        return true;
+      }
+
+
+      struct registry_entry {
+        const char*   name;       // action or table name
+        const char*   signature;  // fields of its type, with typedefs resolved
+        decode_fn     fn;
+      };
+
+      const registry_entry action_registry[] = {
+        {"transfer", "from:name,to:name,quantity:asset,memo:string", decode_transfer},
+        {"buyrambytes", "payer:name,receiver:name,bytes:uint32", decode_buyrambytes},
+        {"delegatebw", "from:name,receiver:name,stake_net_quantity:asset,stake_cpu_quantity:asset,transfer:bool",
+         decode_delegatebw},
+      };
+
+      const registry_entry table_registry[] = {
+        {"accounts", "balance:asset", decode_account},
+        {"stat", "supply:asset,max_supply:asset,issuer:name", decode_currency_stats},
+      };
+
+
+      std::string resolve_type(const abieos::abi_def& abi, std::string type) {
+        // typedefs may be chained, but not looped
+        for( size_t depth = 0; depth < abi.types.size(); depth++ ) {
+          auto itr = std::find_if(abi.types.begin(), abi.types.end(),
+                                  [&](auto& t) { return t.new_type_name == type; });
+          if( itr == abi.types.end() )
+            break;
+          type = itr->type;
+        }
+        return type;
+      }
+
+
+      // flattened list of fields of a struct type, or an empty string if it's not a struct
+      std::string type_signature(const abieos::abi_def& abi, const std::string& type_name, int depth = 0) {
+        std::string type = resolve_type(abi, type_name);
+        auto itr = std::find_if(abi.structs.begin(), abi.structs.end(),
+                                [&](auto& s) { return s.name == type; });
+        if( itr == abi.structs.end() || depth > 8 )
+          return std::string();
+        std::string result;
+        if( !itr->base.empty() )
+          result = type_signature(abi, itr->base, depth + 1);
+        for( auto& field : itr->fields ) {
+          if( !result.empty() )
+            result += ',';
+          result += field.name + ':' + resolve_type(abi, field.type);
+        }
+        return result;
+      }
+    }
+
+
+    // action and table names are stored as 64-bit values in the binary ABI
+    bool may_match(const char* abi_bin, size_t size) {
+      std::string_view abi(abi_bin, size);
+      auto contains = [&](const char* name) {
+        uint64_t value = abieos::name(name).value;
+        return abi.find(std::string_view(reinterpret_cast<const char*>(&value), sizeof(value))) != abi.npos;
+      };
+      for( auto& entry : action_registry ) {
+        if( contains(entry.name) )
+          return true;
+      }
+      for( auto& entry : table_registry ) {
+        if( contains(entry.name) )
+          return true;
+      }
+      return false;
+    }
+
+
+    std::shared_ptr<const decoder_set> match_abi(const abieos::abi_def& abi) {
+      auto result = std::make_shared<decoder_set>();
+      for( auto& entry : action_registry ) {
+        uint64_t name = abieos::name(entry.name).value;
+        for( auto& action : abi.actions ) {
+          if( action.name.value == name && type_signature(abi, action.type) == entry.signature )
+            result->actions.emplace(name, entry.fn);
+        }
+      }
+      for( auto& entry : table_registry ) {
+        uint64_t name = abieos::name(entry.name).value;
+        for( auto& table : abi.tables ) {
+          if( table.name.value == name && type_signature(abi, table.type) == entry.signature )
+            result->tables.emplace(name, entry.fn);
+        }
+      }
+      if( result->actions.empty() && result->tables.empty() )
+        return nullptr;
+      return result;
+    }
+  }
+}
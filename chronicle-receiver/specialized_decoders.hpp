@@ -0,0 +1,51 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <abieos.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string_view>
+
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+namespace chronicle {
+
+  // Compiled decoders for the most frequent actions and table rows, such as
+  // token transfers and balances. They produce the same JSON as the abieos
+  // interpreter, but only if the contract ABI defines the type exactly as the
+  // standard eosio.token and eosio.system contracts do. Any deviation in the
+  // type signature leaves the contract on the generic path.
+
+  namespace specialized_decoders {
+
+    using json_writer = rapidjson::Writer<rapidjson::StringBuffer>;
+
+    // writes the JSON object, or returns false without writing anything if
+    // the binary data does not match the type
+    using decode_fn = bool (*)(const char* pos, const char* end, json_writer& writer);
+
+    struct decoder_set {
+      std::map<uint64_t, decode_fn>  actions;  // by action name
+      std::map<uint64_t, decode_fn>  tables;   // by table name
+
+      decode_fn action(uint64_t name) const {
+        auto itr = actions.find(name);
+        return (itr != actions.end()) ? itr->second : nullptr;
+      }
+
+      decode_fn table(uint64_t name) const {
+        auto itr = tables.find(name);
+        return (itr != tables.end()) ? itr->second : nullptr;
+      }
+    };
+
+    // cheap test of a binary ABI: false if it cannot define any of the
+    // specialized actions or tables, so that it does not need to be parsed
+    bool may_match(const char* abi_bin, size_t size);
+
+    // returns nullptr if none of the specialized decoders match the ABI
+    std::shared_ptr<const decoder_set> match_abi(const abieos::abi_def& abi);
+  }
+}
@@ -0,0 +1,167 @@
+// copyright defined in LICENSE.txt
+
+#include "state_file.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace bfs = boost::filesystem;
+namespace bio = boost::iostreams;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "state files are written in little-endian order");
+
+namespace chronicle {
+
+  static const uint64_t STATE_FILE_MAGIC = 0x4554415453524843ull; // "CHRSTATE"
+  static const uint32_t STATE_FILE_VERSION = 1;
+
+  static void fsync_path(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if( fd < 0 )
+      throw std::runtime_error("Cannot open " + path + " for syncing");
+    int rc = ::fsync(fd);
+    ::close(fd);
+    if( rc != 0 )
+      throw std::runtime_error("Cannot sync " + path);
+  }
+
+
+  state_file_writer::state_file_writer(const std::string& path, bool compressed) :
+    _path(path),
+    _tmp_path(path + ".tmp"),
+    _file(_tmp_path, std::ofstream::binary | std::ofstream::trunc)
+  {
+    if( !_file )
+      throw std::runtime_error("Cannot create " + _tmp_path);
+    if( compressed )
+      _out.push(bio::gzip_compressor(bio::gzip_params(bio::gzip::best_speed)));
+    _out.push(_file);
+    write_u64(STATE_FILE_MAGIC);
+    write_u32(STATE_FILE_VERSION);
+  }
+
+
+  state_file_writer::~state_file_writer() {
+    if( !_committed ) {
+      _out.reset();
+      _file.close();
+      boost::system::error_code ec;
+      bfs::remove(_tmp_path, ec);
+    }
+  }
+
+
+  void state_file_writer::write_raw(const char* data, size_t size) {
+    _crc = crc32(_crc, reinterpret_cast<const Bytef*>(data), size);
+    _out.write(data, size);
+    _written += size;
+  }
+
+
+  void state_file_writer::write_u8(uint8_t v) {
+    write_raw(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+
+  void state_file_writer::write_u32(uint32_t v) {
+    write_raw(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+
+  void state_file_writer::write_u64(uint64_t v) {
+    write_raw(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+
+  void state_file_writer::write_bytes(const char* data, size_t size) {
+    write_u32(size);
+    write_raw(data, size);
+  }
+
+
+  void state_file_writer::commit() {
+    uint32_t crc = _crc;
+    _out.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    _out.reset(); // flushes the compressor
+    _file.close();
+    if( !_file )
+      throw std::runtime_error("Cannot write " + _tmp_path);
+    fsync_path(_tmp_path);
+    bfs::rename(_tmp_path, _path);
+    fsync_path(bfs::path(_path).parent_path().string());
+    _committed = true;
+  }
+
+
+  state_file_reader::state_file_reader(const std::string& path) :
+    _path(path),
+    _file(path, std::ifstream::binary)
+  {
+    if( !_file )
+      throw std::runtime_error("Cannot open " + path);
+    int first = _file.peek();
+    if( first == 0x1f )
+      _in.push(bio::gzip_decompressor());
+    _in.push(_file);
+    if( read_u64() != STATE_FILE_MAGIC )
+      throw std::runtime_error("Not a Chronicle state file: " + path);
+    uint32_t version = read_u32();
+    if( version != STATE_FILE_VERSION )
+      throw std::runtime_error("Unsupported state file version " + std::to_string(version) + ": " + path);
+  }
+
+
+  void state_file_reader::read_raw(char* data, size_t size) {
+    _in.read(data, size);
+    if( (size_t)_in.gcount() != size )
+      throw std::runtime_error("Unexpected end of state file: " + _path);
+    _crc = crc32(_crc, reinterpret_cast<const Bytef*>(data), size);
+  }
+
+
+  uint8_t state_file_reader::read_u8() {
+    uint8_t v;
+    read_raw(reinterpret_cast<char*>(&v), sizeof(v));
+    return v;
+  }
+
+
+  uint32_t state_file_reader::read_u32() {
+    uint32_t v;
+    read_raw(reinterpret_cast<char*>(&v), sizeof(v));
+    return v;
+  }
+
+
+  uint64_t state_file_reader::read_u64() {
+    uint64_t v;
+    read_raw(reinterpret_cast<char*>(&v), sizeof(v));
+    return v;
+  }
+
+
+  void state_file_reader::read_bytes(std::string& data) {
+    uint32_t size = read_u32();
+    data.resize(size);
+    if( size > 0 )
+      read_raw(&data[0], size);
+  }
+
+
+  void state_file_reader::finish() {
+    uint32_t expected = _crc;
+    uint32_t crc;
+    _in.read(reinterpret_cast<char*>(&crc), sizeof(crc));
+    if( _in.gcount() != sizeof(crc) || crc != expected )
+      throw std::runtime_error("State file checksum mismatch: " + _path);
+  }
+
+
+  bool state_file_exists(const std::string& path) {
+    return bfs::exists(path);
+  }
+}
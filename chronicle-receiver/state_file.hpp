@@ -0,0 +1,74 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/iostreams/filtering_stream.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace chronicle {
+
+  // record types in checkpoint and snapshot files
+  enum state_file_record : uint8_t {
+    state_rec_end = 0,
+    state_rec_abi_history = 1,
+    state_rec_contract_abi = 2,
+    state_rec_account_activity = 3
+  };
+
+  // Sequential binary file of receiver state records, used for checkpoints
+  // and snapshots. Integers are stored in little-endian order, and the
+  // stream may be gzip-compressed. A CRC32 of the uncompressed stream is
+  // appended at the end, so that a damaged file is detected when it's read.
+
+  class state_file_writer {
+  public:
+    // the data goes to a temporary file until commit() renames it
+    state_file_writer(const std::string& path, bool compressed);
+    ~state_file_writer();
+
+    void write_u8(uint8_t v);
+    void write_u32(uint32_t v);
+    void write_u64(uint64_t v);
+    void write_raw(const char* data, size_t size);
+    void write_bytes(const char* data, size_t size); // prefixed with size
+
+    // flushes the file to disk and replaces the target atomically
+    void commit();
+
+    uint64_t bytes_written() const { return _written; }
+
+  private:
+    std::string                          _path;
+    std::string                          _tmp_path;
+    std::ofstream                        _file;
+    boost::iostreams::filtering_ostream  _out;
+    uint32_t                             _crc = 0;
+    uint64_t                             _written = 0;
+    bool                                 _committed = false;
+  };
+
+
+  class state_file_reader {
+  public:
+    // compression is detected automatically
+    state_file_reader(const std::string& path);
+
+    uint8_t read_u8();
+    uint32_t read_u32();
+    uint64_t read_u64();
+    void read_raw(char* data, size_t size);
+    void read_bytes(std::string& data);
+
+    // verifies the checksum at the end of the file
+    void finish();
+
+  private:
+    std::string                          _path;
+    std::ifstream                        _file;
+    boost::iostreams::filtering_istream  _in;
+    uint32_t                             _crc = 0;
+  };
+
+  bool state_file_exists(const std::string& path);
+}
@@ -0,0 +1,151 @@
+// copyright defined in LICENSE.txt
+
+#include "time_index.hpp"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <stdexcept>
+#include <fc/log/logger.hpp>
+
+namespace bip = boost::interprocess;
+namespace bfs = boost::filesystem;
+
+namespace chronicle {
+
+  static const uint64_t TIME_INDEX_MAGIC = 0x5844494d49544443ull; // "CDTIMIDX"
+  static const uint32_t TIME_INDEX_VERSION = 1;
+
+  // the file grows by this number of records at a time
+  static const uint64_t TIME_INDEX_GROW_RECORDS = 1024*1024;
+
+  struct time_index::header {
+    uint64_t    magic;
+    uint32_t    version;
+    uint32_t    reserved1;
+    uint64_t    entries;
+    char        reserved[40];
+  };
+
+
+  time_index::time_index(const std::string& path, bool writable) :
+    _path(path),
+    _writable(writable)
+  {
+    bool created = false;
+    if( !bfs::exists(path) ) {
+      if( !writable )
+        throw std::runtime_error("Timestamp index does not exist: " + path);
+      std::ofstream ofs(path, std::ofstream::trunc);
+      ofs.close();
+      bfs::resize_file(path, sizeof(header) + TIME_INDEX_GROW_RECORDS * sizeof(record));
+      created = true;
+    }
+
+    bip::mode_t mode = writable ? bip::read_write : bip::read_only;
+    _file = bip::file_mapping(path.c_str(), mode);
+    map_file();
+
+    if( created ) {
+      _hdr->magic = TIME_INDEX_MAGIC;
+      _hdr->version = TIME_INDEX_VERSION;
+      _hdr->entries = 0;
+    }
+    else if( _hdr->magic != TIME_INDEX_MAGIC || _hdr->version != TIME_INDEX_VERSION ) {
+      throw std::runtime_error("Invalid timestamp index file: " + path);
+    }
+
+    ilog("Timestamp index ${f}: ${e} entries", ("f",path)("e",_hdr->entries));
+  }
+
+
+  bool time_index::exists(const std::string& path) {
+    return bfs::exists(path);
+  }
+
+
+  void time_index::map_file() {
+    bip::mode_t mode = _writable ? bip::read_write : bip::read_only;
+    _region = bip::mapped_region(_file, mode);
+    _hdr = static_cast<header*>(_region.get_address());
+    _records = reinterpret_cast<record*>(reinterpret_cast<char*>(_hdr) + sizeof(header));
+    _mapped_records = (_region.get_size() - sizeof(header)) / sizeof(record);
+  }
+
+
+  void time_index::add(uint32_t block_num, uint32_t slot) {
+    _pending.push_back(record{slot, block_num});
+  }
+
+
+  void time_index::flush(uint32_t irreversible) {
+    while( !_pending.empty() && _pending.front().block_num <= irreversible ) {
+      append(_pending.front());
+      _pending.pop_front();
+    }
+  }
+
+
+  void time_index::rollback(uint32_t block_num) {
+    while( !_pending.empty() && _pending.back().block_num >= block_num )
+      _pending.pop_back();
+  }
+
+
+  void time_index::append(const record& rec) {
+    uint64_t count = _hdr->entries;
+    if( count > 0 && _records[count-1].block_num >= rec.block_num )
+      return; // the block was replayed after a restart
+
+    if( count == _mapped_records ) {
+      bfs::resize_file(_path, sizeof(header) + (count + TIME_INDEX_GROW_RECORDS) * sizeof(record));
+      map_file();
+    }
+
+    // the record must be visible before the counter that publishes it
+    _records[count] = rec;
+    __atomic_store_n(&_hdr->entries, count + 1, __ATOMIC_RELEASE);
+  }
+
+
+  uint32_t time_index::block_at(uint32_t slot) {
+    uint64_t count = entries();
+    if( count == 0 )
+      throw std::runtime_error("Timestamp index is empty");
+    if( count > _mapped_records )
+      map_file(); // the writer has grown the file since we mapped it
+
+    if( slot <= _records[0].slot )
+      return _records[0].block_num;
+    if( slot > _records[count-1].slot )
+      return _records[count-1].block_num + 1;
+
+    // first record with a timestamp equal or higher than the slot
+    uint64_t lo = 0;
+    uint64_t hi = count - 1;
+    while( hi - lo > 1 ) {
+      uint64_t mid = lo + (hi - lo) / 2;
+      if( _records[mid].slot < slot )
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+    const record& r1 = _records[lo];
+    const record& r2 = _records[hi];
+    if( r2.slot == slot )
+      return r2.block_num;
+
+    // some slots may be missed by producers, so we interpolate between the records
+    uint64_t blocks = r2.block_num - r1.block_num;
+    uint64_t slots = r2.slot - r1.slot;
+    uint32_t result = r1.block_num + ((slot - r1.slot) * blocks + slots - 1) / slots;
+    if( result <= r1.block_num )
+      result = r1.block_num + 1;
+    return result;
+  }
+
+
+  uint64_t time_index::entries() const {
+    return __atomic_load_n(&_hdr->entries, __ATOMIC_ACQUIRE);
+  }
+}
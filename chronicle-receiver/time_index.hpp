@@ -0,0 +1,59 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+namespace chronicle {
+
+  // On-disk sorted array of (block timestamp slot, block number) pairs.
+  //
+  // The scanning receiver appends a record for every Nth irreversible block,
+  // and the file grows as needed. Interactive readers map it read-only and
+  // find block numbers by binary search, interpolating between the records.
+
+  class time_index {
+  public:
+    time_index(const std::string& path, bool writable);
+
+    static bool exists(const std::string& path);
+
+    // memorize a block timestamp until the block becomes irreversible
+    void add(uint32_t block_num, uint32_t slot);
+
+    // write pending records for blocks up to and including the given block
+    void flush(uint32_t irreversible);
+
+    // forget pending records at or above the fork block
+    void rollback(uint32_t block_num);
+
+    // first block whose timestamp is equal or higher than the slot. Returns
+    // the block after the last indexed one if the slot is beyond the index.
+    // The result is exact only if every block is indexed.
+    uint32_t block_at(uint32_t slot);
+
+    uint64_t entries() const;
+
+  private:
+    struct header;
+    struct record {
+      uint32_t   slot;
+      uint32_t   block_num;
+    };
+
+    std::string                         _path;
+    boost::interprocess::file_mapping   _file;
+    boost::interprocess::mapped_region  _region;
+    header*                             _hdr = nullptr;
+    record*                             _records = nullptr;
+    uint64_t                            _mapped_records = 0;
+    bool                                _writable;
+    std::deque<record>                  _pending;
+
+    void map_file();
+    void append(const record& rec);
+  };
+}
@@ -0,0 +1,219 @@
+// copyright defined in LICENSE.txt
+
+#include "trx_index.hpp"
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fc/log/logger.hpp>
+
+namespace bip = boost::interprocess;
+namespace bfs = boost::filesystem;
+
+namespace chronicle {
+
+  static const uint64_t TRX_INDEX_MAGIC = 0x5844494e58525443ull; // "CTRXNIDX"
+  static const uint32_t TRX_INDEX_VERSION = 1;
+
+  // the table is rehashed into double size at this fill ratio, in percent
+  static const uint64_t TRX_INDEX_MAX_LOAD = 80;
+
+  struct trx_index::header {
+    uint64_t    magic;
+    uint32_t    version;
+    uint32_t    last_block;
+    uint64_t    slot_count;
+    uint64_t    entries;
+    uint32_t    superseded; // set when the file is replaced by a bigger one
+    char        reserved[28];
+  };
+
+
+  trx_index::trx_index(const std::string& path, bool writable, uint64_t size_mb) :
+    _path(path),
+    _writable(writable)
+  {
+    bool created = false;
+    if( !bfs::exists(path) ) {
+      if( !writable )
+        throw std::runtime_error("Transaction index does not exist: " + path);
+      uint64_t size = size_mb * 1024*1024;
+      uint64_t slots = 1;
+      while( sizeof(header) + slots * 2 * (sizeof(uint64_t) + sizeof(uint32_t)) <= size )
+        slots *= 2;
+      if( slots < 1024 )
+        throw std::runtime_error("Transaction index size is too small");
+      create(path, slots);
+      created = true;
+    }
+
+    bip::mode_t mode = writable ? bip::read_write : bip::read_only;
+    _file = bip::file_mapping(path.c_str(), mode);
+    map_file();
+
+    if( !created && (_hdr->magic != TRX_INDEX_MAGIC || _hdr->version != TRX_INDEX_VERSION) ) {
+      throw std::runtime_error("Invalid transaction index file: " + path);
+    }
+
+    if( writable && !created && size_mb * 1024*1024 > _region.get_size() ) {
+      wlog("Transaction index ${f} keeps its current size of ${s} MB, and grows when it's full",
+           ("f",path)("s",_region.get_size()/(1024*1024)));
+    }
+    ilog("Transaction index ${f}: ${e} entries, capacity ${c}",
+         ("f",path)("e",_hdr->entries)("c",_hdr->slot_count));
+  }
+
+
+  bool trx_index::exists(const std::string& path) {
+    return bfs::exists(path);
+  }
+
+
+  void trx_index::create(const std::string& path, uint64_t slots) {
+    std::ofstream ofs(path, std::ofstream::trunc);
+    ofs.close();
+    bfs::resize_file(path, sizeof(header) + slots * (sizeof(uint64_t) + sizeof(uint32_t)));
+
+    bip::file_mapping file(path.c_str(), bip::read_write);
+    bip::mapped_region region(file, bip::read_write, 0, sizeof(header));
+    header* hdr = static_cast<header*>(region.get_address());
+    hdr->magic = TRX_INDEX_MAGIC;
+    hdr->version = TRX_INDEX_VERSION;
+    hdr->last_block = 0;
+    hdr->slot_count = slots;
+    hdr->entries = 0;
+    hdr->superseded = 0;
+  }
+
+
+  void trx_index::map_file() {
+    bip::mode_t mode = _writable ? bip::read_write : bip::read_only;
+    _region = bip::mapped_region(_file, mode);
+    _hdr = static_cast<header*>(_region.get_address());
+    _keys = reinterpret_cast<uint64_t*>(reinterpret_cast<char*>(_hdr) + sizeof(header));
+    _blocks = reinterpret_cast<uint32_t*>(_keys + _hdr->slot_count);
+    _mask = _hdr->slot_count - 1;
+  }
+
+
+  uint64_t trx_index::key_of(const uint8_t* trx_id) {
+    uint64_t key;
+    memcpy(&key, trx_id, sizeof(key));
+    return (key == 0) ? 1 : key; // zero marks an empty slot
+  }
+
+
+  void trx_index::add(uint32_t block_num, const uint8_t* trx_id) {
+    _pending.push_back(pending_entry{block_num, key_of(trx_id)});
+  }
+
+
+  void trx_index::flush(uint32_t irreversible) {
+    if( _pending.empty() || _pending.front().block_num > irreversible )
+      return;
+    uint32_t last_block = _hdr->last_block;
+    while( !_pending.empty() && _pending.front().block_num <= irreversible ) {
+      auto& e = _pending.front();
+      insert(e.key, e.block_num);
+      if( e.block_num > last_block )
+        last_block = e.block_num;
+      _pending.pop_front();
+    }
+    __atomic_store_n(&_hdr->last_block, last_block, __ATOMIC_RELEASE);
+  }
+
+
+  void trx_index::rollback(uint32_t block_num) {
+    while( !_pending.empty() && _pending.back().block_num >= block_num )
+      _pending.pop_back();
+  }
+
+
+  void trx_index::insert(uint64_t key, uint32_t block_num) {
+    uint64_t pos = key & _mask;
+    while( true ) {
+      uint64_t k = __atomic_load_n(&_keys[pos], __ATOMIC_ACQUIRE);
+      if( k == 0 )
+        break;
+      if( k == key && _blocks[pos] == block_num )
+        return; // the block was replayed after a restart
+      pos = (pos + 1) & _mask;
+    }
+
+    if( (_hdr->entries + 1) * 100 > _hdr->slot_count * TRX_INDEX_MAX_LOAD )
+      grow();
+    store(key, block_num);
+  }
+
+
+  void trx_index::store(uint64_t key, uint32_t block_num) {
+    uint64_t pos = key & _mask;
+    while( __atomic_load_n(&_keys[pos], __ATOMIC_ACQUIRE) != 0 )
+      pos = (pos + 1) & _mask;
+
+    // the block number must be visible before the key that publishes the slot
+    __atomic_store_n(&_blocks[pos], block_num, __ATOMIC_RELAXED);
+    __atomic_store_n(&_keys[pos], key, __ATOMIC_RELEASE);
+    __atomic_store_n(&_hdr->entries, _hdr->entries + 1, __ATOMIC_RELEASE);
+  }
+
+
+  // The old file stays complete and valid until the new one replaces it,
+  // so readers never see a partially rehashed table.
+  void trx_index::grow() {
+    uint64_t slots = _hdr->slot_count * 2;
+    std::string new_path = _path + ".new";
+    ilog("Transaction index ${f} is full with ${e} entries, growing to ${s} slots",
+         ("f",_path)("e",_hdr->entries)("s",slots));
+    create(new_path, slots);
+
+    bip::file_mapping old_file = std::move(_file);
+    bip::mapped_region old_region = std::move(_region);
+    header* old_hdr = _hdr;
+    const uint64_t* old_keys = _keys;
+    const uint32_t* old_blocks = _blocks;
+
+    _file = bip::file_mapping(new_path.c_str(), bip::read_write);
+    map_file();
+    _hdr->last_block = old_hdr->last_block;
+    for( uint64_t pos = 0; pos < old_hdr->slot_count; pos++ ) {
+      if( old_keys[pos] != 0 )
+        store(old_keys[pos], old_blocks[pos]);
+    }
+
+    bfs::rename(new_path, _path);
+    __atomic_store_n(&old_hdr->superseded, 1, __ATOMIC_RELEASE);
+  }
+
+
+  std::vector<uint32_t> trx_index::lookup(const uint8_t* trx_id) {
+    if( __atomic_load_n(&_hdr->superseded, __ATOMIC_ACQUIRE) ) {
+      // the writer has replaced the file with a bigger one
+      _file = bip::file_mapping(_path.c_str(), bip::read_only);
+      map_file();
+    }
+    std::vector<uint32_t> result;
+    uint64_t key = key_of(trx_id);
+    uint64_t pos = key & _mask;
+    while( true ) {
+      uint64_t k = __atomic_load_n(&_keys[pos], __ATOMIC_ACQUIRE);
+      if( k == 0 )
+        break;
+      if( k == key )
+        result.push_back(__atomic_load_n(&_blocks[pos], __ATOMIC_RELAXED));
+      pos = (pos + 1) & _mask;
+    }
+    return result;
+  }
+
+
+  uint64_t trx_index::entries() const {
+    return __atomic_load_n(&_hdr->entries, __ATOMIC_ACQUIRE);
+  }
+
+
+  uint64_t trx_index::capacity() const {
+    return _hdr->slot_count;
+  }
+}
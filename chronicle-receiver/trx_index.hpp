@@ -0,0 +1,70 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace chronicle {
+
+  // On-disk hash index from transaction ID prefix to block number.
+  //
+  // The index is an open-addressing hash table in a pre-allocated memory-mapped
+  // file. Only the scanning receiver writes it, and only for irreversible
+  // blocks, so entries never need to be rolled back. Interactive readers map
+  // the same file read-only and do not need any locking.
+  //
+  // When the table gets full, the writer rehashes it into a new file of
+  // double size, renames it over the old one, and marks the old file as
+  // superseded. Readers reopen the file when they see the mark.
+
+  class trx_index {
+  public:
+    trx_index(const std::string& path, bool writable, uint64_t size_mb);
+
+    static bool exists(const std::string& path);
+
+    // memorize a transaction until its block becomes irreversible
+    void add(uint32_t block_num, const uint8_t* trx_id);
+
+    // write pending entries for blocks up to and including the given block
+    void flush(uint32_t irreversible);
+
+    // forget pending entries at or above the fork block
+    void rollback(uint32_t block_num);
+
+    // block numbers where transactions with the same ID prefix were found
+    std::vector<uint32_t> lookup(const uint8_t* trx_id);
+
+    uint64_t entries() const;
+    uint64_t capacity() const;
+
+  private:
+    struct header;
+
+    std::string                         _path;
+    boost::interprocess::file_mapping   _file;
+    boost::interprocess::mapped_region  _region;
+    header*                             _hdr = nullptr;
+    uint64_t*                           _keys = nullptr;
+    uint32_t*                           _blocks = nullptr;
+    uint64_t                            _mask = 0;
+    bool                                _writable;
+
+    struct pending_entry {
+      uint32_t   block_num;
+      uint64_t   key;
+    };
+    std::deque<pending_entry>           _pending;
+
+    static uint64_t key_of(const uint8_t* trx_id);
+    static void create(const std::string& path, uint64_t slots);
+    void map_file();
+    void insert(uint64_t key, uint32_t block_num);
+    void store(uint64_t key, uint32_t block_num);
+    void grow();
+  };
+}
@@ -0,0 +1,83 @@
+// copyright defined in LICENSE.txt
+
+#include "worker_pool.hpp"
+
+#include <boost/asio/post.hpp>
+#include <stdexcept>
+#include <fc/log/logger.hpp>
+
+namespace chronicle {
+
+  worker_pool::worker_pool(size_t threads) :
+    _threads(threads),
+    _pool(threads)
+  {
+    if( threads == 0 )
+      throw std::runtime_error("Worker pool needs at least one thread");
+  }
+
+
+  worker_pool::~worker_pool() {
+    _pool.join();
+  }
+
+
+  worker_group::worker_group(worker_pool& pool, bool sequential) :
+    _pool(pool)
+  {
+    if( sequential )
+      _strand = std::make_unique<strand>(pool._pool.get_executor());
+  }
+
+
+  worker_group::~worker_group() {
+    wait();
+  }
+
+
+  void worker_group::post(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending++;
+    }
+    auto job = [this, task = std::move(task)]() { run(task); };
+    if( _strand )
+      boost::asio::post(*_strand, std::move(job));
+    else
+      boost::asio::post(_pool._pool, std::move(job));
+  }
+
+
+  void worker_group::wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cond.wait(lock, [this]() { return _pending == 0; });
+  }
+
+
+  void worker_group::run(const std::function<void()>& task) {
+    try {
+      task();
+    }
+    catch( const std::exception& e ) {
+      elog("Background task failed: ${e}", ("e",e.what()));
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if( --_pending == 0 )
+      _cond.notify_all();
+  }
+
+
+  namespace {
+    size_t shared_worker_threads = 2;
+  }
+
+  void set_shared_worker_threads(size_t threads) {
+    shared_worker_threads = threads;
+  }
+
+
+  worker_pool& shared_workers() {
+    static worker_pool pool(shared_worker_threads);
+    return pool;
+  }
+}
@@ -0,0 +1,69 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace chronicle {
+
+  // Threads for background work that does not need the state database,
+  // such as parsing ABI and writing checkpoints. The threads are not tied
+  // to a particular job, so the CPU time goes to whichever job has work.
+
+  class worker_pool {
+  public:
+    explicit worker_pool(size_t threads);
+
+    // waits for the tasks that are already posted
+    ~worker_pool();
+
+    size_t threads() const { return _threads; }
+
+  private:
+    friend class worker_group;
+    size_t                     _threads;
+    boost::asio::thread_pool   _pool;
+  };
+
+
+  // Tasks of one job in a worker pool, so that the job can wait for its
+  // own tasks. Tasks of a sequential group run one at a time, in the order
+  // they are posted. An exception thrown by a task is logged.
+
+  class worker_group {
+  public:
+    worker_group(worker_pool& pool, bool sequential);
+
+    // waits for the tasks
+    ~worker_group();
+
+    void post(std::function<void()> task);
+
+    // blocks until all posted tasks are finished
+    void wait();
+
+  private:
+    using strand = boost::asio::strand<boost::asio::thread_pool::executor_type>;
+
+    worker_pool&               _pool;
+    std::unique_ptr<strand>    _strand;
+    std::mutex                 _mutex;
+    std::condition_variable    _cond;
+    size_t                     _pending = 0;
+
+    void run(const std::function<void()>& task);
+  };
+
+
+  // sets the number of threads in the shared pool. It must be called
+  // before the pool is used.
+  void set_shared_worker_threads(size_t threads);
+
+  // the pool shared by all jobs in the process, started on first use
+  worker_pool& shared_workers();
+}
@@ -0,0 +1,85 @@
+// copyright defined in LICENSE.txt
+
+#include "abi_log.hpp"
+#include "temp_dir.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <limits>
+
+using chronicle::abi_log;
+
+namespace {
+  void add_abi(abi_log& log, uint64_t account, uint32_t block_num, const std::string& abi) {
+    log.add(account, block_num, abi.data(), abi.size());
+  }
+
+  std::string abi_at(const abi_log& log, uint64_t account, uint32_t block_num) {
+    abi_log::lookup_result result;
+    if( !log.lookup(account, block_num, result) )
+      return "none";
+    return std::string(result.data.begin(), result.data.end());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(abi_log_tests)
+
+BOOST_AUTO_TEST_CASE(revisions_by_block) {
+  chronicle_tests::temp_dir dir;
+  abi_log log(dir.file("abi.bin"), true, 4);
+  add_abi(log, 100, 10, "a10");
+  add_abi(log, 200, 15, "b15");
+  add_abi(log, 100, 20, "a20");
+  add_abi(log, 100, 30, "");
+  add_abi(log, 100, 40, "a40");
+  log.flush(40);
+  BOOST_TEST(log.last_block() == 40u);
+  BOOST_TEST(log.entries() == 5u);
+
+  abi_log reader(dir.file("abi.bin"), false, 0);
+  BOOST_TEST(abi_at(reader, 100, 9) == "none");
+  BOOST_TEST(abi_at(reader, 100, 10) == "a10");
+  BOOST_TEST(abi_at(reader, 100, 19) == "a10");
+  BOOST_TEST(abi_at(reader, 100, 25) == "a20");
+  BOOST_TEST(abi_at(reader, 100, 35) == "");
+  BOOST_TEST(abi_at(reader, 100, 1000) == "a40");
+  BOOST_TEST(abi_at(reader, 200, 40) == "b15");
+  BOOST_TEST(abi_at(reader, 300, 40) == "none");
+
+  abi_log::lookup_result result;
+  BOOST_REQUIRE(reader.lookup(100, 25, result));
+  BOOST_TEST(result.revision == 20u);
+  BOOST_TEST(result.next_revision == 30u);
+  BOOST_REQUIRE(reader.lookup(100, 40, result));
+  BOOST_TEST(result.next_revision == std::numeric_limits<uint32_t>::max());
+}
+
+BOOST_AUTO_TEST_CASE(long_chain_with_jumps) {
+  chronicle_tests::temp_dir dir;
+  abi_log log(dir.file("abi.bin"), true, 4);
+  for( uint32_t b = 1; b <= 1000; b++ )
+    add_abi(log, 5, b * 3, std::to_string(b * 3));
+  log.flush(3000);
+  for( uint32_t b = 3; b <= 3002; b += 7 ) {
+    uint32_t revision = b / 3 * 3;
+    BOOST_TEST(abi_at(log, 5, b) == std::to_string(revision));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(last_revision_within_a_block_wins) {
+  chronicle_tests::temp_dir dir;
+  abi_log log(dir.file("abi.bin"), true, 4);
+  add_abi(log, 7, 10, "first");
+  add_abi(log, 7, 10, "second");
+  add_abi(log, 7, 11, "forked");
+  log.rollback(11);
+  log.flush(11);
+  BOOST_TEST(log.entries() == 1u);
+  BOOST_TEST(abi_at(log, 7, 11) == "second");
+
+  // replayed blocks after a restart are ignored
+  add_abi(log, 7, 10, "replayed");
+  log.flush(11);
+  BOOST_TEST(abi_at(log, 7, 10) == "second");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
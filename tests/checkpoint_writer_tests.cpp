@@ -0,0 +1,163 @@
+// copyright defined in LICENSE.txt
+
+#include "checkpoint_writer.hpp"
+#include "temp_dir.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <tuple>
+
+using chronicle::receiver_state;
+
+namespace {
+  // ABI starting with "bad" cannot be parsed
+  bool validate(uint64_t account, const std::string& abi) {
+    return abi.compare(0, 3, "bad") != 0;
+  }
+
+  // (type, account, block or chunk, data)
+  using record = std::tuple<uint8_t, uint64_t, uint32_t, std::string>;
+
+  std::vector<record> read_base(const std::string& path, uint32_t& block_num) {
+    chronicle::state_file_reader reader(path);
+    block_num = reader.read_u32();
+    std::array<uint8_t, 32> id;
+    reader.read_raw((char*)id.data(), id.size());
+    std::vector<record> records;
+    while( true ) {
+      uint8_t type = reader.read_u8();
+      if( type == chronicle::state_rec_end )
+        break;
+      uint64_t account = reader.read_u64();
+      uint32_t num = (type == chronicle::state_rec_contract_abi) ? 0 : reader.read_u32();
+      std::string data;
+      reader.read_bytes(data);
+      records.emplace_back(type, account, num, data);
+    }
+    reader.finish();
+    return records;
+  }
+
+  std::unique_ptr<receiver_state> make_state(uint32_t block_num, bool incremental) {
+    auto state = std::make_unique<receiver_state>();
+    state->incremental = incremental;
+    state->block_num = block_num;
+    state->block_id.fill(uint8_t(block_num));
+    return state;
+  }
+
+  // accounts 1 and 3 with an ABI each, and their activity
+  std::unique_ptr<receiver_state> base_state(const std::string& abi_of_3) {
+    auto state = make_state(10, false);
+    state->abis.push_back({1, {{1, "abi1"}}, "abi1", {}});
+    state->abis.push_back({3, {{5, abi_of_3}}, abi_of_3, {}});
+    state->activity.push_back({1, 0, "a1"});
+    state->activity.push_back({3, 0, "a3"});
+    return state;
+  }
+
+  // account 2 gets an ABI, account 3 a new one, and account 1 an ABI that cannot be used
+  std::unique_ptr<receiver_state> changes() {
+    auto state = make_state(20, true);
+    state->abis.push_back({1, {{12, "bad1"}}, "", {"bad1", "abi1"}});
+    state->abis.push_back({2, {{15, "abi2"}}, "abi2", {}});
+    state->abis.push_back({3, {{18, "abi3new"}}, "abi3new", {}});
+    state->activity.push_back({1, 0, "a1b"});
+    state->activity.push_back({2, 0, "a2"});
+    return state;
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(checkpoint_writer_tests)
+
+BOOST_AUTO_TEST_CASE(changes_go_to_the_delta_file) {
+  chronicle_tests::temp_dir dir;
+  chronicle::worker_pool workers(1);
+  auto base = dir.file("checkpoint.bin");
+  auto delta_file = dir.file("checkpoint-delta.bin");
+  {
+    chronicle::checkpoint_writer writer(workers, base, delta_file, validate);
+    BOOST_TEST(writer.needs_full());
+    // a large base keeps the changes from being merged
+    writer.save(base_state(std::string(10000, 'x')));
+    BOOST_TEST(!writer.needs_full());
+    writer.save(changes());
+  }
+
+  uint32_t block_num;
+  auto records = read_base(base, block_num);
+  BOOST_TEST(block_num == 10u);
+  BOOST_TEST(records.size() == 6u);
+
+  chronicle::checkpoint_delta delta;
+  BOOST_REQUIRE(chronicle::read_checkpoint_delta(delta_file, 10, delta));
+  BOOST_TEST(delta.block_num == 20u);
+  BOOST_TEST(delta.block_id[0] == 20);
+  BOOST_TEST(delta.abi_history.size() == 3u);
+  BOOST_TEST(delta.abi_history.at(std::make_pair(uint64_t(2), uint32_t(15))) == "abi2");
+  // the newest candidate is not valid, so the previous one is used
+  BOOST_TEST(delta.contract_abi.at(1) == "abi1");
+  BOOST_TEST(delta.contract_abi.at(3) == "abi3new");
+  BOOST_TEST(delta.activity.at(std::make_pair(uint64_t(1), uint32_t(0))) == "a1b");
+
+  // a delta of a different base is ignored
+  chronicle::checkpoint_delta other;
+  BOOST_TEST(!chronicle::read_checkpoint_delta(delta_file, 11, other));
+
+  // the position is found after a restart
+  chronicle::checkpoint_writer writer(workers, base, delta_file, validate);
+  BOOST_TEST(writer.last_block() == 20u);
+  BOOST_TEST(!writer.needs_full());
+}
+
+BOOST_AUTO_TEST_CASE(large_delta_is_merged_into_the_base) {
+  chronicle_tests::temp_dir dir;
+  chronicle::worker_pool workers(1);
+  auto base = dir.file("checkpoint.bin");
+  auto delta_file = dir.file("checkpoint-delta.bin");
+  {
+    chronicle::checkpoint_writer writer(workers, base, delta_file, validate);
+    writer.save(base_state("abi3"));
+    writer.save(changes());
+  }
+  BOOST_TEST(!boost::filesystem::exists(delta_file));
+
+  uint32_t block_num;
+  auto records = read_base(base, block_num);
+  BOOST_TEST(block_num == 20u);
+  std::vector<record> expected = {
+    record{chronicle::state_rec_abi_history, 1, 1, "abi1"},
+    record{chronicle::state_rec_abi_history, 1, 12, "bad1"},
+    record{chronicle::state_rec_contract_abi, 1, 0, "abi1"},
+    record{chronicle::state_rec_abi_history, 2, 15, "abi2"},
+    record{chronicle::state_rec_contract_abi, 2, 0, "abi2"},
+    record{chronicle::state_rec_abi_history, 3, 5, "abi3"},
+    record{chronicle::state_rec_abi_history, 3, 18, "abi3new"},
+    record{chronicle::state_rec_contract_abi, 3, 0, "abi3new"},
+    record{chronicle::state_rec_account_activity, 1, 0, "a1b"},
+    record{chronicle::state_rec_account_activity, 2, 0, "a2"},
+    record{chronicle::state_rec_account_activity, 3, 0, "a3"},
+  };
+  BOOST_TEST(records == expected);
+
+  chronicle::checkpoint_writer writer(workers, base, delta_file, validate);
+  BOOST_TEST(writer.last_block() == 20u);
+}
+
+BOOST_AUTO_TEST_CASE(changes_without_a_base_are_skipped) {
+  chronicle_tests::temp_dir dir;
+  chronicle::worker_pool workers(1);
+  auto base = dir.file("checkpoint.bin");
+  auto delta_file = dir.file("checkpoint-delta.bin");
+  {
+    chronicle::checkpoint_writer writer(workers, base, delta_file, validate);
+    BOOST_TEST(writer.last_block() == 0u);
+    writer.save(changes());
+    writer.stop();
+    BOOST_TEST(writer.needs_full());
+  }
+  BOOST_TEST(!boost::filesystem::exists(base));
+  BOOST_TEST(!boost::filesystem::exists(delta_file));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,96 @@
+// copyright defined in LICENSE.txt
+
+#include "live_ring.hpp"
+#include "temp_dir.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using chronicle::live_ring;
+
+namespace {
+  std::string block_data(uint32_t block_num) {
+    return "block " + std::to_string(block_num) + std::string(block_num % 7, '.');
+  }
+
+  void add_blocks(live_ring& ring, uint32_t first, uint32_t last) {
+    for( uint32_t b = first; b <= last; b++ ) {
+      auto data = block_data(b);
+      ring.add(b, data.data(), data.size());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(live_ring_tests)
+
+BOOST_AUTO_TEST_CASE(results_across_the_wrap) {
+  chronicle_tests::temp_dir dir;
+  // the data area holds only a few results, so it wraps around many times
+  live_ring ring(dir.file("ring.bin"), true, 8, 64);
+  add_blocks(ring, 1, 50);
+  ring.flush(50);
+  BOOST_TEST(ring.last_block() == 50u);
+
+  live_ring reader(dir.file("ring.bin"), false);
+  std::string out;
+  uint32_t found = 0;
+  for( uint32_t b = 1; b <= 50; b++ ) {
+    if( reader.get(b, out) ) {
+      BOOST_TEST(out == block_data(b));
+      found++;
+    }
+  }
+  // the newest blocks that fit in the data area are available, older ones are not
+  BOOST_TEST(reader.get(50, out));
+  BOOST_TEST(reader.get(49, out));
+  BOOST_TEST(!reader.get(1, out));
+  BOOST_TEST(!reader.get(42, out));
+  BOOST_TEST(found >= 2u);
+  BOOST_TEST(found < 8u);
+}
+
+BOOST_AUTO_TEST_CASE(pending_results_and_forks) {
+  chronicle_tests::temp_dir dir;
+  live_ring ring(dir.file("ring.bin"), true, 16, 4096);
+  add_blocks(ring, 1, 10);
+  ring.rollback(8);
+  std::string fork = "forked";
+  ring.add(8, fork.data(), fork.size());
+  ring.flush(8);
+
+  std::string out;
+  BOOST_TEST(ring.last_block() == 8u);
+  BOOST_TEST(ring.get(7, out));
+  BOOST_TEST(out == block_data(7));
+  BOOST_TEST(ring.get(8, out));
+  BOOST_TEST(out == fork);
+  BOOST_TEST(!ring.get(9, out));
+  BOOST_TEST(ring.covers(1, 9));
+  BOOST_TEST(!ring.covers(1, 10));
+}
+
+BOOST_AUTO_TEST_CASE(first_block_follows_the_slots) {
+  chronicle_tests::temp_dir dir;
+  live_ring ring(dir.file("ring.bin"), true, 16, 4096);
+  BOOST_TEST(ring.first_block() == 0u);
+  add_blocks(ring, 1, 10);
+  ring.flush(10);
+  BOOST_TEST(ring.first_block() == 1u);
+  add_blocks(ring, 11, 40);
+  ring.flush(40);
+  BOOST_TEST(ring.first_block() == 25u);
+  std::string out;
+  BOOST_TEST(ring.get(25, out));
+  BOOST_TEST(!ring.get(24, out));
+}
+
+BOOST_AUTO_TEST_CASE(result_larger_than_the_ring_is_skipped) {
+  chronicle_tests::temp_dir dir;
+  live_ring ring(dir.file("ring.bin"), true, 4, 16);
+  std::string big(100, 'x');
+  ring.add(1, big.data(), big.size());
+  ring.flush(1);
+  std::string out;
+  BOOST_TEST(!ring.get(1, out));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
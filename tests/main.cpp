@@ -0,0 +1,4 @@
+// copyright defined in LICENSE.txt
+
+#define BOOST_TEST_MODULE chronicle unit tests
+#include <boost/test/unit_test.hpp>
@@ -0,0 +1,73 @@
+// copyright defined in LICENSE.txt
+
+#include "replication.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+using chronicle::replication_message;
+namespace replication = chronicle::replication;
+
+namespace {
+  // the message without its length prefix, after checking the prefix
+  std::string payload(const std::string& framed) {
+    BOOST_REQUIRE(framed.size() >= 4);
+    uint32_t size;
+    memcpy(&size, framed.data(), sizeof(size));
+    BOOST_REQUIRE(size == framed.size() - 4);
+    return framed.substr(4);
+  }
+
+  replication_message decode(const std::string& framed) {
+    auto data = payload(framed);
+    replication_message msg;
+    replication::decode(data.data(), data.size(), msg);
+    return msg;
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(replication_tests)
+
+BOOST_AUTO_TEST_CASE(encode_and_decode) {
+  auto msg = decode(replication::encode_abi_history(0x1122334455667788ull, 42, "abi", 3));
+  BOOST_TEST(msg.type == chronicle::repl_abi_history);
+  BOOST_TEST(msg.account == 0x1122334455667788ull);
+  BOOST_TEST(msg.block_num == 42u);
+  BOOST_TEST(msg.data == "abi");
+
+  msg = decode(replication::encode_abi_history(5, 43, nullptr, 0));
+  BOOST_TEST(msg.data.empty());
+
+  msg = decode(replication::encode_account_activity(6, 44));
+  BOOST_TEST(msg.type == chronicle::repl_account_activity);
+  BOOST_TEST(msg.account == 6u);
+  BOOST_TEST(msg.block_num == 44u);
+
+  msg = decode(replication::encode_activity_chunk(7, 3, "bits", 4));
+  BOOST_TEST(msg.type == chronicle::repl_activity_chunk);
+  BOOST_TEST(msg.block_num == 3u);
+  BOOST_TEST(msg.data == "bits");
+
+  std::string id(32, 'i');
+  msg = decode(replication::encode_irreversible(45, id.data()));
+  BOOST_TEST(msg.type == chronicle::repl_irreversible);
+  BOOST_TEST(msg.block_num == 45u);
+  BOOST_TEST(msg.data == id);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_messages_are_rejected) {
+  replication_message msg;
+  auto data = payload(replication::encode_account_activity(6, 44));
+  BOOST_CHECK_THROW(replication::decode(data.data(), 12, msg), std::runtime_error);
+
+  data[0] = 0;
+  BOOST_CHECK_THROW(replication::decode(data.data(), data.size(), msg), std::runtime_error);
+  data[0] = 5;
+  BOOST_CHECK_THROW(replication::decode(data.data(), data.size(), msg), std::runtime_error);
+
+  std::string id(32, 'i');
+  data = payload(replication::encode_irreversible(45, id.data()));
+  BOOST_CHECK_THROW(replication::decode(data.data(), data.size() - 1, msg), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// copyright defined in LICENSE.txt
+
+#include "ship_relay.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+namespace ship_protocol = chronicle::ship_protocol;
+
+namespace {
+  void put_u32(std::string& out, uint32_t v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  void put_position(std::string& out, uint32_t block_num, char id) {
+    put_u32(out, block_num);
+    out.append(32, id);
+  }
+
+  void put_optional_bytes(std::string& out, const std::string& data) {
+    out.push_back(1);
+    out.push_back(char(data.size())); // varuint32 of a short size
+    out.append(data);
+  }
+
+  // get_blocks_result_v0 of a block, as nodeos sends it
+  std::string blocks_result(uint32_t block_num) {
+    std::string out;
+    out.push_back(1);
+    put_position(out, block_num, 'h');
+    put_position(out, block_num - 1, 'l');
+    out.push_back(1);
+    put_position(out, block_num, 'b');
+    out.push_back(1);
+    put_position(out, block_num - 1, 'p');
+    put_optional_bytes(out, "BLOCK");
+    put_optional_bytes(out, "TRACES");
+    put_optional_bytes(out, "DELTAS");
+    return out;
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(ship_relay_tests)
+
+BOOST_AUTO_TEST_CASE(result_block) {
+  uint32_t block_num = 0;
+  std::string id;
+  BOOST_REQUIRE(ship_protocol::result_block(blocks_result(100), block_num, id));
+  BOOST_TEST(block_num == 100u);
+  BOOST_TEST(id == std::string(32, 'b'));
+
+  // a result without this_block
+  std::string out;
+  out.push_back(1);
+  put_position(out, 100, 'h');
+  put_position(out, 99, 'l');
+  out.append(5, '\0');
+  BOOST_TEST(!ship_protocol::result_block(out, block_num, id));
+}
+
+BOOST_AUTO_TEST_CASE(filter_result) {
+  std::string head_id(32, 'H');
+  std::string lib_id(32, 'L');
+  auto raw = blocks_result(100);
+
+  // everything requested: only head and irreversible block are replaced
+  auto all = ship_protocol::filter_result(raw, 200, head_id, 150, lib_id, true, true, true);
+  std::string expected = raw;
+  memcpy(&expected[1], "\xc8\0\0\0", 4);
+  expected.replace(5, 32, head_id);
+  memcpy(&expected[37], "\x96\0\0\0", 4);
+  expected.replace(41, 32, lib_id);
+  BOOST_TEST(all == expected);
+
+  // unrequested parts become empty optionals
+  auto traces_only = ship_protocol::filter_result(raw, 200, head_id, 150, lib_id, false, true, false);
+  std::string tail;
+  tail.push_back(0);
+  put_optional_bytes(tail, "TRACES");
+  tail.push_back(0);
+  BOOST_TEST(traces_only == expected.substr(0, 1 + 4 * 36 + 2) + tail);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_results_are_rejected) {
+  std::string head_id(32, 'H');
+  auto raw = blocks_result(100);
+  BOOST_CHECK_THROW(ship_protocol::filter_result(raw.substr(0, raw.size() - 1), 1, head_id, 1, head_id,
+                                                 true, true, true), std::runtime_error);
+  raw[0] = 0; // get_status_result_v0
+  uint32_t block_num;
+  std::string id;
+  BOOST_CHECK_THROW(ship_protocol::result_block(raw, block_num, id), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
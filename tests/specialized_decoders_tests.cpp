@@ -0,0 +1,245 @@
+// copyright defined in LICENSE.txt
+
+#include "specialized_decoders.hpp"
+
+#include <abieos.h>
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace specialized_decoders = chronicle::specialized_decoders;
+
+namespace {
+
+  struct type_desc {
+    const char*                                         name;
+    std::vector<std::pair<const char*, const char*>>    fields;
+  };
+
+  // the types of the standard eosio.token and eosio.system contracts
+  const std::vector<type_desc> standard_structs = {
+    {"transfer", {{"from", "name"}, {"to", "name"}, {"quantity", "asset"}, {"memo", "string"}}},
+    {"buyrambytes", {{"payer", "name"}, {"receiver", "name"}, {"bytes", "uint32"}}},
+    {"delegatebw", {{"from", "name"}, {"receiver", "name"}, {"stake_net_quantity", "asset"},
+                    {"stake_cpu_quantity", "asset"}, {"transfer", "bool"}}},
+    {"account", {{"balance", "asset"}}},
+    {"currency_stats", {{"supply", "asset"}, {"max_supply", "asset"}, {"issuer", "name"}}},
+  };
+
+  const std::vector<std::pair<const char*, const char*>> standard_actions = {
+    {"transfer", "transfer"}, {"buyrambytes", "buyrambytes"}, {"delegatebw", "delegatebw"}};
+
+  const std::vector<std::pair<const char*, const char*>> standard_tables = {
+    {"accounts", "account"}, {"stat", "currency_stats"}};
+
+
+  abieos::abi_def make_abi_def(const std::vector<type_desc>& structs) {
+    abieos::abi_def abi;
+    abi.version = "eosio::abi/1.1";
+    for( auto& s : structs ) {
+      abieos::struct_def def;
+      def.name = s.name;
+      for( auto& f : s.fields )
+        def.fields.push_back(abieos::field_def{f.first, f.second});
+      abi.structs.push_back(def);
+    }
+    for( auto& a : standard_actions ) {
+      abieos::action_def def;
+      def.name = abieos::name(a.first);
+      def.type = a.second;
+      abi.actions.push_back(def);
+    }
+    for( auto& t : standard_tables ) {
+      abieos::table_def def;
+      def.name = abieos::name(t.first);
+      def.index_type = "i64";
+      def.type = t.second;
+      abi.tables.push_back(def);
+    }
+    return abi;
+  }
+
+
+  std::string make_abi_json(const std::vector<type_desc>& structs) {
+    std::string json = "{\"version\":\"eosio::abi/1.1\",\"structs\":[";
+    for( size_t i = 0; i < structs.size(); i++ ) {
+      json += std::string(i ? "," : "") + "{\"name\":\"" + structs[i].name + "\",\"base\":\"\",\"fields\":[";
+      for( size_t j = 0; j < structs[i].fields.size(); j++ ) {
+        json += std::string(j ? "," : "") + "{\"name\":\"" + structs[i].fields[j].first +
+          "\",\"type\":\"" + structs[i].fields[j].second + "\"}";
+      }
+      json += "]}";
+    }
+    json += "],\"actions\":[";
+    for( size_t i = 0; i < standard_actions.size(); i++ ) {
+      json += std::string(i ? "," : "") + "{\"name\":\"" + standard_actions[i].first +
+        "\",\"type\":\"" + standard_actions[i].second + "\",\"ricardian_contract\":\"\"}";
+    }
+    json += "],\"tables\":[";
+    for( size_t i = 0; i < standard_tables.size(); i++ ) {
+      json += std::string(i ? "," : "") + "{\"name\":\"" + standard_tables[i].first +
+        "\",\"index_type\":\"i64\",\"key_names\":[],\"key_types\":[],\"type\":\"" +
+        standard_tables[i].second + "\"}";
+    }
+    json += "]}";
+    return json;
+  }
+
+
+  void put_u64(std::string& out, uint64_t v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  void put_name(std::string& out, const char* name) {
+    put_u64(out, abieos::name(name).value);
+  }
+
+  void put_asset(std::string& out, int64_t amount, uint8_t precision, const std::string& code) {
+    put_u64(out, amount);
+    uint64_t symbol = precision;
+    for( size_t i = 0; i < code.size(); i++ )
+      symbol |= uint64_t(uint8_t(code[i])) << (8 * (i + 1));
+    put_u64(out, symbol);
+  }
+
+  void put_string(std::string& out, const std::string& v) {
+    uint32_t size = v.size();
+    do {
+      uint8_t b = size & 0x7f;
+      size >>= 7;
+      if( size )
+        b |= 0x80;
+      out.push_back(b);
+    } while( size );
+    out.append(v);
+  }
+
+
+  // decodes the same data with abieos and with the specialized decoder
+  struct fixture {
+    std::shared_ptr<abieos_context>                        ctxt{abieos_create(), abieos_destroy};
+    uint64_t                                               contract = abieos::name("eosio.token").value;
+    std::shared_ptr<const specialized_decoders::decoder_set> decoders;
+
+    fixture() {
+      BOOST_REQUIRE(abieos_set_abi(ctxt.get(), contract, make_abi_json(standard_structs).c_str()));
+      decoders = specialized_decoders::match_abi(make_abi_def(standard_structs));
+      BOOST_REQUIRE(decoders);
+    }
+
+    std::string generic(const char* type, const std::string& data) {
+      const char* json = abieos_bin_to_json(ctxt.get(), contract, type, data.data(), data.size());
+      BOOST_REQUIRE_MESSAGE(json, abieos_get_error(ctxt.get()));
+      return json;
+    }
+
+    std::string specialized(specialized_decoders::decode_fn decode, const std::string& data) {
+      BOOST_REQUIRE(decode);
+      rapidjson::StringBuffer buffer;
+      specialized_decoders::json_writer writer(buffer);
+      BOOST_REQUIRE(decode(data.data(), data.data() + data.size(), writer));
+      return std::string(buffer.GetString(), buffer.GetSize());
+    }
+
+    void check_action(const char* action, const char* type, const std::string& data) {
+      BOOST_TEST(specialized(decoders->action(abieos::name(action).value), data) == generic(type, data));
+    }
+
+    void check_table(const char* table, const char* type, const std::string& data) {
+      BOOST_TEST(specialized(decoders->table(abieos::name(table).value), data) == generic(type, data));
+    }
+  };
+}
+
+
+BOOST_AUTO_TEST_SUITE(specialized_decoders_tests)
+
+BOOST_FIXTURE_TEST_CASE(transfer_matches_abieos, fixture) {
+  struct sample { int64_t amount; uint8_t precision; const char* code; const char* memo; };
+  const sample samples[] = {
+    {10000, 4, "EOS", "hello"},
+    {-10000, 4, "EOS", "negative"},
+    {-1, 4, "EOS", ""},
+    {0, 4, "EOS", ""},
+    {12345, 0, "WAX", "precision 0"},
+    {-12345, 0, "WAX", ""},
+    {INT64_MAX, 8, "BTC", ""},
+    {INT64_MIN + 1, 18, "LONGSYM", ""},
+    {7, 4, "EOS", "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xe4\xb8\x96\xe7\x95\x8c \xf0\x9f\x9a\x80"},
+    {7, 4, "EOS", "quote \" backslash \\ newline \n tab \t control \x01"},
+  };
+  for( auto& s : samples ) {
+    std::string data;
+    put_name(data, "alice");
+    put_name(data, "bob.x");
+    put_asset(data, s.amount, s.precision, s.code);
+    put_string(data, s.memo);
+    check_action("transfer", "transfer", data);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(system_actions_match_abieos, fixture) {
+  std::string data;
+  put_name(data, "payer");
+  put_name(data, "receiver1234");
+  data.append("\xff\xff\xff\xff", 4);
+  check_action("buyrambytes", "buyrambytes", data);
+
+  for( uint8_t transfer : {0, 1} ) {
+    data.clear();
+    put_name(data, "eosio");
+    put_name(data, "a.b.c");
+    put_asset(data, 5000, 4, "EOS");
+    put_asset(data, 0, 4, "EOS");
+    data.push_back(transfer);
+    check_action("delegatebw", "delegatebw", data);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(tables_match_abieos, fixture) {
+  std::string data;
+  put_asset(data, -42, 2, "USD");
+  check_table("accounts", "account", data);
+
+  data.clear();
+  put_asset(data, 100000000, 4, "TKN");
+  put_asset(data, 0, 0, "TKN");
+  put_name(data, "issuer");
+  check_table("stat", "currency_stats", data);
+}
+
+BOOST_FIXTURE_TEST_CASE(wrong_data_falls_back, fixture) {
+  std::string data;
+  put_name(data, "alice");
+  put_name(data, "bob");
+  put_asset(data, 1, 4, "EOS");
+  put_string(data, "memo");
+  auto decode = decoders->action(abieos::name("transfer").value);
+  rapidjson::StringBuffer buffer;
+  specialized_decoders::json_writer writer(buffer);
+  BOOST_TEST(!decode(data.data(), data.data() + data.size() - 1, writer));
+  std::string extra = data + "x";
+  BOOST_TEST(!decode(extra.data(), extra.data() + extra.size(), writer));
+  BOOST_TEST(buffer.GetSize() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(deviating_abi_is_not_matched) {
+  auto structs = standard_structs;
+  structs[0].fields[3].second = "bytes"; // transfer memo
+  structs[3].fields.push_back({"frozen", "bool"}); // account
+  auto decoders = specialized_decoders::match_abi(make_abi_def(structs));
+  BOOST_REQUIRE(decoders);
+  BOOST_TEST(!decoders->action(abieos::name("transfer").value));
+  BOOST_TEST(!decoders->table(abieos::name("accounts").value));
+  BOOST_TEST(decoders->action(abieos::name("delegatebw").value));
+}
+
+BOOST_AUTO_TEST_CASE(may_match_finds_names) {
+  std::string abi = "unrelated binary ABI";
+  BOOST_TEST(!specialized_decoders::may_match(abi.data(), abi.size()));
+  put_name(abi, "stat");
+  BOOST_TEST(specialized_decoders::may_match(abi.data(), abi.size()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+// copyright defined in LICENSE.txt
+
+#include "state_file.hpp"
+#include "temp_dir.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+
+using chronicle::state_file_reader;
+using chronicle::state_file_writer;
+
+namespace {
+  void write_sample(const std::string& path, bool compressed) {
+    state_file_writer w(path, compressed);
+    w.write_u8(7);
+    w.write_u32(123456);
+    w.write_u64(0x0102030405060708ull);
+    w.write_bytes("payload", 7);
+    w.write_bytes("", 0);
+    w.commit();
+  }
+
+  void read_sample(const std::string& path) {
+    state_file_reader r(path);
+    BOOST_TEST(r.read_u8() == 7u);
+    BOOST_TEST(r.read_u32() == 123456u);
+    BOOST_TEST(r.read_u64() == 0x0102030405060708ull);
+    std::string data;
+    r.read_bytes(data);
+    BOOST_TEST(data == "payload");
+    r.read_bytes(data);
+    BOOST_TEST(data.empty());
+    r.finish();
+  }
+
+  // reads the sample without checking the values, as a damaged file may have any
+  void read_sample_unchecked(const std::string& path) {
+    state_file_reader r(path);
+    r.read_u8();
+    r.read_u32();
+    r.read_u64();
+    std::string data;
+    r.read_bytes(data);
+    r.read_bytes(data);
+    r.finish();
+  }
+
+  // flips one bit in a byte counted from the end of the file
+  void corrupt(const std::string& path, uint64_t from_end) {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekg(-int64_t(from_end), std::ios::end);
+    char c;
+    f.read(&c, 1);
+    c ^= 0x01;
+    f.seekp(-int64_t(from_end), std::ios::end);
+    f.write(&c, 1);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(state_file_tests)
+
+BOOST_AUTO_TEST_CASE(round_trip) {
+  chronicle_tests::temp_dir dir;
+  for( bool compressed : {false, true} ) {
+    auto path = dir.file(compressed ? "state.gz" : "state.bin");
+    write_sample(path, compressed);
+    BOOST_TEST(chronicle::state_file_exists(path));
+    BOOST_TEST(!boost::filesystem::exists(path + ".tmp"));
+    read_sample(path);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(corrupted_data_fails_the_checksum) {
+  chronicle_tests::temp_dir dir;
+  auto path = dir.file("state.bin");
+  write_sample(path, false);
+  corrupt(path, 10); // inside the payload, before the CRC
+  BOOST_CHECK_THROW(read_sample_unchecked(path), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(corrupted_crc_is_rejected) {
+  chronicle_tests::temp_dir dir;
+  auto path = dir.file("state.bin");
+  write_sample(path, false);
+  corrupt(path, 1);
+  BOOST_CHECK_THROW(read_sample_unchecked(path), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(truncated_file_is_rejected) {
+  chronicle_tests::temp_dir dir;
+  auto path = dir.file("state.bin");
+  write_sample(path, false);
+  boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 4);
+  BOOST_CHECK_THROW(read_sample_unchecked(path), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(uncommitted_file_is_discarded) {
+  chronicle_tests::temp_dir dir;
+  auto path = dir.file("state.bin");
+  {
+    state_file_writer w(path, false);
+    w.write_u32(1);
+  }
+  BOOST_TEST(!chronicle::state_file_exists(path));
+  BOOST_TEST(!boost::filesystem::exists(path + ".tmp"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
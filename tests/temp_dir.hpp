@@ -0,0 +1,28 @@
+// copyright defined in LICENSE.txt
+
+#pragma once
+#include <boost/filesystem.hpp>
+#include <string>
+
+namespace chronicle_tests {
+
+  // a fresh directory that is removed with all its contents at the end of the test
+  struct temp_dir {
+    boost::filesystem::path   path;
+
+    temp_dir() :
+      path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("chronicle-test-%%%%-%%%%"))
+    {
+      boost::filesystem::create_directories(path);
+    }
+
+    ~temp_dir() {
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(path, ec);
+    }
+
+    std::string file(const std::string& name) const {
+      return (path / name).string();
+    }
+  };
+}
@@ -0,0 +1,73 @@
+// copyright defined in LICENSE.txt
+
+#include "time_index.hpp"
+#include "temp_dir.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using chronicle::time_index;
+
+BOOST_AUTO_TEST_SUITE(time_index_tests)
+
+BOOST_AUTO_TEST_CASE(exact_and_interpolated_blocks) {
+  chronicle_tests::temp_dir dir;
+  time_index idx(dir.file("time.bin"), true);
+  // every 10th block is indexed, and slots 1030..1039 were missed by producers
+  idx.add(100, 1000);
+  idx.add(110, 1010);
+  idx.add(120, 1020);
+  idx.add(130, 1040);
+  idx.flush(130);
+  BOOST_TEST(idx.entries() == 4u);
+
+  BOOST_TEST(idx.block_at(0) == 100u);
+  BOOST_TEST(idx.block_at(1000) == 100u);
+  BOOST_TEST(idx.block_at(1010) == 110u);
+  BOOST_TEST(idx.block_at(1001) == 101u);
+  BOOST_TEST(idx.block_at(1015) == 115u);
+  BOOST_TEST(idx.block_at(1021) == 121u);  // rounds up over the gap
+  BOOST_TEST(idx.block_at(1039) == 130u);
+  BOOST_TEST(idx.block_at(1040) == 130u);
+  BOOST_TEST(idx.block_at(1041) == 131u);
+}
+
+BOOST_AUTO_TEST_CASE(pending_records_and_forks) {
+  chronicle_tests::temp_dir dir;
+  time_index idx(dir.file("time.bin"), true);
+  idx.add(1, 10);
+  idx.add(2, 11);
+  idx.add(3, 12);
+  idx.rollback(3);
+  idx.add(3, 13);
+  idx.flush(2);
+  BOOST_TEST(idx.entries() == 2u);
+  idx.flush(3);
+  BOOST_TEST(idx.entries() == 3u);
+  BOOST_TEST(idx.block_at(13) == 3u);
+
+  // a replayed block after restart is ignored
+  idx.add(3, 13);
+  idx.flush(3);
+  BOOST_TEST(idx.entries() == 3u);
+}
+
+BOOST_AUTO_TEST_CASE(reader_sees_grown_file) {
+  chronicle_tests::temp_dir dir;
+  time_index writer(dir.file("time.bin"), true);
+  writer.add(1, 1);
+  writer.flush(1);
+  time_index reader(dir.file("time.bin"), false);
+  // more records than the initial file size holds
+  for( uint32_t b = 2; b <= 1200000; b++ )
+    writer.add(b, b);
+  writer.flush(1200000);
+  BOOST_TEST(reader.block_at(1199999) == 1199999u);
+}
+
+BOOST_AUTO_TEST_CASE(empty_index_throws) {
+  chronicle_tests::temp_dir dir;
+  time_index idx(dir.file("time.bin"), true);
+  BOOST_CHECK_THROW(idx.block_at(1), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
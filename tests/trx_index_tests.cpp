@@ -0,0 +1,74 @@
+// copyright defined in LICENSE.txt
+
+#include "trx_index.hpp"
+#include "temp_dir.hpp"
+
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+using chronicle::trx_index;
+
+namespace {
+  struct trx_id {
+    uint8_t  bytes[32] = {};
+    trx_id(uint64_t key) { memcpy(bytes, &key, sizeof(key)); }
+  };
+}
+
+BOOST_AUTO_TEST_SUITE(trx_index_tests)
+
+BOOST_AUTO_TEST_CASE(pending_entries_are_written_on_flush) {
+  chronicle_tests::temp_dir dir;
+  trx_index idx(dir.file("trx.bin"), true, 1);
+  idx.add(10, trx_id(1001).bytes);
+  idx.add(11, trx_id(1002).bytes);
+  idx.add(12, trx_id(1003).bytes);
+  BOOST_TEST(idx.lookup(trx_id(1001).bytes).empty());
+
+  idx.rollback(12);
+  idx.flush(12);
+  BOOST_TEST(idx.entries() == 2u);
+  BOOST_TEST(idx.lookup(trx_id(1001).bytes) == std::vector<uint32_t>{10});
+  BOOST_TEST(idx.lookup(trx_id(1002).bytes) == std::vector<uint32_t>{11});
+  BOOST_TEST(idx.lookup(trx_id(1003).bytes).empty());
+}
+
+BOOST_AUTO_TEST_CASE(same_prefix_returns_all_blocks) {
+  chronicle_tests::temp_dir dir;
+  trx_index idx(dir.file("trx.bin"), true, 1);
+  idx.add(5, trx_id(77).bytes);
+  idx.add(9, trx_id(77).bytes);
+  idx.flush(9);
+  auto blocks = idx.lookup(trx_id(77).bytes);
+  std::sort(blocks.begin(), blocks.end());
+  BOOST_TEST(blocks == (std::vector<uint32_t>{5, 9}));
+}
+
+BOOST_AUTO_TEST_CASE(full_index_grows_and_readers_follow) {
+  chronicle_tests::temp_dir dir;
+  trx_index writer(dir.file("trx.bin"), true, 1);
+  trx_index reader(dir.file("trx.bin"), false, 0);
+  uint64_t capacity = writer.capacity();
+  uint64_t count = capacity; // more than the load limit of the original table
+
+  for( uint64_t i = 1; i <= count; i++ )
+    writer.add(uint32_t(i), trx_id(i * 0x9e3779b97f4a7c15ull).bytes);
+  writer.flush(uint32_t(count));
+
+  BOOST_TEST(writer.capacity() > capacity);
+  BOOST_TEST(writer.entries() == count);
+  for( uint64_t i = 1; i <= count; i += 97 ) {
+    auto blocks = reader.lookup(trx_id(i * 0x9e3779b97f4a7c15ull).bytes);
+    BOOST_REQUIRE(blocks.size() == 1u);
+    BOOST_TEST(blocks[0] == i);
+  }
+  BOOST_TEST(reader.capacity() == writer.capacity());
+}
+
+BOOST_AUTO_TEST_CASE(reader_requires_existing_file) {
+  chronicle_tests::temp_dir dir;
+  BOOST_CHECK_THROW(trx_index(dir.file("missing.bin"), false, 0), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
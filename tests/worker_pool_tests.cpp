@@ -0,0 +1,64 @@
+// copyright defined in LICENSE.txt
+
+#include "worker_pool.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(worker_pool_tests)
+
+BOOST_AUTO_TEST_CASE(sequential_group_keeps_the_order) {
+  chronicle::worker_pool pool(4);
+  std::vector<int> done;
+  chronicle::worker_group group(pool, true);
+  for( int i = 0; i < 100; i++ ) {
+    group.post([&done, i]() {
+        if( i % 10 == 0 )
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        done.push_back(i);
+      });
+  }
+  group.wait();
+  BOOST_REQUIRE(done.size() == 100u);
+  for( int i = 0; i < 100; i++ )
+    BOOST_TEST(done[i] == i);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_group_uses_all_threads) {
+  chronicle::worker_pool pool(3);
+  chronicle::worker_group group(pool, false);
+  std::atomic<int> running{0};
+  std::atomic<int> max_running{0};
+  for( int i = 0; i < 3; i++ ) {
+    group.post([&]() {
+        int now = ++running;
+        int seen = max_running;
+        while( now > seen && !max_running.compare_exchange_weak(seen, now) )
+          ;
+        // waits for the other tasks, so that all of them run at once
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while( max_running < 3 && std::chrono::steady_clock::now() < deadline )
+          std::this_thread::yield();
+        --running;
+      });
+  }
+  group.wait();
+  BOOST_TEST(max_running == 3);
+}
+
+BOOST_AUTO_TEST_CASE(failed_task_does_not_stop_the_group) {
+  chronicle::worker_pool pool(1);
+  int done = 0;
+  {
+    chronicle::worker_group group(pool, true);
+    group.post([]() { throw std::runtime_error("task failed"); });
+    group.post([&done]() { done++; });
+  }
+  BOOST_TEST(done == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()